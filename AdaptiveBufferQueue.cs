@@ -0,0 +1,269 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// Queue of byte buffers passed from a writer thread to a reader thread, where the maximum number of queued bytes
+    /// and the size of each buffer adapt to memory pressure and to the relative throughput of the two threads
+    /// </summary>
+    /// <remarks>
+    /// <para>
+    /// Data added by the writer is copied into batches of BatchSize bytes, which are queued when full;
+    /// when the queue holds QueuedBytesLimit bytes, the writer waits for the reader
+    /// </para>
+    /// <para>
+    /// After every 64 batches, the limits are adjusted:
+    /// when the memory load (see ResourceLimits.GetMemoryLoad) is high, the queue limit and the batch size are halved;
+    /// when it is low, the queue limit is doubled if both threads waited for each other (bursty throughput),
+    /// and the batch size is doubled if only the reader waited (the writer is slower, so fewer, larger batches reduce the hand-off overhead);
+    /// if only the writer waited, the reader is the bottleneck and a longer queue would not increase throughput, so the limits are unchanged
+    /// </para>
+    /// </remarks>
+    public class AdaptiveBufferQueue
+    {
+        private const int ADJUSTMENT_INTERVAL_BATCHES = 64;
+
+        private const double HIGH_MEMORY_LOAD = 0.9;
+
+        private const double LOW_MEMORY_LOAD = 0.5;
+
+        private const int MIN_BATCH_SIZE = 4096;
+
+        private const int MAX_BATCH_SIZE = 262144;
+
+        // The queue limit can shrink or grow by this factor, relative to the initial limit
+        private const int LIMIT_SCALE_FACTOR = 8;
+
+        private readonly object mLock = new();
+
+        private readonly Queue<byte[]> mQueue = new();
+
+        private readonly ResourceLimits mResourceLimits;
+
+        private readonly long mMinQueuedBytesLimit;
+
+        private readonly long mMaxQueuedBytesLimit;
+
+        private readonly Stopwatch mWriterWaitTime = new();
+
+        private byte[] mBatch;
+
+        private int mBatchLength;
+
+        private int mBatchesSinceAdjustment;
+
+        private long mQueuedBytes;
+
+        private bool mAddingCompleted;
+
+        private bool mReaderWaited;
+
+        private bool mWriterWaited;
+
+        /// <summary>
+        /// Current size of the queued buffers, in bytes
+        /// </summary>
+        public int BatchSize { get; private set; }
+
+        /// <summary>
+        /// Number of times the limits were increased
+        /// </summary>
+        public int GrowCount { get; private set; }
+
+        /// <summary>
+        /// Maximum number of bytes queued at once
+        /// </summary>
+        public long PeakQueuedBytes { get; private set; }
+
+        /// <summary>
+        /// Current maximum number of queued bytes; when reached, the writer waits for the reader
+        /// </summary>
+        public long QueuedBytesLimit { get; private set; }
+
+        /// <summary>
+        /// Number of times the limits were decreased due to memory pressure
+        /// </summary>
+        public int ShrinkCount { get; private set; }
+
+        /// <summary>
+        /// Total time the writer waited for the reader
+        /// </summary>
+        public TimeSpan WriterWaitTime => mWriterWaitTime.Elapsed;
+
+        /// <summary>
+        /// Constructor
+        /// </summary>
+        /// <param name="initialBatchSize">Initial size of each queued buffer, in bytes</param>
+        /// <param name="initialCapacity">Initial maximum number of queued buffers</param>
+        /// <param name="resourceLimits">Resource limits, used to determine the memory load</param>
+        public AdaptiveBufferQueue(int initialBatchSize, int initialCapacity, ResourceLimits resourceLimits)
+        {
+            mResourceLimits = resourceLimits;
+
+            BatchSize = Math.Max(MIN_BATCH_SIZE, Math.Min(MAX_BATCH_SIZE, initialBatchSize));
+            QueuedBytesLimit = (long)BatchSize * Math.Max(1, initialCapacity);
+
+            mMinQueuedBytesLimit = Math.Max(MIN_BATCH_SIZE * 4, QueuedBytesLimit / LIMIT_SCALE_FACTOR);
+            mMaxQueuedBytesLimit = QueuedBytesLimit * LIMIT_SCALE_FACTOR;
+
+            if (resourceLimits.MemoryBudgetBytes > 0)
+            {
+                // Never queue more than 1/16 of the memory budget
+                mMaxQueuedBytesLimit = Math.Max(QueuedBytesLimit, Math.Min(mMaxQueuedBytesLimit, resourceLimits.MemoryBudgetBytes / 16));
+            }
+
+            mBatch = new byte[BatchSize];
+        }
+
+        /// <summary>
+        /// Copy data to the queue, waiting if the queue is full
+        /// </summary>
+        /// <param name="buffer">Buffer</param>
+        /// <param name="offset">Offset of the first byte to copy</param>
+        /// <param name="count">Number of bytes to copy</param>
+        public void Add(byte[] buffer, int offset, int count)
+        {
+            if (mAddingCompleted)
+                throw new InvalidOperationException("Data cannot be added after CompleteAdding has been called");
+
+            while (count > 0)
+            {
+                var bytesToCopy = Math.Min(count, mBatch.Length - mBatchLength);
+                Buffer.BlockCopy(buffer, offset, mBatch, mBatchLength, bytesToCopy);
+
+                mBatchLength += bytesToCopy;
+                offset += bytesToCopy;
+                count -= bytesToCopy;
+
+                if (mBatchLength == mBatch.Length)
+                {
+                    EnqueueBatch();
+                }
+            }
+        }
+
+        private void AdjustLimits()
+        {
+            var memoryLoad = mResourceLimits.GetMemoryLoad();
+
+            if (memoryLoad >= HIGH_MEMORY_LOAD)
+            {
+                if (QueuedBytesLimit > mMinQueuedBytesLimit || BatchSize > MIN_BATCH_SIZE)
+                {
+                    QueuedBytesLimit = Math.Max(mMinQueuedBytesLimit, QueuedBytesLimit / 2);
+                    BatchSize = Math.Max(MIN_BATCH_SIZE, BatchSize / 2);
+                    ShrinkCount++;
+                }
+            }
+            else if (memoryLoad < LOW_MEMORY_LOAD)
+            {
+                if (mWriterWaited && mReaderWaited && QueuedBytesLimit < mMaxQueuedBytesLimit)
+                {
+                    QueuedBytesLimit = Math.Min(mMaxQueuedBytesLimit, QueuedBytesLimit * 2);
+                    GrowCount++;
+                }
+                else if (mReaderWaited && !mWriterWaited && BatchSize < MAX_BATCH_SIZE && BatchSize * 2L <= QueuedBytesLimit / 4)
+                {
+                    BatchSize *= 2;
+                    GrowCount++;
+                }
+            }
+
+            mWriterWaited = false;
+            mReaderWaited = false;
+            mBatchesSinceAdjustment = 0;
+        }
+
+        /// <summary>
+        /// Queue any partially filled buffer, then signal the reader that no more data will be added
+        /// </summary>
+        public void CompleteAdding()
+        {
+            if (mAddingCompleted)
+                return;
+
+            if (mBatchLength > 0)
+            {
+                var lastBatch = new byte[mBatchLength];
+                Buffer.BlockCopy(mBatch, 0, lastBatch, 0, mBatchLength);
+                mBatch = lastBatch;
+                EnqueueBatch();
+            }
+
+            lock (mLock)
+            {
+                mAddingCompleted = true;
+                Monitor.PulseAll(mLock);
+            }
+        }
+
+        private void EnqueueBatch()
+        {
+            lock (mLock)
+            {
+                // Always allow one batch in the queue, even if it is larger than the limit
+                if (mQueuedBytes + mBatch.Length > QueuedBytesLimit && mQueue.Count > 0)
+                {
+                    mWriterWaited = true;
+                    mWriterWaitTime.Start();
+
+                    while (mQueuedBytes + mBatch.Length > QueuedBytesLimit && mQueue.Count > 0)
+                    {
+                        Monitor.Wait(mLock);
+                    }
+
+                    mWriterWaitTime.Stop();
+                }
+
+                mQueue.Enqueue(mBatch);
+                mQueuedBytes += mBatch.Length;
+
+                if (mQueuedBytes > PeakQueuedBytes)
+                    PeakQueuedBytes = mQueuedBytes;
+
+                Monitor.PulseAll(mLock);
+
+                mBatchesSinceAdjustment++;
+                if (mBatchesSinceAdjustment >= ADJUSTMENT_INTERVAL_BATCHES)
+                {
+                    AdjustLimits();
+                }
+            }
+
+            mBatch = new byte[BatchSize];
+            mBatchLength = 0;
+        }
+
+        /// <summary>
+        /// Take the next buffer from the queue, waiting if the queue is empty
+        /// </summary>
+        /// <param name="buffer">Buffer; null if no more data</param>
+        /// <returns>True if a buffer was taken, false if the queue is empty and CompleteAdding has been called</returns>
+        public bool TryTake(out byte[] buffer)
+        {
+            lock (mLock)
+            {
+                while (mQueue.Count == 0)
+                {
+                    if (mAddingCompleted)
+                    {
+                        buffer = null;
+                        return false;
+                    }
+
+                    mReaderWaited = true;
+                    Monitor.Wait(mLock);
+                }
+
+                buffer = mQueue.Dequeue();
+                mQueuedBytes -= buffer.Length;
+
+                Monitor.PulseAll(mLock);
+                return true;
+            }
+        }
+    }
+}
@@ -0,0 +1,390 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.IO;
+using System.Text;
+using System.Threading;
+using PRISM;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// Writes messages to the console and (optionally) a log file using a background thread
+    /// </summary>
+    /// <remarks>
+    /// <para>
+    /// Messages are added to a queue and written in batches by a single writer thread,
+    /// so threads reporting status, warnings, or progress never wait on console or file I/O
+    /// </para>
+    /// <para>
+    /// The queue is bounded: when it is full, debug messages and progress text (such as progress dots) are discarded;
+    /// status messages, warnings, errors, and progress text that ends a line are always kept, so console lines are never merged
+    /// </para>
+    /// <para>
+    /// If writing to the log file fails (e.g. the disk is full), the error is shown once and logging to the file stops;
+    /// if writing to the console fails, console output stops; in both cases the queue continues to be drained
+    /// </para>
+    /// </remarks>
+    public sealed class AsyncLogWriter : IDisposable
+    {
+        /// <summary>
+        /// Default maximum number of queued messages
+        /// </summary>
+        public const int DEFAULT_QUEUE_CAPACITY = 10000;
+
+        private const int MAX_WAIT_MSEC = 250;
+
+        private enum MessageTypes
+        {
+            Debug = 0,
+            Status = 1,
+            Warning = 2,
+            Error = 3,
+            Progress = 4
+        }
+
+        private readonly struct LogMessage
+        {
+            public readonly MessageTypes MessageType;
+            public readonly string Message;
+            public readonly Exception Exception;
+            public readonly DateTime Timestamp;
+
+            public LogMessage(MessageTypes messageType, string message, Exception ex)
+            {
+                MessageType = messageType;
+                Message = message ?? string.Empty;
+                Exception = ex;
+                Timestamp = DateTime.Now;
+            }
+        }
+
+        private readonly int mCapacity;
+
+        private readonly ConcurrentQueue<LogMessage> mQueue = new();
+
+        private readonly AutoResetEvent mMessagesQueued = new(false);
+
+        private readonly string mLogFilePath;
+
+        private readonly Thread mWriterThread;
+
+        private volatile bool mStopRequested;
+
+        private int mDroppedMessages;
+
+        private int mQueuedMessages;
+
+        /// <summary>
+        /// Number of debug or progress messages discarded because the queue was full
+        /// </summary>
+        public int DroppedMessages => mDroppedMessages;
+
+        /// <summary>
+        /// Log file path; empty if not logging to a file
+        /// </summary>
+        public string LogFilePath => mLogFilePath;
+
+        /// <summary>
+        /// Constructor
+        /// </summary>
+        /// <param name="logFilePath">Log file path; if empty, messages are only written to the console</param>
+        /// <param name="capacity">Maximum number of queued messages</param>
+        public AsyncLogWriter(string logFilePath, int capacity = DEFAULT_QUEUE_CAPACITY)
+        {
+            mLogFilePath = logFilePath ?? string.Empty;
+            mCapacity = Math.Max(1, capacity);
+
+            mWriterThread = new Thread(WriteQueuedMessages)
+            {
+                IsBackground = true,
+                Name = "AsyncLogWriter"
+            };
+
+            mWriterThread.Start();
+        }
+
+        /// <summary>
+        /// Write the queued messages, then stop the writer thread
+        /// </summary>
+        public void Dispose()
+        {
+            if (mStopRequested)
+                return;
+
+            mStopRequested = true;
+            mMessagesQueued.Set();
+            mWriterThread.Join();
+            mMessagesQueued.Dispose();
+        }
+
+        private void Enqueue(MessageTypes messageType, string message, Exception ex = null)
+        {
+            // Reserve a slot before queuing, so that concurrent callers cannot exceed the capacity
+            var queuedMessages = Interlocked.Increment(ref mQueuedMessages);
+
+            if (queuedMessages > mCapacity && CanDiscard(messageType, message))
+            {
+                Interlocked.Decrement(ref mQueuedMessages);
+                Interlocked.Increment(ref mDroppedMessages);
+                return;
+            }
+
+            mQueue.Enqueue(new LogMessage(messageType, message, ex));
+            mMessagesQueued.Set();
+        }
+
+        /// <summary>
+        /// Debug messages and progress text can be discarded when the queue is full, unless the progress text ends a line
+        /// </summary>
+        private static bool CanDiscard(MessageTypes messageType, string message)
+        {
+            return messageType switch
+            {
+                MessageTypes.Debug => true,
+                MessageTypes.Progress => message == null || message.IndexOf('\n') < 0,
+                _ => false
+            };
+        }
+
+        private static string GetLogFileLine(LogMessage item)
+        {
+            var line = item.Timestamp.ToString("yyyy-MM-dd HH:mm:ss") + "\t" + item.MessageType + "\t" + item.Message;
+
+            return item.Exception == null ? line : line + "; " + item.Exception.Message;
+        }
+
+        /// <summary>
+        /// Queue a debug message
+        /// </summary>
+        /// <param name="message"></param>
+        public void ShowDebug(string message)
+        {
+            Enqueue(MessageTypes.Debug, message);
+        }
+
+        /// <summary>
+        /// Queue an error message
+        /// </summary>
+        /// <param name="message"></param>
+        /// <param name="ex">Optional exception</param>
+        public void ShowError(string message, Exception ex = null)
+        {
+            Enqueue(MessageTypes.Error, message, ex);
+        }
+
+        /// <summary>
+        /// Queue a status message
+        /// </summary>
+        /// <param name="message"></param>
+        public void ShowMessage(string message)
+        {
+            Enqueue(MessageTypes.Status, message);
+        }
+
+        /// <summary>
+        /// Queue text to be written to the console without a trailing newline, e.g. a progress dot
+        /// </summary>
+        /// <remarks>Progress text is not written to the log file</remarks>
+        /// <param name="text"></param>
+        public void ShowProgress(string text)
+        {
+            Enqueue(MessageTypes.Progress, text);
+        }
+
+        /// <summary>
+        /// Queue a warning message
+        /// </summary>
+        /// <param name="message"></param>
+        public void ShowWarning(string message)
+        {
+            Enqueue(MessageTypes.Warning, message);
+        }
+
+        /// <summary>
+        /// Close the log file after an error writing to it, and report the error
+        /// </summary>
+        /// <param name="logFileWriter">Log file writer; set to null</param>
+        /// <param name="ex">Exception</param>
+        private void CloseLogFileAfterError(ref StreamWriter logFileWriter, Exception ex)
+        {
+            try
+            {
+                logFileWriter.Dispose();
+            }
+            catch (Exception)
+            {
+                // Ignore errors closing the file; the error writing to it is reported below
+            }
+
+            logFileWriter = null;
+
+            try
+            {
+                ConsoleMsgUtils.ShowError("Error writing to the log file " + mLogFilePath + "; messages will no longer be logged", ex);
+            }
+            catch (Exception)
+            {
+                // The console is not available either
+            }
+        }
+
+        private void WriteQueuedMessages()
+        {
+            StreamWriter logFileWriter = null;
+            var consoleText = new StringBuilder();
+
+            // Set to false if writing to the console fails
+            var consoleAvailable = true;
+
+            try
+            {
+                if (!string.IsNullOrWhiteSpace(mLogFilePath))
+                {
+                    var logDirectory = Path.GetDirectoryName(Path.GetFullPath(mLogFilePath));
+                    if (!string.IsNullOrEmpty(logDirectory) && !Directory.Exists(logDirectory))
+                    {
+                        Directory.CreateDirectory(logDirectory);
+                    }
+
+                    logFileWriter = new StreamWriter(new FileStream(mLogFilePath, FileMode.Append, FileAccess.Write, FileShare.ReadWrite));
+                }
+            }
+            catch (Exception ex)
+            {
+                ConsoleMsgUtils.ShowError("Unable to open the log file " + mLogFilePath, ex);
+            }
+
+            while (true)
+            {
+                mMessagesQueued.WaitOne(MAX_WAIT_MSEC);
+
+                // Read this before draining the queue so that messages queued prior to Dispose() are written
+                var stopRequested = mStopRequested;
+
+                while (mQueue.TryDequeue(out var item))
+                {
+                    Interlocked.Decrement(ref mQueuedMessages);
+
+                    if (consoleAvailable)
+                    {
+                        consoleAvailable = WriteToConsole(item, consoleText);
+                    }
+
+                    if (logFileWriter != null && item.MessageType != MessageTypes.Progress && !string.IsNullOrWhiteSpace(item.Message))
+                    {
+                        try
+                        {
+                            logFileWriter.WriteLine(GetLogFileLine(item));
+                        }
+                        catch (Exception ex)
+                        {
+                            CloseLogFileAfterError(ref logFileWriter, ex);
+                        }
+                    }
+                }
+
+                if (consoleAvailable)
+                {
+                    consoleAvailable = FlushConsoleText(consoleText);
+                }
+
+                if (logFileWriter != null)
+                {
+                    try
+                    {
+                        logFileWriter.Flush();
+                    }
+                    catch (Exception ex)
+                    {
+                        CloseLogFileAfterError(ref logFileWriter, ex);
+                    }
+                }
+
+                if (stopRequested)
+                    break;
+            }
+
+            try
+            {
+                if (mDroppedMessages > 0 && consoleAvailable)
+                {
+                    Console.WriteLine();
+                    Console.WriteLine("Note: {0:#,##0} debug or progress messages were not shown since the message queue was full", mDroppedMessages);
+                }
+
+                logFileWriter?.Dispose();
+            }
+            catch (Exception)
+            {
+                // Ignore errors writing the final note or closing the log file
+            }
+        }
+
+        /// <summary>
+        /// Write pending console text, ignoring errors
+        /// </summary>
+        /// <returns>True if successful, false if writing to the console failed</returns>
+        private static bool FlushConsoleText(StringBuilder consoleText)
+        {
+            if (consoleText.Length == 0)
+                return true;
+
+            try
+            {
+                Console.Write(consoleText.ToString());
+                return true;
+            }
+            catch (Exception)
+            {
+                return false;
+            }
+            finally
+            {
+                consoleText.Clear();
+            }
+        }
+
+        /// <summary>
+        /// Show a message on the console; status messages and progress text are appended to consoleText, to be written in a single batch
+        /// </summary>
+        /// <returns>True if successful, false if writing to the console failed</returns>
+        private static bool WriteToConsole(LogMessage item, StringBuilder consoleText)
+        {
+            if (item.MessageType is MessageTypes.Status or MessageTypes.Progress)
+            {
+                // Plain text is batched into a single console write
+                consoleText.Append(item.Message);
+                if (item.MessageType == MessageTypes.Status)
+                    consoleText.AppendLine();
+
+                return true;
+            }
+
+            // ConsoleMsgUtils changes the console colors, so write any pending text first
+            if (!FlushConsoleText(consoleText))
+                return false;
+
+            try
+            {
+                switch (item.MessageType)
+                {
+                    case MessageTypes.Debug:
+                        ConsoleMsgUtils.ShowDebug(item.Message);
+                        break;
+                    case MessageTypes.Warning:
+                        ConsoleMsgUtils.ShowWarning(item.Message);
+                        break;
+                    default:
+                        ConsoleMsgUtils.ShowError(item.Message, item.Exception);
+                        break;
+                }
+
+                return true;
+            }
+            catch (Exception)
+            {
+                return false;
+            }
+        }
+    }
+}
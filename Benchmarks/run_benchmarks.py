@@ -0,0 +1,220 @@
+#!/usr/bin/python
+
+#
+# Benchmark regression gate for PeptideListToXML
+#
+# Converts each example dataset with the /PerfStats switch, then compares the per-phase
+# throughput (PSMs/sec and MB/sec), allocated bytes, and peak working set to a stored
+# baseline. The exit code is non-zero if any metric regressed by more than its tolerance.
+#
+# Example usage:
+#   Create or update the baseline:
+#     python run_benchmarks.py --save-baseline
+#   Compare to the baseline (allowing 10% slowdown, 20% more memory):
+#     python run_benchmarks.py --tolerance 10 --metric-tolerance peakWorkingSetBytes=20
+#
+# Exit code is 0 if no regressions, 1 if a metric regressed, and 2 if a conversion failed
+#
+# 2026-10-18 - Initial version
+#
+
+import argparse
+import datetime
+import json
+import os
+import platform
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Use the dataset definitions from the golden-output harness
+sys.path.insert(0, os.path.join(REPO_DIR, 'Validation'))
+from verify_golden_output import DATASETS, build_command
+
+DEFAULT_BASELINE_FILE = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'benchmark_baseline.json')
+
+PERF_STATS_FILE_SUFFIX = '_PerfStats.json'
+
+# Metric name and whether larger values are better
+METRICS = [
+    ('psmsPerSecond', True),
+    ('mbPerSecond', True),
+    ('allocatedBytes', False),
+    ('peakWorkingSetBytes', False),
+]
+
+
+def run_dataset(runner, exe_path, data_dir, dataset, output_dir):
+    """Convert a dataset once; returns the parsed _PerfStats.json file, or None if an error"""
+    shutil.rmtree(output_dir, ignore_errors=True)
+    os.makedirs(output_dir)
+
+    args = dataset['args'] + ['/PerfStats', '/O:' + output_dir]
+    log_path = os.path.join(output_dir, 'PeptideListToXML_ConsoleOutput.txt')
+    with open(log_path, 'w') as log_file:
+        process = subprocess.run(build_command(runner, exe_path, args),
+                                 cwd=os.path.join(data_dir, dataset['directory']),
+                                 stdout=log_file, stderr=subprocess.STDOUT)
+
+    stats_files = [name for name in os.listdir(output_dir) if name.endswith(PERF_STATS_FILE_SUFFIX)]
+    if process.returncode != 0 or len(stats_files) != 1:
+        print('  Conversion failed (exit code %d); see %s' % (process.returncode, log_path))
+        return None
+
+    with open(os.path.join(output_dir, stats_files[0])) as stats_file:
+        return json.load(stats_file)
+
+
+def summarize_runs(runs):
+    """Combine the runs for a dataset, returning the median value of each metric for each phase"""
+    summary = {}
+    for phase_name in [phase['name'] for phase in runs[0]['phases']]:
+        values = {}
+        for metric, _ in METRICS:
+            values[metric] = statistics.median(
+                phase[metric] for run in runs for phase in run['phases'] if phase['name'] == phase_name)
+        summary[phase_name] = values
+
+    return summary
+
+
+def compare_to_baseline(baseline, results, default_tolerance, metric_tolerances):
+    """Print a comparison table; returns the number of regressions"""
+    regressions = 0
+    print()
+    print('%-20s %-16s %-20s %14s %14s %9s' % ('Dataset', 'Phase', 'Metric', 'Baseline', 'Current', 'Change'))
+
+    for dataset_name, phases in results.items():
+        if dataset_name not in baseline['datasets']:
+            print('%-20s not in the baseline; skipped' % dataset_name)
+            continue
+
+        for phase_name, values in phases.items():
+            baseline_values = baseline['datasets'][dataset_name].get(phase_name)
+            if baseline_values is None:
+                continue
+
+            for metric, larger_is_better in METRICS:
+                baseline_value = baseline_values.get(metric, 0)
+                current_value = values[metric]
+                if baseline_value <= 0:
+                    continue
+
+                percent_change = (current_value - baseline_value) / baseline_value * 100
+                tolerance = metric_tolerances.get(metric, default_tolerance)
+                regressed = percent_change < -tolerance if larger_is_better else percent_change > tolerance
+
+                print('%-20s %-16s %-20s %14.6g %14.6g %+8.1f%%%s' % (
+                    dataset_name, phase_name, metric, baseline_value, current_value, percent_change,
+                    '  REGRESSION' if regressed else ''))
+
+                if regressed:
+                    regressions += 1
+
+    return regressions
+
+
+def parse_metric_tolerances(items):
+    metric_names = [metric for metric, _ in METRICS]
+    tolerances = {}
+    for item in items:
+        metric, _, value = item.partition('=')
+        if metric not in metric_names:
+            raise ValueError('Unknown metric %s; should be one of %s' % (metric, ', '.join(metric_names)))
+        tolerances[metric] = float(value)
+
+    return tolerances
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark PeptideListToXML and compare to a stored baseline')
+    parser.add_argument('--exe', default=os.path.join(REPO_DIR, 'bin', 'PeptideListToXML.exe'),
+                        help='Path to PeptideListToXML.exe')
+    parser.add_argument('--runner', default='',
+                        help='Optional program used to start the executable, e.g. mono or dotnet')
+    parser.add_argument('--data-dir', default=os.path.join(REPO_DIR, 'Data'),
+                        help='Directory with the example datasets')
+    parser.add_argument('--datasets', nargs='+', choices=[item['name'] for item in DATASETS],
+                        default=[item['name'] for item in DATASETS], help='Datasets to benchmark')
+    parser.add_argument('--iterations', type=int, default=3,
+                        help='Number of conversions per dataset; the median of each metric is used')
+    parser.add_argument('--baseline', default=DEFAULT_BASELINE_FILE, help='Baseline JSON file')
+    parser.add_argument('--save-baseline', action='store_true',
+                        help='Store the results as the new baseline instead of comparing')
+    parser.add_argument('--tolerance', type=float, default=10,
+                        help='Allowed regression, in percent, for all metrics')
+    parser.add_argument('--metric-tolerance', nargs='*', default=[],
+                        help='Per-metric tolerances, e.g. peakWorkingSetBytes=20 psmsPerSecond=5')
+    options = parser.parse_args()
+
+    exe_path = os.path.abspath(options.exe)
+    if not os.path.exists(exe_path):
+        print('Executable not found: %s' % exe_path)
+        return 2
+
+    metric_tolerances = parse_metric_tolerances(options.metric_tolerance)
+
+    baseline = None
+    if not options.save_baseline:
+        if not os.path.exists(options.baseline):
+            print('Baseline file not found: %s' % options.baseline)
+            print('Use --save-baseline to create it')
+            return 2
+
+        with open(options.baseline) as baseline_file:
+            baseline = json.load(baseline_file)
+
+    work_dir = tempfile.mkdtemp(prefix='PeptideListToXML_Benchmark_')
+    results = {}
+
+    try:
+        for dataset in DATASETS:
+            if dataset['name'] not in options.datasets:
+                continue
+
+            print('Benchmarking %s' % dataset['name'])
+            runs = []
+            for iteration in range(options.iterations):
+                stats = run_dataset(options.runner, exe_path, options.data_dir, dataset,
+                                    os.path.join(work_dir, dataset['name']))
+                if stats is None:
+                    return 2
+                runs.append(stats)
+
+            results[dataset['name']] = summarize_runs(runs)
+    finally:
+        shutil.rmtree(work_dir, ignore_errors=True)
+
+    if options.save_baseline:
+        baseline = {
+            'created': datetime.datetime.now().isoformat(timespec='seconds'),
+            'machine': platform.node(),
+            'iterations': options.iterations,
+            'datasets': results,
+        }
+        with open(options.baseline, 'w') as baseline_file:
+            json.dump(baseline, baseline_file, indent=2)
+
+        print('Baseline saved to %s' % options.baseline)
+        return 0
+
+    if baseline.get('machine') != platform.node():
+        print('Warning: baseline was created on %s; results may not be comparable' % baseline.get('machine'))
+
+    regressions = compare_to_baseline(baseline, results, options.tolerance, metric_tolerances)
+
+    print()
+    if regressions > 0:
+        print('%d metric(s) regressed by more than the allowed tolerance' % regressions)
+        return 1
+
+    print('No regressions')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
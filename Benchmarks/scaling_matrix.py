@@ -0,0 +1,323 @@
+#!/usr/bin/python
+
+#
+# Thread-scaling and data-size scaling test matrix for PeptideListToXML
+#
+# Converts each example dataset at several synthetic input sizes (the dataset's PHRP files
+# replicated N times, with offset scan numbers and result IDs) using a range of thread counts.
+# Wall time, CPU time, CPU utilization, and peak memory are recorded for each run, along with
+# the speedup and parallel efficiency relative to a single thread, and the data-size efficiency
+# relative to the smallest input. Results are written to a CSV file.
+#
+# Example usage:
+#   python scaling_matrix.py --threads 1 2 4 8 --sizes 1 10 100
+#   python scaling_matrix.py --datasets XTandem --sizes 1 5 --output xtandem_scaling.csv
+#
+# Thread counts other than 1 are only run if the executable supports the /Threads switch
+# Peak memory is read from the _PerfStats.json file; CPU time requires a POSIX system or the psutil module
+#
+# 2026-10-18 - Initial version
+#
+
+import argparse
+import csv
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Use the dataset definitions from the golden-output harness
+sys.path.insert(0, os.path.join(REPO_DIR, 'Validation'))
+from verify_golden_output import DATASETS, build_command, get_supported_switches
+
+try:
+    import psutil
+except ImportError:
+    psutil = None
+
+PERF_STATS_FILE_SUFFIX = '_PerfStats.json'
+
+# Columns in the PHRP and MASIC files that need to be unique in each replicate; keys are the offset group
+OFFSET_COLUMNS = {
+    'ResultID': 'result', 'Result_ID': 'result',
+    'Scan': 'scan', 'ScanNumber': 'scan',
+    'SpecIndex': 'spec_index',
+    'Group_ID': 'group',
+}
+
+CSV_COLUMNS = ['dataset', 'size_factor', 'input_mb', 'psms', 'threads', 'wall_seconds', 'cpu_seconds',
+               'cpu_utilization', 'peak_working_set_mb', 'speedup', 'parallel_efficiency', 'size_efficiency']
+
+
+def read_tab_delimited(file_path):
+    with open(file_path, newline='') as reader:
+        header = reader.readline().rstrip('\r\n').split('\t')
+        rows = [line.rstrip('\r\n').split('\t') for line in reader if line.strip()]
+    return header, rows
+
+
+def get_offset_column_indices(header):
+    return [(index, OFFSET_COLUMNS[name]) for index, name in enumerate(header) if name in OFFSET_COLUMNS]
+
+
+def create_synthetic_dataset(source_dir, dataset_prefix, size_factor, target_dir):
+    """
+    Copy the files for a dataset to target_dir, replicating the rows of each tab-delimited file
+    whose name starts with dataset_prefix size_factor times
+    Scan numbers, result IDs, spectrum indices, and group IDs are offset in each replicate so that they stay unique
+    """
+    os.makedirs(target_dir, exist_ok=True)
+
+    files_to_replicate = []
+    for name in os.listdir(source_dir):
+        source_path = os.path.join(source_dir, name)
+        if not os.path.isfile(source_path) or name.lower().endswith('.pepxml'):
+            continue
+
+        if name.startswith(dataset_prefix) and name.lower().endswith('.txt'):
+            files_to_replicate.append(name)
+        else:
+            shutil.copy2(source_path, os.path.join(target_dir, name))
+
+    # Determine the maximum value of each offset group, across all files
+    maximums = {}
+    cached_files = {}
+    for name in files_to_replicate:
+        header, rows = read_tab_delimited(os.path.join(source_dir, name))
+        cached_files[name] = (header, rows)
+        for index, group in get_offset_column_indices(header):
+            for row in rows:
+                if index < len(row) and row[index].isdigit():
+                    maximums[group] = max(maximums.get(group, 0), int(row[index]))
+
+    for name in files_to_replicate:
+        header, rows = cached_files[name]
+        offset_columns = get_offset_column_indices(header)
+
+        with open(os.path.join(target_dir, name), 'w', newline='') as writer:
+            writer.write('\t'.join(header) + '\r\n')
+
+            # Files without offset columns (e.g. SeqInfo and ModSummary) are keyed by sequence; copy them once
+            replicates = size_factor if offset_columns else 1
+
+            for replicate in range(replicates):
+                for row in rows:
+                    if replicate > 0:
+                        row = list(row)
+                        for index, group in offset_columns:
+                            if index < len(row) and row[index].isdigit():
+                                row[index] = str(int(row[index]) + replicate * maximums[group])
+
+                    writer.write('\t'.join(row) + '\r\n')
+
+
+def get_input_file_name(dataset):
+    for arg in dataset['args']:
+        if arg.upper().startswith('/I:'):
+            return arg[3:]
+    return ''
+
+
+def run_conversion(runner, exe_path, working_dir, args, output_dir):
+    """
+    Convert a dataset once
+    Returns a dictionary with wall_seconds, cpu_seconds, peak_working_set_mb, and psms, or None if an error
+    """
+    shutil.rmtree(output_dir, ignore_errors=True)
+    os.makedirs(output_dir)
+
+    log_path = os.path.join(output_dir, 'PeptideListToXML_ConsoleOutput.txt')
+    cpu_seconds = None
+
+    with open(log_path, 'w') as log_file:
+        start_time = time.perf_counter()
+        process = subprocess.Popen(build_command(runner, exe_path, args + ['/PerfStats', '/O:' + output_dir]),
+                                   cwd=working_dir, stdout=log_file, stderr=subprocess.STDOUT)
+
+        if hasattr(os, 'wait4'):
+            _, status, usage = os.wait4(process.pid, 0)
+            process.returncode = os.waitstatus_to_exitcode(status) if hasattr(os, 'waitstatus_to_exitcode') else status
+            cpu_seconds = usage.ru_utime + usage.ru_stime
+        elif psutil is not None:
+            monitor = psutil.Process(process.pid)
+            while process.poll() is None:
+                try:
+                    times = monitor.cpu_times()
+                    cpu_seconds = times.user + times.system
+                except psutil.Error:
+                    pass
+                time.sleep(0.05)
+        else:
+            process.wait()
+
+        wall_seconds = time.perf_counter() - start_time
+
+    stats_files = [name for name in os.listdir(output_dir) if name.endswith(PERF_STATS_FILE_SUFFIX)]
+    if process.returncode != 0 or len(stats_files) != 1:
+        print('  Conversion failed (exit code %d); see %s' % (process.returncode, log_path))
+        return None
+
+    with open(os.path.join(output_dir, stats_files[0])) as stats_file:
+        stats = json.load(stats_file)
+
+    return {
+        'wall_seconds': wall_seconds,
+        'cpu_seconds': cpu_seconds,
+        'peak_working_set_mb': max(phase['peakWorkingSetBytes'] for phase in stats['phases']) / 1024.0 / 1024.0,
+        'psms': stats['phases'][0]['psms'],
+    }
+
+
+def median_of_runs(runs, key):
+    values = [run[key] for run in runs if run[key] is not None]
+    return statistics.median(values) if values else None
+
+
+def add_scaling_columns(results):
+    """Add speedup, parallel efficiency, and size efficiency to each result"""
+    for result in results:
+        same_size = [item for item in results
+                     if item['dataset'] == result['dataset'] and item['size_factor'] == result['size_factor']]
+        single_thread = min(same_size, key=lambda item: item['threads'])
+
+        # If 1 thread was not tested, assume linear scaling up to the smallest thread count
+        speedup = single_thread['wall_seconds'] / result['wall_seconds']
+        result['speedup'] = speedup * single_thread['threads']
+        result['parallel_efficiency'] = result['speedup'] / result['threads']
+
+        same_threads = [item for item in results
+                        if item['dataset'] == result['dataset'] and item['threads'] == result['threads']]
+        smallest = min(same_threads, key=lambda item: item['size_factor'])
+
+        # 1.0 means that wall time grows linearly with input size
+        expected_seconds = smallest['wall_seconds'] * result['size_factor'] / smallest['size_factor']
+        result['size_efficiency'] = expected_seconds / result['wall_seconds']
+
+        if result['cpu_seconds'] is not None:
+            result['cpu_utilization'] = result['cpu_seconds'] / result['wall_seconds']
+        else:
+            result['cpu_utilization'] = None
+
+
+def format_value(value):
+    if value is None:
+        return ''
+    if isinstance(value, float):
+        return '%.4f' % value
+    return value
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Measure how PeptideListToXML scales with thread count and input size')
+    parser.add_argument('--exe', default=os.path.join(REPO_DIR, 'bin', 'PeptideListToXML.exe'),
+                        help='Path to PeptideListToXML.exe')
+    parser.add_argument('--runner', default='',
+                        help='Optional program used to start the executable, e.g. mono or dotnet')
+    parser.add_argument('--data-dir', default=os.path.join(REPO_DIR, 'Data'),
+                        help='Directory with the example datasets')
+    parser.add_argument('--datasets', nargs='+', choices=[item['name'] for item in DATASETS],
+                        default=[item['name'] for item in DATASETS], help='Datasets to convert')
+    parser.add_argument('--threads', nargs='+', type=int,
+                        default=sorted({1, 2, 4, os.cpu_count() or 1}),
+                        help='Thread counts to test (default is 1, 2, 4, and the number of cores)')
+    parser.add_argument('--sizes', nargs='+', type=int, default=[1, 10, 100],
+                        help='Input size factors; the example files are replicated this many times')
+    parser.add_argument('--iterations', type=int, default=1,
+                        help='Number of conversions per combination; the median is used')
+    parser.add_argument('--output', default='scaling_matrix.csv', help='CSV file to create')
+    parser.add_argument('--work-dir', default='',
+                        help='Directory for the synthetic datasets; a temporary directory is used if not defined')
+    options = parser.parse_args()
+
+    exe_path = os.path.abspath(options.exe)
+    if not os.path.exists(exe_path):
+        print('Executable not found: %s' % exe_path)
+        return 2
+
+    thread_counts = sorted(set(options.threads))
+    if 'threads' not in get_supported_switches(options.runner, exe_path):
+        print('The /Threads switch is not supported by this build; only measuring data-size scaling')
+        thread_counts = [1]
+
+    work_dir = os.path.abspath(options.work_dir) if options.work_dir else tempfile.mkdtemp(prefix='PeptideListToXML_Scaling_')
+    results = []
+
+    try:
+        for dataset in DATASETS:
+            if dataset['name'] not in options.datasets:
+                continue
+
+            source_dir = os.path.join(options.data_dir, dataset['directory'])
+            dataset_prefix = os.path.splitext(os.path.basename(dataset['reference']))[0]
+            input_file_name = get_input_file_name(dataset)
+
+            for size_factor in sorted(set(options.sizes)):
+                print('Creating %dx synthetic input for %s' % (size_factor, dataset['name']))
+                synthetic_dir = os.path.join(work_dir, '%s_%dx' % (dataset['name'], size_factor))
+                shutil.rmtree(synthetic_dir, ignore_errors=True)
+                create_synthetic_dataset(source_dir, dataset_prefix, size_factor, synthetic_dir)
+
+                input_mb = os.path.getsize(os.path.join(synthetic_dir, input_file_name)) / 1024.0 / 1024.0
+
+                for threads in thread_counts:
+                    args = list(dataset['args'])
+                    if len(thread_counts) > 1:
+                        args.append('/Threads:%d' % threads)
+
+                    runs = []
+                    for iteration in range(options.iterations):
+                        run = run_conversion(options.runner, exe_path, synthetic_dir, args,
+                                             os.path.join(synthetic_dir, 'Output'))
+                        if run is None:
+                            return 2
+                        runs.append(run)
+
+                    result = {
+                        'dataset': dataset['name'],
+                        'size_factor': size_factor,
+                        'input_mb': input_mb,
+                        'psms': runs[0]['psms'],
+                        'threads': threads,
+                        'wall_seconds': median_of_runs(runs, 'wall_seconds'),
+                        'cpu_seconds': median_of_runs(runs, 'cpu_seconds'),
+                        'peak_working_set_mb': median_of_runs(runs, 'peak_working_set_mb'),
+                    }
+                    results.append(result)
+
+                    print('  %3d thread(s): %8.2f seconds, %8.1f MB peak' % (
+                        threads, result['wall_seconds'], result['peak_working_set_mb']))
+
+                shutil.rmtree(synthetic_dir, ignore_errors=True)
+    finally:
+        if not options.work_dir:
+            shutil.rmtree(work_dir, ignore_errors=True)
+
+    add_scaling_columns(results)
+
+    with open(options.output, 'w', newline='') as csv_file:
+        writer = csv.writer(csv_file)
+        writer.writerow(CSV_COLUMNS)
+        for result in results:
+            writer.writerow([format_value(result[column]) for column in CSV_COLUMNS])
+
+    print()
+    print('%-20s %6s %8s %10s %8s %8s %10s' % ('Dataset', 'Size', 'Threads', 'Seconds', 'Speedup', 'CPU', 'Peak MB'))
+    for result in results:
+        print('%-20s %5dx %8d %10.2f %8.2f %8s %10.1f' % (
+            result['dataset'], result['size_factor'], result['threads'], result['wall_seconds'], result['speedup'],
+            '' if result['cpu_utilization'] is None else '%.2f' % result['cpu_utilization'],
+            result['peak_working_set_mb']))
+
+    print()
+    print('Results saved to %s' % options.output)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,141 @@
+#!/usr/bin/python
+
+#
+# Startup benchmark for PeptideListToXML
+#
+# Converts a small example dataset (X!Tandem by default) several times with the /PerfStats switch
+# and reports the time to first spectrum (from the start of the process until the first
+# spectrum_query is written, as reported in the _PerfStats.json file) and the total wall time.
+# For small datasets these are dominated by runtime startup and JIT compilation, so this is used
+# to compare a JIT-compiled build with a precompiled (NGen) build.
+#
+# Example usage:
+#   python startup_benchmark.py
+#   python startup_benchmark.py --exe ..\bin\Release\PeptideListToXML.exe ..\bin\NGen\PeptideListToXML.exe
+#   python startup_benchmark.py --runner mono --iterations 20
+#
+# The first conversion with each executable is a warm-up run and is not included in the statistics;
+# it also creates the multi-core JIT profile used by subsequent runs
+#
+# Exit code is 0 if successful and 2 if a conversion failed
+#
+# 2026-10-18 - Initial version
+#
+
+import argparse
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Use the dataset definitions from the golden-output harness
+sys.path.insert(0, os.path.join(REPO_DIR, 'Validation'))
+from verify_golden_output import DATASETS, build_command
+
+PERF_STATS_FILE_SUFFIX = '_PerfStats.json'
+
+
+def run_dataset(runner, exe_path, data_dir, dataset, output_dir):
+    """Convert the dataset once; returns a tuple of (time to first spectrum, wall time), or None if an error"""
+    shutil.rmtree(output_dir, ignore_errors=True)
+    os.makedirs(output_dir)
+
+    args = dataset['args'] + ['/PerfStats', '/O:' + output_dir]
+    log_path = os.path.join(output_dir, 'PeptideListToXML_ConsoleOutput.txt')
+    with open(log_path, 'w') as log_file:
+        start_time = time.perf_counter()
+        process = subprocess.run(build_command(runner, exe_path, args),
+                                 cwd=os.path.join(data_dir, dataset['directory']),
+                                 stdout=log_file, stderr=subprocess.STDOUT)
+        wall_time = time.perf_counter() - start_time
+
+    stats_files = [name for name in os.listdir(output_dir) if name.endswith(PERF_STATS_FILE_SUFFIX)]
+    if process.returncode != 0 or len(stats_files) != 1:
+        print('  Conversion failed (exit code %d); see %s' % (process.returncode, log_path))
+        return None
+
+    with open(os.path.join(output_dir, stats_files[0])) as stats_file:
+        stats = json.load(stats_file)
+
+    return stats.get('timeToFirstSpectrumSeconds', 0), wall_time
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Measure the time to first spectrum of PeptideListToXML')
+    parser.add_argument('--exe', nargs='+', default=[os.path.join(REPO_DIR, 'bin', 'PeptideListToXML.exe')],
+                        help='One or more paths to PeptideListToXML.exe; results are compared to the first one')
+    parser.add_argument('--runner', default='',
+                        help='Optional program used to start the executable, e.g. mono or dotnet')
+    parser.add_argument('--data-dir', default=os.path.join(REPO_DIR, 'Data'),
+                        help='Directory with the example datasets')
+    parser.add_argument('--dataset', choices=[item['name'] for item in DATASETS], default='XTandem',
+                        help='Dataset to convert')
+    parser.add_argument('--iterations', type=int, default=10,
+                        help='Number of timed conversions per executable')
+    options = parser.parse_args()
+
+    exe_paths = [os.path.abspath(path) for path in options.exe]
+    for exe_path in exe_paths:
+        if not os.path.exists(exe_path):
+            print('Executable not found: %s' % exe_path)
+            return 2
+
+    dataset = [item for item in DATASETS if item['name'] == options.dataset][0]
+
+    work_dir = tempfile.mkdtemp(prefix='PeptideListToXML_Startup_')
+    results = []
+
+    try:
+        for exe_path in exe_paths:
+            print('Converting %s with %s' % (dataset['name'], exe_path))
+            output_dir = os.path.join(work_dir, 'Output')
+
+            # Warm-up run, loading the executable and data files into the file system cache
+            if run_dataset(options.runner, exe_path, options.data_dir, dataset, output_dir) is None:
+                return 2
+
+            first_spectrum_times = []
+            wall_times = []
+            for iteration in range(options.iterations):
+                run = run_dataset(options.runner, exe_path, options.data_dir, dataset, output_dir)
+                if run is None:
+                    return 2
+
+                first_spectrum_times.append(run[0])
+                wall_times.append(run[1])
+
+            results.append((exe_path, first_spectrum_times, wall_times))
+    finally:
+        shutil.rmtree(work_dir, ignore_errors=True)
+
+    print()
+    print('%-40s %-22s %10s %10s %10s %9s' % ('Executable', 'Metric', 'Median', 'Min', 'Max', 'Change'))
+
+    baseline_medians = None
+    for exe_path, first_spectrum_times, wall_times in results:
+        medians = []
+        for metric, values in (('Time to first spectrum', first_spectrum_times), ('Wall time', wall_times)):
+            median = statistics.median(values)
+            medians.append(median)
+
+            change = ''
+            if baseline_medians is not None and baseline_medians[len(medians) - 1] > 0:
+                change = '%+8.1f%%' % ((median - baseline_medians[len(medians) - 1]) / baseline_medians[len(medians) - 1] * 100)
+
+            print('%-40s %-22s %9.3fs %9.3fs %9.3fs %9s' % (
+                os.path.relpath(exe_path)[-40:], metric, median, min(values), max(values), change))
+
+        if baseline_medians is None:
+            baseline_medians = medians
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,173 @@
+﻿using System.Collections.Generic;
+using PHRPReader.Data;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// Values of a PSM that are written to the PepXML file
+    /// </summary>
+    /// <remarks>
+    /// PSMs read by PHRPReader include the data line text, a score dictionary, and other values not used by this program;
+    /// this class is cached instead, reducing the memory used by each PSM
+    /// </remarks>
+    public class CachedPSM
+    {
+        /// <summary>
+        /// Result ID
+        /// </summary>
+        public int ResultID { get; }
+
+        /// <summary>
+        /// Scan number
+        /// </summary>
+        public int ScanNumber { get; }
+
+        /// <summary>
+        /// Score rank
+        /// </summary>
+        public int ScoreRank { get; }
+
+        /// <summary>
+        /// Sequence ID
+        /// </summary>
+        public int SeqID { get; }
+
+        /// <summary>
+        /// Number of tryptic termini
+        /// </summary>
+        public short NumTrypticTermini { get; }
+
+        /// <summary>
+        /// Number of missed cleavages
+        /// </summary>
+        public short NumMissedCleavages { get; }
+
+        /// <summary>
+        /// Monoisotopic mass of the peptide, including modifications
+        /// </summary>
+        public double PeptideMonoisotopicMass { get; }
+
+        /// <summary>
+        /// Peptide sequence, including prefix, suffix, and any mod symbols
+        /// </summary>
+        public string Peptide { get; }
+
+        /// <summary>
+        /// Peptide sequence with numeric mod masses
+        /// </summary>
+        public string PeptideWithNumericMods { get; }
+
+        /// <summary>
+        /// First protein for this PSM
+        /// </summary>
+        public string ProteinFirst { get; }
+
+        /// <summary>
+        /// Proteins for this PSM
+        /// </summary>
+        /// <remarks>Limited to the first MaxProteinsPerPSM proteins; use ProteinCount for the total number of proteins</remarks>
+        public IReadOnlyList<string> Proteins { get; }
+
+        /// <summary>
+        /// Total number of proteins for this PSM
+        /// </summary>
+        /// <remarks>Can be larger than Proteins.Count</remarks>
+        public int ProteinCount { get; }
+
+        /// <summary>
+        /// Modified residues
+        /// </summary>
+        public List<AminoAcidModInfo> ModifiedResidues { get; }
+
+        /// <summary>
+        /// Mass error, in Da
+        /// </summary>
+        public string MassErrorDa { get; }
+
+        /// <summary>
+        /// Mass error, in ppm
+        /// </summary>
+        public string MassErrorPPM { get; }
+
+        /// <summary>
+        /// MSGF spectral E-value
+        /// </summary>
+        public string MSGFSpecEValue { get; }
+
+        /// <summary>
+        /// Search engine scores, indexed by ScoreSchema slot number
+        /// </summary>
+        /// <remarks>NaN for scores that this PSM does not have; use GetScoreText to obtain the text to write</remarks>
+        public double[] Scores { get; }
+
+        // Original text of scores that are not stored in Scores; null if all scores are in Scores
+        private readonly string[] mScoreText;
+
+        /// <summary>
+        /// Constructor
+        /// </summary>
+        /// <param name="psm">PSM read by PHRPReader</param>
+        /// <param name="scoreSchema">Score schema for the dataset</param>
+        /// <param name="maxProteinsPerPSM">Maximum number of proteins to store; 0 to store all proteins</param>
+        public CachedPSM(PSM psm, ScoreSchema scoreSchema, int maxProteinsPerPSM)
+        {
+            ResultID = psm.ResultID;
+            ScanNumber = psm.ScanNumber;
+            ScoreRank = psm.ScoreRank;
+            SeqID = psm.SeqID;
+            NumTrypticTermini = psm.NumTrypticTermini;
+            NumMissedCleavages = psm.NumMissedCleavages;
+            PeptideMonoisotopicMass = psm.PeptideMonoisotopicMass;
+            Peptide = psm.Peptide;
+            PeptideWithNumericMods = psm.PeptideWithNumericMods;
+            ProteinFirst = psm.ProteinFirst;
+            Proteins = GetProteins(psm.Proteins, maxProteinsPerPSM);
+            ProteinCount = psm.Proteins.Count;
+            ModifiedResidues = psm.ModifiedResidues;
+            MassErrorDa = psm.MassErrorDa;
+            MassErrorPPM = psm.MassErrorPPM;
+            MSGFSpecEValue = psm.MSGFSpecEValue;
+            Scores = scoreSchema.GetScores(psm, out mScoreText);
+        }
+
+        /// <summary>
+        /// Get the text of a search engine score, as read from the input file
+        /// </summary>
+        /// <param name="slot">ScoreSchema slot number</param>
+        /// <returns>Score text, or null if this PSM does not have the score</returns>
+        public string GetScoreText(int slot)
+        {
+            if (slot < 0 || slot >= Scores.Length)
+                return null;
+
+            if (mScoreText != null && slot < mScoreText.Length && mScoreText[slot] != null)
+                return mScoreText[slot];
+
+            return double.IsNaN(Scores[slot]) ? null : ScoreSchema.FormatScore(Scores[slot]);
+        }
+
+        /// <summary>
+        /// Get the proteins to store for a PSM
+        /// </summary>
+        /// <remarks>
+        /// The protein list is only copied if it is longer than maxProteinsPerPSM,
+        /// so that peptides shared by thousands of proteins do not keep the full list in memory
+        /// </remarks>
+        /// <param name="proteins">Proteins read by PHRPReader</param>
+        /// <param name="maxProteinsPerPSM">Maximum number of proteins to store; 0 to store all proteins</param>
+        private static IReadOnlyList<string> GetProteins(IReadOnlyList<string> proteins, int maxProteinsPerPSM)
+        {
+            if (maxProteinsPerPSM <= 0 || proteins.Count <= maxProteinsPerPSM)
+                return proteins;
+
+            var cappedProteins = new string[maxProteinsPerPSM];
+
+            for (var i = 0; i < maxProteinsPerPSM; i++)
+            {
+                cappedProteins[i] = proteins[i];
+            }
+
+            return cappedProteins;
+        }
+    }
+}
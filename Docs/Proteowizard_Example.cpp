@@ -7,12 +7,17 @@ void write( const string& sourceFilepath,
             const string& searchDatabase,
             boost::regex cleavageAgentRegex,
             const string& decoyPrefix,
-            const RunTimeVariableMap& vars ) const
+            const RunTimeVariableMap& vars,
+            bool gzipOutput = false ) const
 {
     using namespace pwiz::identdata;
     namespace msdata = pwiz::msdata;
     namespace proteome = pwiz::proteome;
 
+    // Peptide, Modification, PeptideEvidence and SpectrumIdentificationItem objects are drawn from this arena;
+    // it is declared before mzid so that it outlives the (non-owning) handles that mzid holds
+    IdentDataArena arena;
+
     IdentData mzid;
 
     mzid.id = sourceFilepath + " " + searchDatabase + " " + searchEngineName + " " + searchEngineVersion;
@@ -234,12 +239,19 @@ void write( const string& sourceFilepath,
     BOOST_FOREACH(const RunTimeVariableMap::value_type& itr, vars)
         sipPtr->additionalSearchParams.userParams.push_back(UserParam(itr.first, itr.second));
 
-    map<string, DBSequencePtr> dbSequences;
-    PeptideIndex peptides;
-    PeptidePtr currentPeptide;
+    // keyed by protein accession; decoy status is determined once per DBSequence
+    StringHashMap<DBSequenceEntry> dbSequences;
+
+    // peptides are deduplicated by a lightweight key, so a Peptide is only created for a new sequence/mods variant
+    typedef map<PeptideKey, PeptideIndexEntry, PeptideKeyLessThan> PeptideKeyIndex;
+    PeptideKeyIndex peptides;
+    PeptideKey probeKey; // reused for every result, so probing does not allocate once its buffers have grown
+
+    // formats score and count values, and caches the CVID of each score name, for the whole run
+    ParamWriter paramWriter(cvTranslator);
 
     size_t spectrumIndex = 0;
-    set<string> uniqueNativeIDs;
+    StringHashMap<bool> uniqueNativeIDs;
     SpectrumIdentificationResultPtr sirPtr;
 
     BOOST_FOREACH(SpectrumType* s, *this)
@@ -252,7 +264,19 @@ void write( const string& sourceFilepath,
         if (totalResults == 0)
             continue;
 
+        // nativeIDs must be unique within the SpectrumIdentificationList
+        bool newNativeID;
+        uniqueNativeIDs.insert(s->id.nativeID, newNativeID);
+        if (!newNativeID)
+            throw runtime_error("[SearchSpectraList::write] duplicate nativeID \"" + s->id.nativeID + "\"");
+
+        sirPtr = arena.create<SpectrumIdentificationResult>();
+        silPtr->spectrumIdentificationResult.push_back(sirPtr);
+
         SpectrumIdentificationResult& sir = *sirPtr;
+        paramWriter.formatId(sir.id, "SIR", "_", ++spectrumIndex);
+        sir.spectrumID = s->id.nativeID;
+        sir.spectraDataPtr = spectraData;
 
         size_t resultIndex = 0;
 
@@ -273,70 +297,92 @@ void write( const string& sourceFilepath,
             BOOST_FOREACH(typename RankMap::value_type& rank, resultsByRank)
             BOOST_FOREACH(const boost::shared_ptr<SearchResultType>& resultPtr, rank.second)
             {
-                SpectrumIdentificationItemPtr siiPtr(new SpectrumIdentificationItem);
+                SpectrumIdentificationItemPtr siiPtr = arena.create<SpectrumIdentificationItem>();
                 sir.spectrumIdentificationItem.push_back(siiPtr);
 
                 SpectrumIdentificationItem& sii = *siiPtr;
                 const SearchResultType& result = *resultPtr;
 
-                sii.id = sir.id + "_SII_" + lexical_cast<string>(++resultIndex);
+                paramWriter.formatId(sii.id, sir.id, "_SII_", ++resultIndex);
                 sii.rank = rank.first;
                 sii.chargeState = result.precursorMassHypothesis.charge;
                 sii.experimentalMassToCharge = Ion::mz(result.precursorMassHypothesis.mass, sii.chargeState);
                 sii.calculatedMassToCharge = Ion::mz(result.calculatedMass(), sii.chargeState);
                 sii.massTablePtr = massTable;
 
-                currentPeptide.reset(new pwiz::identdata::Peptide);
-                currentPeptide->peptideSequence = result.sequence();
+                paramWriter.set(sii, MS_number_of_matched_peaks, result.fragmentsMatched);
+                paramWriter.set(sii, MS_number_of_unmatched_peaks, result.fragmentsUnmatched);
 
-                sii.set(MS_number_of_matched_peaks, result.fragmentsMatched);
-                sii.set(MS_number_of_unmatched_peaks, result.fragmentsUnmatched);
+                // build the probe key for the current peptide variant
+                probeKey.sequence.assign(result.sequence());
+                probeKey.modifications.clear();
 
                 const ModificationMap& modMap = result.modifications();
                 BOOST_FOREACH(const ModificationMap::value_type& mapPair, modMap)
                 BOOST_FOREACH(const pwiz::proteome::Modification& mod, mapPair.second)
                 {
-                    ModificationPtr resultMod(new pwiz::identdata::Modification);
-                    currentPeptide->modification.push_back(resultMod);
-
-                    resultMod->avgMassDelta = mod.averageDeltaMass();
-                    resultMod->monoisotopicMassDelta = mod.monoisotopicDeltaMass();
+                    PeptideKey::Mod keyMod;
+                    keyMod.avgMassDelta = mod.averageDeltaMass();
+                    keyMod.monoisotopicMassDelta = mod.monoisotopicDeltaMass();
 
                     switch (mapPair.first)
                     {
                         case INT_MIN:
-                            resultMod->location = 0;
+                            keyMod.location = 0;
                             break;
                         case INT_MAX:
-                            resultMod->location = result.sequence().length() + 1;
+                            keyMod.location = result.sequence().length() + 1;
                             break;
                         default:
-                            resultMod->residues.push_back(result.sequence()[mapPair.first]);
-                            resultMod->location = mapPair.first + 1;
+                            keyMod.location = mapPair.first + 1;
                             break;
                     }
+
+                    probeKey.modifications.push_back(keyMod);
                 }
 
-                // try to insert the current peptide variant
-                pair<typename PeptideIndex::iterator, bool> insertResult = peptides.insert(make_pair(currentPeptide, vector<PeptideEvidencePtr>()));
-                currentPeptide = insertResult.first->first;
+                // find the current peptide variant; only create it if it is new
+                typename PeptideKeyIndex::iterator peptideItr = peptides.find(probeKey);
+                bool newPeptide = peptideItr == peptides.end();
 
                 // if peptide is new, add its proteins as DBSequences and
                 // populate the SII with PeptideEvidence elements
-                if (insertResult.second)
+                if (newPeptide)
                 {
+                    peptideItr = peptides.insert(make_pair(probeKey, PeptideIndexEntry())).first;
+
+                    PeptidePtr currentPeptide = arena.create<pwiz::identdata::Peptide>();
+                    peptideItr->second.peptide = currentPeptide;
+
+                    currentPeptide->peptideSequence = probeKey.sequence;
                     currentPeptide->id = "PEP_" + lexical_cast<string>(peptides.size());
+
+                    BOOST_FOREACH(const PeptideKey::Mod& keyMod, probeKey.modifications)
+                    {
+                        ModificationPtr resultMod = arena.create<pwiz::identdata::Modification>();
+                        currentPeptide->modification.push_back(resultMod);
+
+                        resultMod->avgMassDelta = keyMod.avgMassDelta;
+                        resultMod->monoisotopicMassDelta = keyMod.monoisotopicMassDelta;
+                        resultMod->location = keyMod.location;
+
+                        // terminal mods (location 0 or length+1) have no residue
+                        if (keyMod.location > 0 && keyMod.location <= (int) probeKey.sequence.length())
+                            resultMod->residues.push_back(probeKey.sequence[keyMod.location - 1]);
+                    }
+
                     mzid.sequenceCollection.peptides.push_back(currentPeptide);
 
                     BOOST_FOREACH(const string& accession, result.proteins)
                     {
                         // insert or find protein accession
-                        pair<map<string, DBSequencePtr>::iterator, bool> insertResult2 = dbSequences.insert(make_pair(accession, DBSequencePtr()));
+                        bool newDBSequence;
+                        DBSequenceEntry& dbSequenceEntry = dbSequences.insert(accession, newDBSequence);
 
-                        DBSequencePtr& dbSequence = insertResult2.first->second;
+                        DBSequencePtr& dbSequence = dbSequenceEntry.dbSequence;
 
                         // if it was inserted, add it to the sequenceCollection
-                        if (insertResult2.second)
+                        if (newDBSequence)
                         {
                             dbSequence.reset(new DBSequence);
                             mzid.sequenceCollection.dbSequences.push_back(dbSequence);
@@ -344,9 +390,10 @@ void write( const string& sourceFilepath,
                             dbSequence->searchDatabasePtr = sdb;
                             dbSequence->accession = accession;
                             dbSequence->id = "DBSeq_" + accession;
+                            dbSequenceEntry.isDecoy = bal::starts_with(accession, decoyPrefix);
                         }
 
-                        PeptideEvidencePtr pe(new PeptideEvidence);
+                        PeptideEvidencePtr pe = arena.create<PeptideEvidence>();
                         pe->dbSequencePtr = dbSequence;
                         pe->peptidePtr = currentPeptide;
 
@@ -358,26 +405,30 @@ void write( const string& sourceFilepath,
                         const string& nextAA = result.CTerminusSuffix();
                         pe->pre = prevAA.empty() ? '-' : *prevAA.rbegin();
                         pe->post = nextAA.empty() ? '-' : *nextAA.begin();
-                        pe->isDecoy = bal::starts_with(accession, decoyPrefix);
+                        pe->isDecoy = dbSequenceEntry.isDecoy;
 
-                        insertResult.first->second.push_back(pe);
+                        peptideItr->second.peptideEvidence.push_back(pe);
                         mzid.sequenceCollection.peptideEvidence.push_back(pe);
                     }
                 }
 
-                sii.peptideEvidencePtr = insertResult.first->second;
+                sii.peptideEvidencePtr = peptideItr->second.peptideEvidence;
 
                 // the peptide is guaranteed to exist, so reference it
-                sii.peptidePtr = currentPeptide;
+                sii.peptidePtr = peptideItr->second.peptide;
                 sii.passThreshold = true;
 
                 // add search scores as either CVParams or UserParams
                 SearchScoreList scores = result.getScoreList();
+                sii.cvParams.reserve(sii.cvParams.size() + scores.size());
                 BOOST_FOREACH(const SearchScore& score, scores)
-                    if (score.cvid != CVID_Unknown)
-                        sii.set(score.cvid, score.value);
+                {
+                    CVID scoreCVID = paramWriter.scoreCVID(score);
+                    if (scoreCVID != CVID_Unknown)
+                        paramWriter.set(sii, scoreCVID, score.value);
                     else
-                        sii.userParams.push_back(UserParam(score.name, lexical_cast<string>(score.value)));
+                        paramWriter.addUserParam(sii, score.name, score.value);
+                }
 
             } // for each tied result in a rank
         } // for each charge state
@@ -395,7 +446,20 @@ void write( const string& sourceFilepath,
     string extension = outputFormat == IdentDataFile::Format_pepXML ? ".pepXML" : ".mzid";
     string outputFilename = bfs::path(sourceFilepath).replace_extension("").filename() + filenameSuffix + extension;
 
-    IdentDataFile::write(mzid, outputFilename, IdentDataFile::WriteConfig(outputFormat));
+    if (!gzipOutput)
+    {
+        IdentDataFile::write(mzid, outputFilename, IdentDataFile::WriteConfig(outputFormat));
+        return;
+    }
+
+    // serialize on this thread while another thread compresses and writes to disk
+    GzipOutputQueue gzipQueue(outputFilename + ".gz");
+    {
+        std::ostream os(&gzipQueue);
+        IdentDataFile::write(mzid, outputFilename, os, IdentDataFile::WriteConfig(outputFormat));
+        os.flush();
+    }
+    gzipQueue.close();
 } // write()
 
 struct ModLessThan
@@ -455,3 +519,544 @@ struct PeptideLessThan
             return lhs.peptideSequence.length() < rhs.peptideSequence.length();
     }
 };
+
+template <typename T> class ArenaAllocator;
+
+/// monotonic arena for the identdata objects created by write();
+/// memory is never reused and every object is destroyed when the arena is destroyed
+class IdentDataArena : boost::noncopyable
+{
+    public:
+
+    explicit IdentDataArena(size_t blockSize = 1 << 20)
+        : blockSize_(blockSize), current_(0), remaining_(0)
+    {}
+
+    ~IdentDataArena()
+    {
+        // destroy objects in the reverse order of their creation
+        for (vector<Destructor>::reverse_iterator itr = destructors_.rbegin(); itr != destructors_.rend(); ++itr)
+            itr->destroy(itr->object);
+
+        BOOST_FOREACH(char* block, blocks_)
+            ::operator delete(block);
+    }
+
+    void* allocate(size_t size, size_t alignment)
+    {
+        size_t padding = (alignment - reinterpret_cast<size_t>(current_) % alignment) % alignment;
+        if (padding + size > remaining_)
+        {
+            size_t newBlockSize = std::max(blockSize_, size + alignment);
+            blocks_.push_back(static_cast<char*>(::operator new(newBlockSize)));
+            current_ = blocks_.back();
+            remaining_ = newBlockSize;
+            padding = (alignment - reinterpret_cast<size_t>(current_) % alignment) % alignment;
+        }
+
+        void* result = current_ + padding;
+        current_ += padding + size;
+        remaining_ -= padding + size;
+        return result;
+    }
+
+    /// creates a default-constructed T in the arena and returns a non-owning handle to it;
+    /// the handle's control block is also allocated from the arena, so no heap allocation is made per object
+    template <typename T>
+    boost::shared_ptr<T> create()
+    {
+        // so that push_back below cannot throw after T is constructed; grow geometrically to keep create() amortized constant time
+        if (destructors_.size() == destructors_.capacity())
+            destructors_.reserve(std::max<size_t>(64, destructors_.capacity() * 2));
+        T* object = new (allocate(sizeof(T), boost::alignment_of<T>::value)) T();
+        destructors_.push_back(Destructor(object, &destroy<T>));
+        return boost::shared_ptr<T>(object, boost::null_deleter(), ArenaAllocator<T>(*this));
+    }
+
+    private:
+
+    struct Destructor
+    {
+        Destructor(void* object, void (*destroy)(void*)) : object(object), destroy(destroy) {}
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    template <typename T>
+    static void destroy(void* object) { static_cast<T*>(object)->~T(); }
+
+    size_t blockSize_;
+    char* current_;
+    size_t remaining_;
+    vector<char*> blocks_;
+    vector<Destructor> destructors_;
+};
+
+/// allocator for shared_ptr control blocks; deallocation is a no-op since the arena frees all memory at once
+template <typename T>
+class ArenaAllocator
+{
+    public:
+
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U> struct rebind { typedef ArenaAllocator<U> other; };
+
+    explicit ArenaAllocator(IdentDataArena& arena) : arena_(&arena) {}
+    template <typename U> ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena_) {}
+
+    pointer allocate(size_type n, const void* = 0) { return static_cast<pointer>(arena_->allocate(n * sizeof(T), boost::alignment_of<T>::value)); }
+    void deallocate(pointer, size_type) {}
+
+    void construct(pointer p, const T& value) { new (p) T(value); }
+    void destroy(pointer p) { p->~T(); }
+    size_type max_size() const { return size_t(-1) / sizeof(T); }
+
+    pointer address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+
+    template <typename U> bool operator== (const ArenaAllocator<U>& rhs) const { return arena_ == rhs.arena_; }
+    template <typename U> bool operator!= (const ArenaAllocator<U>& rhs) const { return arena_ != rhs.arena_; }
+
+    private:
+
+    template <typename U> friend class ArenaAllocator;
+    IdentDataArena* arena_;
+};
+
+/// lightweight peptide key (sequence and mods) used to find an existing Peptide before creating one
+struct PeptideKey
+{
+    struct Mod
+    {
+        int location;
+        double avgMassDelta;
+        double monoisotopicMassDelta;
+    };
+
+    string sequence;
+    vector<Mod> modifications;
+};
+
+/// same ordering as PeptideLessThan and ModLessThan, without needing Peptide or Modification objects
+struct PeptideKeyLessThan
+{
+    bool operator() (const PeptideKey& lhs, const PeptideKey& rhs) const
+    {
+        if (lhs.sequence.length() != rhs.sequence.length())
+            return lhs.sequence.length() < rhs.sequence.length();
+
+        int compare = lhs.sequence.compare(rhs.sequence);
+        if (compare)
+            return compare < 0;
+
+        if (lhs.modifications.size() != rhs.modifications.size())
+            return lhs.modifications.size() < rhs.modifications.size();
+
+        for (size_t i=0; i < lhs.modifications.size(); ++i)
+        {
+            const PeptideKey::Mod& lhsMod = lhs.modifications[i];
+            const PeptideKey::Mod& rhsMod = rhs.modifications[i];
+
+            if (lhsMod.location != rhsMod.location)
+                return lhsMod.location < rhsMod.location;
+            if (lhsMod.avgMassDelta != rhsMod.avgMassDelta)
+                return lhsMod.avgMassDelta < rhsMod.avgMassDelta;
+            if (lhsMod.monoisotopicMassDelta != rhsMod.monoisotopicMassDelta)
+                return lhsMod.monoisotopicMassDelta < rhsMod.monoisotopicMassDelta;
+        }
+        return false;
+    }
+};
+
+/// the Peptide created for a PeptideKey, and its PeptideEvidence elements
+struct PeptideIndexEntry
+{
+    pwiz::identdata::PeptidePtr peptide;
+    vector<pwiz::identdata::PeptideEvidencePtr> peptideEvidence;
+};
+
+/// writes numeric CVParam and UserParam values with std::to_chars into a reusable buffer,
+/// so that setting a param does not create temporary strings (short values also fit in the string's own buffer);
+/// also caches the CVID of each score name so that names are only translated once per run
+class ParamWriter
+{
+    public:
+
+    explicit ParamWriter(const CVTranslator& cvTranslator) : cvTranslator_(cvTranslator) {}
+
+    /// same as ParamContainer::set(): replaces the value if the CVParam exists, otherwise adds it
+    template <typename T>
+    void set(pwiz::identdata::ParamContainer& params, CVID cvid, T value)
+    {
+        BOOST_FOREACH(pwiz::identdata::CVParam& cvParam, params.cvParams)
+            if (cvParam.cvid == cvid)
+            {
+                assignValue(cvParam.value, value);
+                return;
+            }
+
+        params.cvParams.push_back(pwiz::identdata::CVParam(cvid));
+        assignValue(params.cvParams.back().value, value);
+    }
+
+    template <typename T>
+    void addUserParam(pwiz::identdata::ParamContainer& params, const string& name, T value)
+    {
+        params.userParams.push_back(pwiz::identdata::UserParam(name));
+        assignValue(params.userParams.back().value, value);
+    }
+
+    /// sets id to prefix + separator + number, allocating at most once
+    template <typename T>
+    void formatId(string& id, const string& prefix, const char* separator, T number)
+    {
+        std::to_chars_result result = std::to_chars(buffer_, buffer_ + sizeof(buffer_), number);
+
+        id.clear();
+        id.reserve(prefix.length() + strlen(separator) + (result.ptr - buffer_));
+        id.append(prefix).append(separator).append(buffer_, result.ptr);
+    }
+
+    /// returns the score's CVID if it has one, otherwise the CVID that its name translates to (or CVID_Unknown)
+    CVID scoreCVID(const SearchScore& score)
+    {
+        if (score.cvid != CVID_Unknown)
+            return score.cvid;
+
+        map<string, CVID>::const_iterator itr = scoreCVIDs_.find(score.name);
+        if (itr == scoreCVIDs_.end())
+            itr = scoreCVIDs_.insert(make_pair(score.name, cvTranslator_.translate(score.name))).first;
+        return itr->second;
+    }
+
+    private:
+
+    /// doubles are written in their shortest round-trip form
+    template <typename T>
+    void assignValue(string& target, T value)
+    {
+        std::to_chars_result result = std::to_chars(buffer_, buffer_ + sizeof(buffer_), value);
+        target.assign(buffer_, result.ptr);
+    }
+
+    const CVTranslator& cvTranslator_;
+    map<string, CVID> scoreCVIDs_;
+    char buffer_[64];
+};
+
+/// a DBSequence, and whether its accession has the decoy prefix
+struct DBSequenceEntry
+{
+    DBSequenceEntry() : isDecoy(false) {}
+
+    pwiz::identdata::DBSequencePtr dbSequence;
+    bool isDecoy;
+};
+
+/// open-addressing (linear probing) hash map from strings to values;
+/// each slot holds only the key's hash and an entry index, so probing scans a compact array and keys are only compared when hashes match;
+/// entries are stored in insertion order, and growing the table rehashes from the stored hashes without rehashing the keys
+template <typename Value>
+class StringHashMap
+{
+    public:
+
+    explicit StringHashMap(size_t initialCapacity = 1024)
+        : slots_(roundUpToPowerOfTwo(initialCapacity))
+    {}
+
+    static size_t hash(const string& key)
+    {
+        // 64-bit FNV-1a
+        boost::uint64_t hash = 14695981039346656037ULL;
+        for (size_t i=0; i < key.length(); ++i)
+        {
+            hash ^= (unsigned char) key[i];
+            hash *= 1099511628211ULL;
+        }
+        return (size_t) hash;
+    }
+
+    /// returns the value for key, inserting a default-constructed value if key is new;
+    /// the reference is valid until the next insert
+    Value& insert(const string& key, bool& inserted)
+    {
+        return insert(key, hash(key), inserted);
+    }
+
+    /// as above, with the key's hash already computed
+    Value& insert(const string& key, size_t keyHash, bool& inserted)
+    {
+        size_t slotIndex = findSlot(key, keyHash);
+        if (slots_[slotIndex].entry > 0)
+        {
+            inserted = false;
+            return entries_[slots_[slotIndex].entry - 1].second;
+        }
+
+        inserted = true;
+        entries_.push_back(make_pair(key, Value()));
+        slots_[slotIndex].hash = keyHash;
+        slots_[slotIndex].entry = entries_.size();
+
+        // keep the load factor at or below 0.5
+        if (entries_.size() * 2 > slots_.size())
+            grow();
+
+        return entries_.back().second;
+    }
+
+    size_t size() const {return entries_.size();}
+
+    private:
+
+    struct Slot
+    {
+        Slot() : hash(0), entry(0) {}
+        size_t hash;
+        size_t entry; // 1-based index into entries_; 0 if the slot is empty
+    };
+
+    static size_t roundUpToPowerOfTwo(size_t value)
+    {
+        size_t result = 16;
+        while (result < value)
+            result <<= 1;
+        return result;
+    }
+
+    /// returns the slot holding key, or the empty slot where it would be inserted
+    size_t findSlot(const string& key, size_t keyHash) const
+    {
+        size_t mask = slots_.size() - 1;
+        for (size_t slotIndex = keyHash & mask;; slotIndex = (slotIndex + 1) & mask)
+        {
+            const Slot& slot = slots_[slotIndex];
+            if (slot.entry == 0 || (slot.hash == keyHash && entries_[slot.entry - 1].first == key))
+                return slotIndex;
+        }
+    }
+
+    void grow()
+    {
+        vector<Slot> slots(slots_.size() * 2);
+        size_t mask = slots.size() - 1;
+
+        BOOST_FOREACH(const Slot& slot, slots_)
+        {
+            if (slot.entry == 0)
+                continue;
+
+            size_t slotIndex = slot.hash & mask;
+            while (slots[slotIndex].entry > 0)
+                slotIndex = (slotIndex + 1) & mask;
+            slots[slotIndex] = slot;
+        }
+
+        slots_.swap(slots);
+    }
+
+    vector<Slot> slots_;
+    vector<pair<string, Value> > entries_;
+};
+
+/// stream buffer that hands each filled buffer to a background thread, which gzip-compresses it to a file;
+/// buffers are recycled from a fixed pool, so if compression falls behind the serializing thread waits
+/// instead of queueing more data (memory use is bounded by bufferSize * (maxQueuedBuffers + 1))
+class GzipOutputQueue : public std::streambuf, boost::noncopyable
+{
+    public:
+
+    GzipOutputQueue(const string& filepath, size_t bufferSize = 1 << 20, size_t maxQueuedBuffers = 4)
+        : filepath_(filepath), buffers_(maxQueuedBuffers + 1, vector<char>(bufferSize)), current_(0), done_(false), closed_(false)
+    {
+        for (size_t i=1; i < buffers_.size(); ++i)
+            freeBuffers_.push_back(&buffers_[i]);
+
+        current_ = &buffers_[0];
+        setp(&(*current_)[0], &(*current_)[0] + current_->size());
+
+        thread_ = boost::thread(&GzipOutputQueue::compress, this);
+    }
+
+    ~GzipOutputQueue()
+    {
+        try
+        {
+            close();
+        }
+        catch (...)
+        {
+            // errors are reported by an explicit close()
+        }
+    }
+
+    /// queues any remaining data, waits for compression to finish, then rethrows any compression error
+    void close()
+    {
+        if (closed_)
+            return;
+        closed_ = true;
+
+        queueCurrentBuffer(false);
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            done_ = true;
+        }
+        queuedCondition_.notify_one();
+        thread_.join();
+
+        if (!error_.empty())
+            throw runtime_error("[GzipOutputQueue::close] error writing \"" + filepath_ + "\": " + error_);
+    }
+
+    protected:
+
+    virtual int_type overflow(int_type ch)
+    {
+        if (closed_ || !queueCurrentBuffer(true))
+            return traits_type::eof();
+
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    private:
+
+    typedef pair<vector<char>*, size_t> QueuedBuffer;
+
+    /// queues the filled part of the current buffer; if another buffer is needed, waits for a free one
+    bool queueCurrentBuffer(bool needAnotherBuffer)
+    {
+        size_t length = pptr() - pbase();
+
+        boost::mutex::scoped_lock lock(mutex_);
+
+        if (length > 0)
+        {
+            queuedBuffers_.push_back(make_pair(current_, length));
+            queuedCondition_.notify_one();
+            current_ = 0;
+        }
+
+        if (!needAnotherBuffer)
+        {
+            setp(0, 0);
+            return true;
+        }
+
+        if (!current_)
+        {
+            while (freeBuffers_.empty())
+                freeCondition_.wait(lock);
+
+            current_ = freeBuffers_.front();
+            freeBuffers_.pop_front();
+        }
+
+        setp(&(*current_)[0], &(*current_)[0] + current_->size());
+        return error_.empty();
+    }
+
+    /// runs on the compression thread
+    void compress()
+    {
+        boost::iostreams::filtering_ostream gzipStream;
+        try
+        {
+            boost::iostreams::file_sink fileSink(filepath_, std::ios::binary);
+            if (!fileSink.is_open())
+                throw runtime_error("unable to open file");
+
+            gzipStream.push(boost::iostreams::gzip_compressor());
+            gzipStream.push(fileSink);
+        }
+        catch (exception& e)
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            error_ = e.what();
+        }
+
+        while (true)
+        {
+            QueuedBuffer queuedBuffer;
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                while (queuedBuffers_.empty() && !done_)
+                    queuedCondition_.wait(lock);
+
+                if (queuedBuffers_.empty())
+                    break;
+
+                queuedBuffer = queuedBuffers_.front();
+                queuedBuffers_.pop_front();
+            }
+
+            // after an error, keep recycling buffers (discarding their data) so that the serializing thread cannot block
+            bool failed;
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                failed = !error_.empty();
+            }
+
+            if (!failed)
+            {
+                try
+                {
+                    gzipStream.write(&(*queuedBuffer.first)[0], queuedBuffer.second);
+                    if (!gzipStream)
+                        throw runtime_error("write failed");
+                }
+                catch (exception& e)
+                {
+                    boost::mutex::scoped_lock lock(mutex_);
+                    error_ = e.what();
+                }
+            }
+
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                freeBuffers_.push_back(queuedBuffer.first);
+            }
+            freeCondition_.notify_one();
+        }
+
+        try
+        {
+            // writes the gzip trailer and closes the file
+            boost::iostreams::close(gzipStream);
+        }
+        catch (exception& e)
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (error_.empty())
+                error_ = e.what();
+        }
+    }
+
+    string filepath_;
+    vector<vector<char> > buffers_;
+    vector<char>* current_;
+
+    boost::mutex mutex_;
+    boost::condition_variable queuedCondition_;
+    boost::condition_variable freeCondition_;
+    deque<QueuedBuffer> queuedBuffers_;
+    deque<vector<char>*> freeBuffers_;
+    bool done_;
+    bool closed_;
+    string error_;
+
+    boost::thread thread_;
+};
@@ -0,0 +1,376 @@
+//
+// Google Benchmark harness for the mzIdentML writer in Proteowizard_Example.cpp
+//
+// Build within the freicore tree, linking against the library that contains SearchSpectraList::write()
+// (and the PeptideLessThan, ModLessThan, PeptideKey and IdentDataArena helpers that follow it), pwiz_data_identdata,
+// pwiz_data_msdata, and Google Benchmark (benchmark + benchmark_main).
+//
+// Synthetic spectra are generated with a configurable number of spectra, ranks per spectrum, mods per peptide,
+// and proteins per peptide; one third of the peptides repeat an earlier sequence/mods variant so that the
+// dedup path sees both new and existing peptides.
+//
+// Example usage:
+//   Proteowizard_Example_Benchmark --benchmark_filter=BM_Write
+//   Proteowizard_Example_Benchmark --benchmark_filter=BM_Peptide --benchmark_repetitions=5
+//
+
+#include "pwiz/data/msdata/examples.hpp"
+#include "pwiz/data/msdata/MSDataFile.hpp"
+#include "pwiz/data/identdata/IdentData.hpp"
+#include "pwiz/data/proteome/Modification.hpp"
+#include "pwiz/data/common/cv.hpp"
+#include "SearchSpectraList.h"
+#include "PeptideSpectrum.h"
+#include "BaseSearchResult.h"
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+#include <boost/random.hpp>
+
+using namespace std;
+using namespace freicore;
+namespace bfs = boost::filesystem;
+
+namespace {
+
+const char* RESIDUES = "ACDEFGHIKLMNPQRSTVWY";
+
+// one in this many peptides repeats the previous sequence/mods variant
+const int DUPLICATE_PEPTIDE_INTERVAL = 3;
+
+struct SyntheticSearchResult : public BaseSearchResult
+{
+    SyntheticSearchResult(const pwiz::proteome::DigestedPeptide& peptide) : BaseSearchResult(peptide), score(0) {}
+
+    double score;
+
+    SearchScoreList getScoreList() const
+    {
+        SearchScoreList scoreList;
+        scoreList.push_back(SearchScore("synthetic:score", score, pwiz::cv::CVID_Unknown));
+        scoreList.push_back(SearchScore("synthetic:evalue", 1.0 / (1.0 + score), pwiz::cv::CVID_Unknown));
+        return scoreList;
+    }
+
+    bool operator< (const SyntheticSearchResult& rhs) const { return score < rhs.score; }
+    bool operator== (const SyntheticSearchResult& rhs) const { return score == rhs.score; }
+};
+
+struct SyntheticSpectrum : public PeptideSpectrum<SyntheticSearchResult>
+{
+};
+
+typedef SearchSpectraList<SyntheticSpectrum> SyntheticSpectraList;
+
+struct SyntheticParameters
+{
+    int spectra;
+    int ranks;
+    int modsPerPeptide;
+    int proteinsPerPeptide;
+};
+
+SyntheticParameters getParameters(const benchmark::State& state)
+{
+    SyntheticParameters parameters;
+    parameters.spectra = (int) state.range(0);
+    parameters.ranks = (int) state.range(1);
+    parameters.modsPerPeptide = (int) state.range(2);
+    parameters.proteinsPerPeptide = (int) state.range(3);
+    return parameters;
+}
+
+/// returns a random peptide sequence; sequences are reused every DUPLICATE_PEPTIDE_INTERVAL calls
+string randomSequence(boost::mt19937& rng, int index, string& previousSequence)
+{
+    if (index % DUPLICATE_PEPTIDE_INTERVAL == DUPLICATE_PEPTIDE_INTERVAL - 1 && !previousSequence.empty())
+        return previousSequence;
+
+    boost::uniform_int<> lengthDist(7, 25);
+    boost::uniform_int<> residueDist(0, 19);
+
+    string sequence(lengthDist(rng), 'A');
+    for (size_t i=0; i < sequence.length(); ++i)
+        sequence[i] = RESIDUES[residueDist(rng)];
+    sequence[sequence.length()-1] = 'K';
+
+    previousSequence = sequence;
+    return sequence;
+}
+
+pwiz::proteome::DigestedPeptide makePeptide(const string& sequence, int modsPerPeptide)
+{
+    pwiz::proteome::DigestedPeptide peptide(sequence, 0, 0, true, true, "K", "-");
+
+    // mods are spread over the sequence, with the first one on the N terminus
+    for (int i=0; i < modsPerPeptide; ++i)
+    {
+        int position = i == 0 ? pwiz::proteome::ModificationMap::NTerminus()
+                              : (int) ((i * sequence.length()) / (modsPerPeptide + 1));
+        peptide.modifications()[position].push_back(pwiz::proteome::Modification(pwiz::chemistry::Formula("O1")));
+    }
+    return peptide;
+}
+
+/// creates the synthetic spectra; the caller owns the spectra list (and thus the spectra)
+void generateSpectra(const SyntheticParameters& parameters, SyntheticSpectraList& spectra)
+{
+    boost::mt19937 rng(12345);
+    string previousSequence;
+    int peptideIndex = 0;
+
+    for (int s=0; s < parameters.spectra; ++s)
+    {
+        SyntheticSpectrum* spectrum = new SyntheticSpectrum;
+        spectrum->id.index = s;
+        spectrum->id.nativeID = "controllerType=0 controllerNumber=1 scan=" + boost::lexical_cast<string>(s+1);
+        spectrum->resultsByCharge.resize(1, SyntheticSpectrum::SearchResultSetType(parameters.ranks));
+
+        for (int r=0; r < parameters.ranks; ++r)
+        {
+            string sequence = randomSequence(rng, peptideIndex++, previousSequence);
+            boost::shared_ptr<SyntheticSearchResult> result(new SyntheticSearchResult(makePeptide(sequence, parameters.modsPerPeptide)));
+
+            result->score = 100.0 - r;
+            result->precursorMassHypothesis.charge = 2;
+            result->precursorMassHypothesis.mass = result->calculatedMass();
+            result->fragmentsMatched = 10;
+            result->fragmentsUnmatched = 20;
+
+            for (int p=0; p < parameters.proteinsPerPeptide; ++p)
+                result->proteins.insert((p % 10 == 9 ? "rev_PROT_" : "PROT_") + boost::lexical_cast<string>((peptideIndex * 7 + p) % 20000));
+
+            spectrum->resultsByCharge[0].add(result);
+        }
+
+        spectra.push_back(spectrum);
+    }
+}
+
+RunTimeVariableMap getSearchVariables()
+{
+    RunTimeVariableMap vars;
+    vars["Config: MinTerminiCleavages"] = "2";
+    vars["Config: MaxMissedCleavages"] = "2";
+    vars["Config: PrecursorMzToleranceRule"] = "mono";
+    vars["Config: MonoPrecursorMzTolerance"] = "10ppm";
+    vars["Config: FragmentMzTolerance"] = "0.5mz";
+    vars["Config: FragmentationRule"] = "cid";
+    vars["Config: DynamicMods"] = "M * 15.994915";
+    vars["Config: StaticMods"] = "C 57.021464";
+    vars["SearchStats: Overall"] = "20000 proteins";
+    return vars;
+}
+
+/// writes the tiny example mzML once; write() needs a real source file to determine its format and nativeID format
+const string& getSourceFilepath()
+{
+    static string sourceFilepath;
+    if (sourceFilepath.empty())
+    {
+        sourceFilepath = (bfs::temp_directory_path() / "Proteowizard_Example_Benchmark.mzML").string();
+
+        pwiz::msdata::MSData tiny;
+        pwiz::msdata::examples::initializeTiny(tiny);
+        pwiz::msdata::MSDataFile::write(tiny, sourceFilepath);
+    }
+    return sourceFilepath;
+}
+
+vector<pwiz::identdata::PeptidePtr> generatePeptides(const SyntheticParameters& parameters)
+{
+    boost::mt19937 rng(12345);
+    string previousSequence;
+    vector<pwiz::identdata::PeptidePtr> peptides;
+
+    for (int i=0; i < parameters.spectra * parameters.ranks; ++i)
+    {
+        pwiz::identdata::PeptidePtr peptide(new pwiz::identdata::Peptide);
+        peptide->peptideSequence = randomSequence(rng, i, previousSequence);
+
+        // a repeated sequence gets exact copies of the previous peptide's mods, so that it is a duplicate peptide
+        if (!peptides.empty() && peptide->peptideSequence == peptides.back()->peptideSequence)
+        {
+            BOOST_FOREACH(const pwiz::identdata::ModificationPtr& previousMod, peptides.back()->modification)
+                peptide->modification.push_back(pwiz::identdata::ModificationPtr(new pwiz::identdata::Modification(*previousMod)));
+
+            peptides.push_back(peptide);
+            continue;
+        }
+
+        // otherwise the mod masses alternate between neighboring peptides
+        for (int m=0; m < parameters.modsPerPeptide; ++m)
+        {
+            pwiz::identdata::ModificationPtr mod(new pwiz::identdata::Modification);
+            mod->location = m == 0 ? 0 : (int) ((m * peptide->peptideSequence.length()) / (parameters.modsPerPeptide + 1));
+            mod->monoisotopicMassDelta = 15.994915 + (i % 2) * m;
+            mod->avgMassDelta = 15.9994 + (i % 2) * m;
+            peptide->modification.push_back(mod);
+        }
+
+        peptides.push_back(peptide);
+    }
+    return peptides;
+}
+
+/// fills a PeptideKey the same way that write() does
+void fillKey(const pwiz::identdata::Peptide& peptide, PeptideKey& key)
+{
+    key.sequence.assign(peptide.peptideSequence);
+    key.modifications.clear();
+
+    BOOST_FOREACH(const pwiz::identdata::ModificationPtr& mod, peptide.modification)
+    {
+        PeptideKey::Mod keyMod;
+        keyMod.location = mod->location;
+        keyMod.avgMassDelta = mod->avgMassDelta;
+        keyMod.monoisotopicMassDelta = mod->monoisotopicMassDelta;
+        key.modifications.push_back(keyMod);
+    }
+}
+
+} // namespace
+
+
+/// SearchSpectraList::write() end to end, including writing the .mzid (or .mzid.gz) file
+void runWriteBenchmark(benchmark::State& state, bool gzipOutput)
+{
+    SyntheticParameters parameters = getParameters(state);
+
+    SyntheticSpectraList spectra;
+    generateSpectra(parameters, spectra);
+
+    const string& sourceFilepath = getSourceFilepath();
+    RunTimeVariableMap vars = getSearchVariables();
+    string outputFilepath = bfs::path(sourceFilepath).replace_extension("").filename().string() + "-benchmark.mzid" + (gzipOutput ? ".gz" : "");
+
+    for (auto _ : state)
+    {
+        spectra.write(sourceFilepath, pwiz::identdata::IdentDataFile::Format_MzIdentML, "-benchmark",
+                      "MyriMatch", "2.2", "http://proteowizard.sourceforge.net", "synthetic.fasta",
+                      boost::regex("(?<=[KR])(?!P)"), "rev_", vars, gzipOutput);
+    }
+
+    state.SetItemsProcessed(state.iterations() * parameters.spectra * parameters.ranks);
+    if (bfs::exists(outputFilepath))
+    {
+        state.SetBytesProcessed(state.iterations() * bfs::file_size(outputFilepath));
+        bfs::remove(outputFilepath);
+    }
+
+    spectra.clear(true);
+}
+
+void BM_Write(benchmark::State& state) { runWriteBenchmark(state, false); }
+BENCHMARK(BM_Write)
+    ->ArgNames({"spectra", "ranks", "mods", "proteins"})
+    ->Args({1000, 1, 1, 1})
+    ->Args({1000, 5, 2, 3})
+    ->Args({10000, 5, 2, 3})
+    ->Args({10000, 5, 4, 50})
+    ->Unit(benchmark::kMillisecond);
+
+/// as BM_Write, with gzip compression on a separate thread; bytes processed are compressed bytes
+void BM_WriteGzip(benchmark::State& state) { runWriteBenchmark(state, true); }
+BENCHMARK(BM_WriteGzip)
+    ->ArgNames({"spectra", "ranks", "mods", "proteins"})
+    ->Args({10000, 5, 2, 3})
+    ->Args({10000, 5, 4, 50})
+    ->Unit(benchmark::kMillisecond);
+
+
+/// PeptideLessThan on neighboring peptides (one third of which have the same sequence, so mods are compared too)
+void BM_PeptideLessThan(benchmark::State& state)
+{
+    vector<pwiz::identdata::PeptidePtr> peptides = generatePeptides(getParameters(state));
+    PeptideLessThan peptideLessThan;
+
+    for (auto _ : state)
+        for (size_t i=1; i < peptides.size(); ++i)
+            benchmark::DoNotOptimize(peptideLessThan(peptides[i-1], peptides[i]));
+
+    state.SetItemsProcessed(state.iterations() * (peptides.size() - 1));
+}
+BENCHMARK(BM_PeptideLessThan)
+    ->ArgNames({"spectra", "ranks", "mods", "proteins"})
+    ->Args({10000, 1, 1, 1})
+    ->Args({10000, 1, 4, 1});
+
+
+/// ModLessThan on the mods of neighboring peptides
+void BM_ModLessThan(benchmark::State& state)
+{
+    vector<pwiz::identdata::PeptidePtr> peptides = generatePeptides(getParameters(state));
+    ModLessThan modLessThan;
+
+    for (auto _ : state)
+        for (size_t i=1; i < peptides.size(); ++i)
+            for (size_t m=0; m < peptides[i]->modification.size(); ++m)
+                benchmark::DoNotOptimize(modLessThan(peptides[i-1]->modification[m], peptides[i]->modification[m]));
+
+    state.SetItemsProcessed(state.iterations() * (peptides.size() - 1) * state.range(2));
+}
+BENCHMARK(BM_ModLessThan)
+    ->ArgNames({"spectra", "ranks", "mods", "proteins"})
+    ->Args({10000, 1, 1, 1})
+    ->Args({10000, 1, 4, 1});
+
+
+/// the peptide dedup path used by write(): probe with a PeptideKey, then create the Peptide in the arena only if new
+void BM_PeptideDedupInsert(benchmark::State& state)
+{
+    vector<pwiz::identdata::PeptidePtr> peptides = generatePeptides(getParameters(state));
+
+    for (auto _ : state)
+    {
+        IdentDataArena arena;
+        map<PeptideKey, PeptideIndexEntry, PeptideKeyLessThan> index;
+        PeptideKey probeKey;
+
+        BOOST_FOREACH(const pwiz::identdata::PeptidePtr& peptide, peptides)
+        {
+            fillKey(*peptide, probeKey);
+            map<PeptideKey, PeptideIndexEntry, PeptideKeyLessThan>::iterator itr = index.find(probeKey);
+            if (itr == index.end())
+            {
+                itr = index.insert(make_pair(probeKey, PeptideIndexEntry())).first;
+                itr->second.peptide = arena.create<pwiz::identdata::Peptide>();
+                itr->second.peptide->peptideSequence = probeKey.sequence;
+            }
+            benchmark::DoNotOptimize(itr->second.peptide.get());
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * peptides.size());
+}
+BENCHMARK(BM_PeptideDedupInsert)
+    ->ArgNames({"spectra", "ranks", "mods", "proteins"})
+    ->Args({10000, 5, 1, 1})
+    ->Args({10000, 5, 4, 1});
+
+
+/// the previous dedup path, for comparison: construct a Peptide on the heap, then insert it, discarding it if it already exists
+void BM_PeptideDedupInsertSpeculative(benchmark::State& state)
+{
+    vector<pwiz::identdata::PeptidePtr> peptides = generatePeptides(getParameters(state));
+
+    for (auto _ : state)
+    {
+        map<pwiz::identdata::PeptidePtr, vector<pwiz::identdata::PeptideEvidencePtr>, PeptideLessThan> index;
+
+        BOOST_FOREACH(const pwiz::identdata::PeptidePtr& peptide, peptides)
+        {
+            pwiz::identdata::PeptidePtr currentPeptide(new pwiz::identdata::Peptide);
+            currentPeptide->peptideSequence = peptide->peptideSequence;
+            BOOST_FOREACH(const pwiz::identdata::ModificationPtr& mod, peptide->modification)
+                currentPeptide->modification.push_back(pwiz::identdata::ModificationPtr(new pwiz::identdata::Modification(*mod)));
+
+            benchmark::DoNotOptimize(index.insert(make_pair(currentPeptide, vector<pwiz::identdata::PeptideEvidencePtr>())).first->first.get());
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * peptides.size());
+}
+BENCHMARK(BM_PeptideDedupInsertSpeculative)
+    ->ArgNames({"spectra", "ranks", "mods", "proteins"})
+    ->Args({10000, 5, 1, 1})
+    ->Args({10000, 5, 4, 1});
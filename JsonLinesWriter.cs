@@ -0,0 +1,733 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using PHRPReader;
+using PHRPReader.Data;
+using PRISM;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// JSON Lines writer, creating one compact JSON object per spectrum (equivalent to a PepXML spectrum_query element)
+    /// </summary>
+    /// <remarks>
+    /// <para>
+    /// Uses the same cached spectra and PSMs as PepXMLWriter. Numbers are written as JSON numbers, strings are escaped,
+    /// and each object is followed by a newline, allowing the output to be consumed as it is written (including from standard output)
+    /// </para>
+    /// <para>
+    /// Text is encoded as UTF-8 directly into a reusable byte buffer, which is written to the output stream when full;
+    /// aside from the values provided by PHRPReader, no strings are created while writing
+    /// </para>
+    /// </remarks>
+    public class JsonLinesWriter : EventNotifier, IDisposable
+    {
+        // Ignore Spelling: jsonl, msgf
+
+        // Longest UTF-8 sequence or JSON escape written for a single character (\u001F)
+        private const int MAX_BYTES_PER_CHAR = 6;
+
+        // Longest number written by WriteNumber(long), including the sign
+        private const int MAX_BYTES_PER_INTEGER = 20;
+
+        private const int MAX_DIGITS_AFTER_DECIMAL = 9;
+
+        private static readonly long[] mPowersOfTen =
+        {
+            1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+        };
+
+        private static readonly byte[] mHexDigits = { (byte)'0', (byte)'1', (byte)'2', (byte)'3', (byte)'4', (byte)'5', (byte)'6', (byte)'7', (byte)'8', (byte)'9', (byte)'a', (byte)'b', (byte)'c', (byte)'d', (byte)'e', (byte)'f' };
+
+        private readonly byte[] mBuffer;
+
+        private readonly bool mLeaveOpen;
+
+        private readonly Options mOptions;
+
+        private readonly ScoreSchema mScoreSchema;
+
+        private readonly Stream mStream;
+
+        private bool mClosed;
+
+        // True if a comma must be written before the next property or array value
+        private bool mNeedsComma;
+
+        private int mPosition;
+
+        /// <summary>
+        /// Number of bytes written to the output stream (including any bytes still in the buffer)
+        /// </summary>
+        public long BytesWritten { get; private set; }
+
+        /// <summary>
+        /// Number of PSMs written
+        /// </summary>
+        public int HitCount { get; private set; }
+
+        /// <summary>
+        /// Protein-relative modification sites, read from the _ProteinMods.txt file
+        /// </summary>
+        /// <remarks>When defined, the protein positions of each modification are written</remarks>
+        public ProteinModIndex ProteinModSites { get; set; }
+
+        /// <summary>
+        /// Number of spectra written (one line per spectrum)
+        /// </summary>
+        public int SpectrumCount { get; private set; }
+
+        /// <summary>
+        /// Constructor that creates a new file
+        /// </summary>
+        /// <param name="outputFilePath">Path to the .jsonl file to create</param>
+        /// <param name="scoreSchema">Score schema of the cached PSMs</param>
+        /// <param name="options"></param>
+        public JsonLinesWriter(string outputFilePath, ScoreSchema scoreSchema, Options options)
+            : this(new FileStream(outputFilePath, FileMode.Create, FileAccess.Write, FileShare.Read), scoreSchema, options, false)
+        {
+        }
+
+        /// <summary>
+        /// Constructor that writes to an existing stream, for example standard output
+        /// </summary>
+        /// <param name="outputStream">Output stream</param>
+        /// <param name="scoreSchema">Score schema of the cached PSMs</param>
+        /// <param name="options"></param>
+        /// <param name="leaveOpen">When true, the stream is flushed but not closed by Close and Dispose</param>
+        public JsonLinesWriter(Stream outputStream, ScoreSchema scoreSchema, Options options, bool leaveOpen)
+        {
+            mStream = outputStream;
+            mScoreSchema = scoreSchema;
+            mOptions = options;
+            mLeaveOpen = leaveOpen;
+            mBuffer = new byte[options.ResourceLimits.OutputBufferSize];
+        }
+
+        /// <summary>
+        /// Write any buffered data, then close the output stream (unless leaveOpen was true)
+        /// </summary>
+        public void Close()
+        {
+            if (mClosed)
+                return;
+
+            mClosed = true;
+            FlushBuffer();
+            mStream.Flush();
+
+            if (!mLeaveOpen)
+                mStream.Dispose();
+        }
+
+        /// <summary>
+        /// Close the output stream, if not yet closed
+        /// </summary>
+        public void Dispose()
+        {
+            Close();
+        }
+
+        private void EnsureCapacity(int byteCount)
+        {
+            if (mPosition + byteCount > mBuffer.Length)
+                FlushBuffer();
+        }
+
+        private void FlushBuffer()
+        {
+            if (mPosition == 0)
+                return;
+
+            mStream.Write(mBuffer, 0, mPosition);
+            mPosition = 0;
+        }
+
+        /// <summary>
+        /// Check whether the text is a valid JSON number, e.g. 15, -0.25, or 1.5E-05
+        /// </summary>
+        /// <param name="value"></param>
+        private static bool IsJsonNumber(string value)
+        {
+            var i = 0;
+            var length = value.Length;
+
+            if (i < length && value[i] == '-')
+                i++;
+
+            if (i >= length || !IsDigit(value[i]))
+                return false;
+
+            // Leading zeros are not allowed
+            if (value[i] == '0' && i + 1 < length && IsDigit(value[i + 1]))
+                return false;
+
+            while (i < length && IsDigit(value[i]))
+                i++;
+
+            if (i < length && value[i] == '.')
+            {
+                i++;
+                if (i >= length || !IsDigit(value[i]))
+                    return false;
+
+                while (i < length && IsDigit(value[i]))
+                    i++;
+            }
+
+            if (i < length && (value[i] == 'e' || value[i] == 'E'))
+            {
+                i++;
+                if (i < length && (value[i] == '+' || value[i] == '-'))
+                    i++;
+
+                if (i >= length || !IsDigit(value[i]))
+                    return false;
+
+                while (i < length && IsDigit(value[i]))
+                    i++;
+            }
+
+            return i == length;
+        }
+
+        private static bool IsDigit(char value)
+        {
+            return value >= '0' && value <= '9';
+        }
+
+        /// <summary>
+        /// Write one line with the given spectrum and its PSMs
+        /// </summary>
+        /// <param name="spectrum">Spectrum info</param>
+        /// <param name="psms">PSMs for this spectrum</param>
+        public void WriteSpectrum(SpectrumInfo spectrum, List<CachedPSM> psms)
+        {
+            if (psms is null || psms.Count == 0)
+            {
+                return;
+            }
+
+            WriteStartObject();
+
+            // Example: QC_05_2_05Dec05_Doc_0508-08.9427.9427.1
+            WritePropertyName("spectrum");
+            WriteByte((byte)'"');
+            WriteEscapedText(mOptions.DatasetName);
+            WriteByte((byte)'.');
+            WriteDigits(spectrum.StartScan);
+            WriteByte((byte)'.');
+            WriteDigits(spectrum.EndScan);
+            WriteByte((byte)'.');
+            WriteDigits(spectrum.AssumedCharge);
+            WriteByte((byte)'"');
+            mNeedsComma = true;
+
+            WriteProperty("start_scan", spectrum.StartScan);
+            WriteProperty("end_scan", spectrum.EndScan);
+            WriteProperty("retention_time_sec", spectrum.ElutionTimeMinutes * 60.0, 2);
+
+            if (spectrum.CollisionMode != PepXMLWriter.ActivationMethods.Unknown)
+            {
+                WriteProperty("activation_method", PepXMLWriter.GetActivationMethodName(spectrum.CollisionMode));
+            }
+
+            WriteProperty("precursor_neutral_mass", spectrum.PrecursorNeutralMass, 4);
+            WriteProperty("assumed_charge", spectrum.AssumedCharge);
+            WriteProperty("index", spectrum.Index);
+
+            // Use the same native ID as the PepXML writer; example: controllerType=0 controllerNumber=1 scan=20554
+            WriteProperty("spectrumNativeID", spectrum.GetNativeID());
+
+            WritePropertyName("search_hits");
+            WriteStartArray();
+
+            foreach (var psmEntry in psms)
+            {
+                WriteSearchHit(psmEntry);
+            }
+
+            WriteEndArray();
+            WriteEndObject();
+
+            EnsureCapacity(1);
+            mBuffer[mPosition++] = (byte)'\n';
+            BytesWritten++;
+            mNeedsComma = false;
+
+            SpectrumCount++;
+            HitCount += psms.Count;
+        }
+
+        private void WriteSearchHit(CachedPSM psmEntry)
+        {
+            WriteStartObject();
+            WriteProperty("hit_rank", psmEntry.ScoreRank);
+
+            string cleanSequence;
+
+            if (PeptideCleavageStateCalculator.SplitPrefixAndSuffixFromSequence(psmEntry.Peptide, out var peptide, out var prefix, out var suffix))
+            {
+                // The peptide sequence needs to be just the amino acids; no mod symbols
+                cleanSequence = PeptideCleavageStateCalculator.ExtractCleanSequenceFromSequenceWithMods(peptide, false);
+                WriteProperty("peptide", cleanSequence);
+                WriteProperty("peptide_prev_aa", prefix);
+                WriteProperty("peptide_next_aa", suffix);
+            }
+            else
+            {
+                cleanSequence = PeptideCleavageStateCalculator.ExtractCleanSequenceFromSequenceWithMods(psmEntry.Peptide, false);
+                WriteProperty("peptide", cleanSequence);
+                WriteProperty("peptide_prev_aa", string.Empty);
+                WriteProperty("peptide_next_aa", string.Empty);
+            }
+
+            if (psmEntry.ModifiedResidues.Count > 0)
+            {
+                WriteProperty("peptide_with_mods", psmEntry.PeptideWithNumericMods);
+            }
+
+            WriteProperty("calc_neutral_pep_mass", psmEntry.PeptideMonoisotopicMass, 4);
+            WritePropertyNumberOrString("massdiff", psmEntry.MassErrorDa);
+            WritePropertyNumberOrString("mass_error_ppm", psmEntry.MassErrorPPM);
+            WriteProperty("num_tol_term", psmEntry.NumTrypticTermini);
+            WriteProperty("num_missed_cleavages", psmEntry.NumMissedCleavages);
+            WriteProperty("num_tot_proteins", psmEntry.ProteinCount);
+
+            // The first protein is listed first, followed by the additional proteins
+            // CachedPSM limits the proteins to MaxProteinsPerPSM
+            WritePropertyName("proteins");
+            WriteStartArray();
+            WriteArrayValue(psmEntry.ProteinFirst);
+
+            foreach (var protein in psmEntry.Proteins)
+            {
+                if (protein.Equals(psmEntry.ProteinFirst))
+                    continue;
+
+                WriteArrayValue(protein);
+            }
+
+            WriteEndArray();
+
+            if (psmEntry.ModifiedResidues.Count > 0)
+            {
+                WritePropertyName("modifications");
+                WriteStartArray();
+
+                foreach (var residue in psmEntry.ModifiedResidues)
+                {
+                    WriteStartObject();
+                    WriteProperty("position", residue.ResidueLocInPeptide);
+
+                    WritePropertyName("residue");
+                    WriteByte((byte)'"');
+                    WriteEscapedChar(residue.Residue);
+                    WriteByte((byte)'"');
+                    mNeedsComma = true;
+
+                    WriteProperty("mass_diff", residue.ModDefinition.ModificationMass, 5);
+
+                    if (residue.ModDefinition.ModificationType is
+                        ModificationDefinition.ResidueModificationType.TerminalPeptideStaticMod or
+                        ModificationDefinition.ResidueModificationType.ProteinTerminusStaticMod)
+                    {
+                        var cTerminal = residue.TerminusState is
+                            AminoAcidModInfo.ResidueTerminusState.PeptideCTerminus or
+                            AminoAcidModInfo.ResidueTerminusState.ProteinCTerminus;
+
+                        WriteProperty("terminus", cTerminal ? "c" : "n");
+                    }
+
+                    if (ProteinModSites != null)
+                    {
+                        WriteProteinPositions(ProteinModSites.GetSites(psmEntry.ResultID), residue.ResidueLocInPeptide);
+                    }
+
+                    WriteEndObject();
+                }
+
+                WriteEndArray();
+            }
+
+            WritePropertyName("scores");
+            WriteStartObject();
+
+            for (var slot = 0; slot < psmEntry.Scores.Length; slot++)
+            {
+                var scoreText = psmEntry.GetScoreText(slot);
+                if (scoreText == null)
+                    continue;
+
+                WritePropertyNumberOrString(mScoreSchema.ScoreNames[slot], scoreText);
+            }
+
+            if (!string.IsNullOrWhiteSpace(psmEntry.MSGFSpecEValue))
+            {
+                WritePropertyNumberOrString("msgfspecprob", psmEntry.MSGFSpecEValue);
+            }
+
+            WriteEndObject();
+
+            WriteEndObject();
+        }
+
+        private void WriteArrayValue(string value)
+        {
+            WriteSeparator();
+            WriteString(value);
+        }
+
+        private void WriteByte(byte value)
+        {
+            EnsureCapacity(1);
+            mBuffer[mPosition++] = value;
+            BytesWritten++;
+        }
+
+        /// <summary>
+        /// Write the digits of a non-negative integer
+        /// </summary>
+        /// <param name="value"></param>
+        /// <param name="minimumDigits">Number of digits to write, padding with leading zeros if necessary</param>
+        private void WriteDigits(long value, int minimumDigits = 1)
+        {
+            EnsureCapacity(Math.Max(MAX_BYTES_PER_INTEGER, minimumDigits));
+
+            var digitCount = 1;
+            for (var remaining = value / 10; remaining > 0; remaining /= 10)
+            {
+                digitCount++;
+            }
+
+            digitCount = Math.Max(digitCount, minimumDigits);
+
+            for (var i = mPosition + digitCount - 1; i >= mPosition; i--)
+            {
+                mBuffer[i] = (byte)('0' + value % 10);
+                value /= 10;
+            }
+
+            mPosition += digitCount;
+            BytesWritten += digitCount;
+        }
+
+        private void WriteEndArray()
+        {
+            WriteByte((byte)']');
+            mNeedsComma = true;
+        }
+
+        private void WriteEndObject()
+        {
+            WriteByte((byte)'}');
+            mNeedsComma = true;
+        }
+
+        /// <summary>
+        /// Append a character as UTF-8, escaping it if required by the JSON format
+        /// </summary>
+        /// <param name="value"></param>
+        private void WriteEscapedChar(char value)
+        {
+            EnsureCapacity(MAX_BYTES_PER_CHAR);
+
+            var start = mPosition;
+
+            switch (value)
+            {
+                case '"':
+                case '\\':
+                    mBuffer[mPosition++] = (byte)'\\';
+                    mBuffer[mPosition++] = (byte)value;
+                    break;
+
+                case '\n':
+                    mBuffer[mPosition++] = (byte)'\\';
+                    mBuffer[mPosition++] = (byte)'n';
+                    break;
+
+                case '\r':
+                    mBuffer[mPosition++] = (byte)'\\';
+                    mBuffer[mPosition++] = (byte)'r';
+                    break;
+
+                case '\t':
+                    mBuffer[mPosition++] = (byte)'\\';
+                    mBuffer[mPosition++] = (byte)'t';
+                    break;
+
+                default:
+                    if (value < 0x20)
+                    {
+                        mBuffer[mPosition++] = (byte)'\\';
+                        mBuffer[mPosition++] = (byte)'u';
+                        mBuffer[mPosition++] = (byte)'0';
+                        mBuffer[mPosition++] = (byte)'0';
+                        mBuffer[mPosition++] = mHexDigits[value >> 4];
+                        mBuffer[mPosition++] = mHexDigits[value & 0xF];
+                    }
+                    else if (value < 0x80)
+                    {
+                        mBuffer[mPosition++] = (byte)value;
+                    }
+                    else if (value < 0x800)
+                    {
+                        mBuffer[mPosition++] = (byte)(0xC0 | (value >> 6));
+                        mBuffer[mPosition++] = (byte)(0x80 | (value & 0x3F));
+                    }
+                    else
+                    {
+                        // Unpaired surrogates are written as the replacement character, U+FFFD
+                        var codePoint = char.IsSurrogate(value) ? '\uFFFD' : value;
+                        mBuffer[mPosition++] = (byte)(0xE0 | (codePoint >> 12));
+                        mBuffer[mPosition++] = (byte)(0x80 | ((codePoint >> 6) & 0x3F));
+                        mBuffer[mPosition++] = (byte)(0x80 | (codePoint & 0x3F));
+                    }
+
+                    break;
+            }
+
+            BytesWritten += mPosition - start;
+        }
+
+        /// <summary>
+        /// Append text as UTF-8, escaping characters as required by the JSON format
+        /// </summary>
+        /// <param name="value"></param>
+        private void WriteEscapedText(string value)
+        {
+            for (var i = 0; i < value.Length; i++)
+            {
+                var currentChar = value[i];
+
+                if (!char.IsHighSurrogate(currentChar) || i + 1 >= value.Length || !char.IsLowSurrogate(value[i + 1]))
+                {
+                    WriteEscapedChar(currentChar);
+                    continue;
+                }
+
+                // Surrogate pair; write the code point as four bytes
+                var codePoint = char.ConvertToUtf32(currentChar, value[i + 1]);
+                i++;
+
+                EnsureCapacity(4);
+                mBuffer[mPosition++] = (byte)(0xF0 | (codePoint >> 18));
+                mBuffer[mPosition++] = (byte)(0x80 | ((codePoint >> 12) & 0x3F));
+                mBuffer[mPosition++] = (byte)(0x80 | ((codePoint >> 6) & 0x3F));
+                mBuffer[mPosition++] = (byte)(0x80 | (codePoint & 0x3F));
+                BytesWritten += 4;
+            }
+        }
+
+        private void WriteNull()
+        {
+            WriteEscapedText("null");
+        }
+
+        private void WriteNumber(long value)
+        {
+            if (value < 0)
+            {
+                WriteByte((byte)'-');
+
+                if (value == long.MinValue)
+                {
+                    // Cannot negate long.MinValue
+                    WriteEscapedText(long.MinValue.ToString(CultureInfo.InvariantCulture).Substring(1));
+                    return;
+                }
+
+                value = -value;
+            }
+
+            WriteDigits(value);
+        }
+
+        /// <summary>
+        /// Write a number, rounded to the given number of digits after the decimal point
+        /// </summary>
+        /// <remarks>Trailing zeros are removed; NaN and infinity are written as null</remarks>
+        /// <param name="value"></param>
+        /// <param name="digitsAfterDecimal"></param>
+        private void WriteNumber(double value, byte digitsAfterDecimal)
+        {
+            if (double.IsNaN(value) || double.IsInfinity(value))
+            {
+                WriteNull();
+                return;
+            }
+
+            var digits = Math.Min((int)digitsAfterDecimal, MAX_DIGITS_AFTER_DECIMAL);
+            var scale = mPowersOfTen[digits];
+            var scaledValue = Math.Round(Math.Abs(value) * scale, MidpointRounding.AwayFromZero);
+
+            if (scaledValue >= long.MaxValue / 10)
+            {
+                // Too large to format using integer arithmetic (this is not expected for masses or elution times)
+                WriteEscapedText(value.ToString("R", CultureInfo.InvariantCulture));
+                return;
+            }
+
+            var roundedValue = (long)scaledValue;
+            var integerPart = roundedValue / scale;
+            var fractionalPart = roundedValue % scale;
+
+            if (value < 0 && roundedValue != 0)
+                WriteByte((byte)'-');
+
+            WriteDigits(integerPart);
+
+            if (fractionalPart == 0)
+                return;
+
+            while (fractionalPart % 10 == 0)
+            {
+                fractionalPart /= 10;
+                digits--;
+            }
+
+            WriteByte((byte)'.');
+            WriteDigits(fractionalPart, digits);
+        }
+
+        /// <summary>
+        /// Write a value reported by PHRPReader as a JSON number if numeric, otherwise as a string
+        /// </summary>
+        /// <remarks>Empty values are written as null</remarks>
+        /// <param name="value"></param>
+        private void WriteNumberOrString(string value)
+        {
+            if (string.IsNullOrWhiteSpace(value))
+            {
+                WriteNull();
+            }
+            else if (IsJsonNumber(value))
+            {
+                // Keep the original text, and thus the original precision
+                WriteEscapedText(value);
+            }
+            else if (double.TryParse(value, NumberStyles.Float, CultureInfo.InvariantCulture, out var numericValue) &&
+                     !double.IsNaN(numericValue) && !double.IsInfinity(numericValue))
+            {
+                // Numbers like +5 or .25 are not valid JSON
+                WriteEscapedText(numericValue.ToString("R", CultureInfo.InvariantCulture));
+            }
+            else
+            {
+                WriteString(value);
+            }
+        }
+
+        private void WriteProperty(string propertyName, string value)
+        {
+            WritePropertyName(propertyName);
+            WriteString(value);
+            mNeedsComma = true;
+        }
+
+        private void WriteProperty(string propertyName, long value)
+        {
+            WritePropertyName(propertyName);
+            WriteNumber(value);
+            mNeedsComma = true;
+        }
+
+        private void WriteProperty(string propertyName, double value, byte digitsAfterDecimal)
+        {
+            WritePropertyName(propertyName);
+            WriteNumber(value, digitsAfterDecimal);
+            mNeedsComma = true;
+        }
+
+        private void WritePropertyName(string propertyName)
+        {
+            WriteSeparator();
+            WriteByte((byte)'"');
+            WriteEscapedText(propertyName);
+            WriteByte((byte)'"');
+            WriteByte((byte)':');
+        }
+
+        private void WritePropertyNumberOrString(string propertyName, string value)
+        {
+            WritePropertyName(propertyName);
+            WriteNumberOrString(value);
+            mNeedsComma = true;
+        }
+
+        /// <summary>
+        /// Write the protein name and residue number of each site at the given peptide residue
+        /// </summary>
+        /// <remarks>Nothing is written if none of the sites are at the peptide residue</remarks>
+        /// <param name="sites">Protein-relative modification sites for the PSM</param>
+        /// <param name="peptideResidueNumber">Residue number in the peptide (1-based)</param>
+        private void WriteProteinPositions(ArraySegment<ProteinModIndex.ProteinModSite> sites, int peptideResidueNumber)
+        {
+            var arrayStarted = false;
+
+            // Index the underlying array instead of using foreach, which would box the ArraySegment enumerator
+            for (var i = sites.Offset; i < sites.Offset + sites.Count; i++)
+            {
+                var site = sites.Array[i];
+
+                if (site.PeptideResidueNumber != peptideResidueNumber)
+                    continue;
+
+                if (!arrayStarted)
+                {
+                    WritePropertyName("protein_positions");
+                    WriteStartArray();
+                    arrayStarted = true;
+                }
+
+                WriteStartObject();
+                WriteProperty("protein", site.ProteinName);
+                WriteProperty("position", site.ProteinResidueNumber);
+                WriteEndObject();
+            }
+
+            if (arrayStarted)
+                WriteEndArray();
+        }
+
+        private void WriteSeparator()
+        {
+            if (mNeedsComma)
+                WriteByte((byte)',');
+
+            mNeedsComma = false;
+        }
+
+        private void WriteStartArray()
+        {
+            WriteSeparator();
+            WriteByte((byte)'[');
+            mNeedsComma = false;
+        }
+
+        private void WriteStartObject()
+        {
+            WriteSeparator();
+            WriteByte((byte)'{');
+            mNeedsComma = false;
+        }
+
+        private void WriteString(string value)
+        {
+            if (value == null)
+            {
+                WriteNull();
+            }
+            else
+            {
+                WriteByte((byte)'"');
+                WriteEscapedText(value);
+                WriteByte((byte)'"');
+            }
+
+            mNeedsComma = true;
+        }
+    }
+}
@@ -0,0 +1,259 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Linq;
+using PHRPReader;
+using PHRPReader.Data;
+using PRISM;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// Micro-benchmarks for the functions called once per PSM or once per search hit
+    /// </summary>
+    /// <remarks>
+    /// PSMs are read from the input file, then each function is called repeatedly,
+    /// reporting the average time (ns/op) and managed memory allocated (bytes/op) per call
+    /// </remarks>
+    public class MicroBenchmarks : EventNotifier
+    {
+        /// <summary>
+        /// Maximum number of PSMs to load from the input file
+        /// </summary>
+        private const int MAX_PSMS_TO_LOAD = 10000;
+
+        /// <summary>
+        /// Minimum elapsed time for each measurement, in milliseconds
+        /// </summary>
+        private const int MINIMUM_SAMPLE_MSEC = 250;
+
+        /// <summary>
+        /// Number of measurements per function; the median time is reported
+        /// </summary>
+        private const int SAMPLE_COUNT = 5;
+
+        private readonly Options mOptions;
+
+        // Results of the benchmarked functions are stored here so that the JIT compiler cannot optimize the calls away
+        private object mLastResult;
+        private bool mLastFlag;
+
+        /// <summary>
+        /// Constructor
+        /// </summary>
+        /// <param name="options"></param>
+        public MicroBenchmarks(Options options)
+        {
+            mOptions = options;
+
+            // Required to track allocated bytes under the .NET Framework
+            AppDomain.MonitoringIsEnabled = true;
+        }
+
+        private List<PSM> LoadPSMs(string inputFilePath, out SortedList<int, List<ProteinInfo>> seqToProteinMap)
+        {
+            var startupOptions = new StartupOptions
+            {
+                LoadModsAndSeqInfo = mOptions.LoadModsAndSeqInfo,
+                LoadMSGFResults = mOptions.LoadMSGFResults,
+                LoadScanStatsData = mOptions.LoadScanStats,
+
+                // Load all of the proteins for each PSM so that the total protein count is known; CachedPSM applies MaxProteinsPerPSM
+                MaxProteinsPerPSM = 0
+            };
+
+            var psms = new List<PSM>();
+
+            using var reader = new ReaderFactory(inputFilePath, startupOptions);
+            RegisterEvents(reader);
+
+            mOptions.DatasetName = string.IsNullOrEmpty(reader.DatasetName) ? "Unknown" : reader.DatasetName;
+            mOptions.PeptideHitResultType = reader.PeptideHitResultType;
+            seqToProteinMap = reader.SeqToProteinMap;
+
+            while (psms.Count < MAX_PSMS_TO_LOAD && reader.MoveNext())
+            {
+                psms.Add(reader.CurrentPSM);
+            }
+
+            return psms;
+        }
+
+        /// <summary>
+        /// Call an operation repeatedly, then report the average time and bytes allocated per call
+        /// </summary>
+        /// <param name="functionName"></param>
+        /// <param name="operation">Operation to benchmark; the argument is the iteration number</param>
+        private void Measure(string functionName, Action<int> operation)
+        {
+            // Warm up, which also JIT compiles the code
+            for (var i = 0; i < 1000; i++)
+            {
+                operation(i);
+            }
+
+            // Determine the number of iterations required to reach the minimum sample time
+            var iterations = 1000;
+            var stopwatch = new Stopwatch();
+
+            while (true)
+            {
+                stopwatch.Restart();
+                for (var i = 0; i < iterations; i++)
+                {
+                    operation(i);
+                }
+
+                stopwatch.Stop();
+
+                if (stopwatch.ElapsedMilliseconds >= MINIMUM_SAMPLE_MSEC || iterations >= int.MaxValue / 2)
+                    break;
+
+                iterations *= 2;
+            }
+
+            var nanosecondsPerOp = new List<double>();
+            long totalAllocatedBytes = 0;
+
+            for (var sample = 0; sample < SAMPLE_COUNT; sample++)
+            {
+                GC.Collect();
+                GC.WaitForPendingFinalizers();
+                GC.Collect();
+
+                var startAllocatedBytes = AppDomain.CurrentDomain.MonitoringTotalAllocatedMemorySize;
+                stopwatch.Restart();
+
+                for (var i = 0; i < iterations; i++)
+                {
+                    operation(i);
+                }
+
+                stopwatch.Stop();
+
+                totalAllocatedBytes += AppDomain.CurrentDomain.MonitoringTotalAllocatedMemorySize - startAllocatedBytes;
+                nanosecondsPerOp.Add(stopwatch.Elapsed.TotalMilliseconds * 1000000.0 / iterations);
+            }
+
+            nanosecondsPerOp.Sort();
+            var bytesPerOp = totalAllocatedBytes / (double)SAMPLE_COUNT / iterations;
+
+            OnStatusEvent(string.Format("{0,-28} {1,14:#,##0} {2,12:#,##0.0} {3,12:#,##0.0}",
+                functionName, iterations, nanosecondsPerOp[SAMPLE_COUNT / 2], bytesPerOp));
+        }
+
+        /// <summary>
+        /// Load PSMs from the input file, then benchmark the per-PSM and per-hit functions
+        /// </summary>
+        /// <remarks>
+        /// Filter options (/X, /H, /PepFilter, and /ChargeFilter) are used when benchmarking the PSM filters
+        /// </remarks>
+        /// <param name="inputFilePath">PHRP input file path</param>
+        /// <returns>True if successful, false if an error</returns>
+        public bool Run(string inputFilePath)
+        {
+            try
+            {
+                if (!File.Exists(inputFilePath))
+                {
+                    OnErrorEvent("Input file not found: " + inputFilePath);
+                    return false;
+                }
+
+                OnStatusEvent("Loading up to " + MAX_PSMS_TO_LOAD.ToString("#,##0") + " PSMs from " + Path.GetFileName(inputFilePath));
+                var psms = LoadPSMs(inputFilePath, out var seqToProteinMap);
+
+                if (psms.Count == 0)
+                {
+                    OnErrorEvent("No PSMs were loaded from " + inputFilePath);
+                    return false;
+                }
+
+                var converter = new PeptideListToXML(mOptions);
+                RegisterEvents(converter);
+
+                SortedSet<string> peptidesToFilterOn;
+                if (string.IsNullOrWhiteSpace(mOptions.PeptideFilterFilePath))
+                {
+                    peptidesToFilterOn = new SortedSet<string>();
+                }
+                else if (!converter.LoadPeptideFilterFile(mOptions.PeptideFilterFilePath, out peptidesToFilterOn))
+                {
+                    return false;
+                }
+
+                var spectrumKeys = psms.ConvertAll(PeptideListToXML.GetSpectrumKey);
+
+                var scoreSchema = new ScoreSchema();
+                var cachedPSMs = psms.ConvertAll(psm => new CachedPSM(psm, scoreSchema, mOptions.MaxProteinsPerPSM));
+                var modifiedPSMs = cachedPSMs.Where(psm => psm.ModifiedResidues.Count > 0).ToList();
+
+                // Use the spectrum with the most hits as the representative spectrum, preferring one with modified residues
+                var spectrumPSMIndices = (from index in Enumerable.Range(0, psms.Count)
+                                          group index by spectrumKeys[index] into spectrum
+                                          orderby spectrum.Count() descending, spectrum.Any(index => psms[index].ModifiedResidues.Count > 0) descending
+                                          select spectrum.ToList()).First();
+
+                var spectrumPSMs = spectrumPSMIndices.ConvertAll(index => cachedPSMs[index]);
+
+                var firstPSM = psms[spectrumPSMIndices[0]];
+                var spectrumInfo = new SpectrumInfo(
+                    firstPSM.ScanNumberStart,
+                    firstPSM.ScanNumberEnd,
+                    firstPSM.PrecursorNeutralMass,
+                    firstPSM.Charge,
+                    firstPSM.ElutionTimeMinutes,
+                    PepXMLWriter.GetPepXMLCollisionMode(firstPSM.CollisionMode),
+                    0);
+
+                var searchEngineParams = new SearchEngineParameters(mOptions.PeptideHitResultType.ToString());
+                var writer = new PepXMLWriter(Stream.Null, mOptions.DatasetName + ".pepXML", searchEngineParams, scoreSchema, mOptions);
+                RegisterEvents(writer);
+
+                OnStatusEvent(string.Format("Loaded {0:#,##0} PSMs ({1:#,##0} with modified residues); representative spectrum has {2} hits",
+                    psms.Count, modifiedPSMs.Count, spectrumPSMs.Count));
+
+                OnStatusEvent(string.Empty);
+                OnStatusEvent(string.Format("{0,-28} {1,14} {2,12} {3,12}", "Function", "Iterations", "ns/op", "bytes/op"));
+
+                Measure("GetSpectrumKey", i => mLastFlag = PeptideListToXML.GetSpectrumKey(psms[i % psms.Count]).Charge > 0);
+
+                Measure("SkipPSM (filter chain)", i => mLastFlag = converter.SkipPSM(psms[i % psms.Count], peptidesToFilterOn));
+
+                Measure("CachedPSM constructor", i => mLastResult = new CachedPSM(psms[i % psms.Count], scoreSchema, mOptions.MaxProteinsPerPSM));
+
+                Measure("PSMInfo constructor", i => mLastResult = new PSMInfo(spectrumKeys[i % psms.Count], cachedPSMs[i % psms.Count]));
+
+                Measure("GetPepXMLCollisionMode", i => mLastFlag = PepXMLWriter.GetPepXMLCollisionMode(psms[i % psms.Count].CollisionMode) != PepXMLWriter.ActivationMethods.Unknown);
+
+                if (modifiedPSMs.Count > 0)
+                {
+                    var modifiedResidues = new Dictionary<int, double>();
+                    Measure("WriteModificationInfo", i => writer.WriteModificationInfo(modifiedResidues, modifiedPSMs[i % modifiedPSMs.Count]));
+                }
+                else
+                {
+                    OnStatusEvent(string.Format("{0,-28} skipped since no PSMs have modified residues", "WriteModificationInfo"));
+                }
+
+                Measure("WriteSpectrum", _ => writer.WriteSpectrum(spectrumInfo, spectrumPSMs, seqToProteinMap));
+
+                writer.CloseDocument();
+
+                OnStatusEvent(string.Empty);
+                OnStatusEvent("Times include the overhead of calling a delegate (typically 1 to 2 ns); " +
+                              "XML is written to a null stream, so WriteSpectrum and WriteModificationInfo exclude disk I/O");
+
+                GC.KeepAlive(mLastResult);
+                GC.KeepAlive(mLastFlag);
+                return true;
+            }
+            catch (Exception ex)
+            {
+                OnErrorEvent("Error in MicroBenchmarks.Run", ex);
+                return false;
+            }
+        }
+    }
+}
@@ -0,0 +1,583 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Reflection;
+using System.Text;
+using PHRPReader;
+using PHRPReader.Data;
+using PRISM;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// mzTab 1.0 writer (Summary mode, Identification type)
+    /// </summary>
+    /// <remarks>
+    /// <para>
+    /// Uses the same cached spectra and PSMs as PepXMLWriter; PSM rows are written as each spectrum is processed,
+    /// while peptides are aggregated in memory (one entry per unique sequence, modifications, and charge)
+    /// </para>
+    /// <para>
+    /// The mzTab format requires the peptide section to precede the PSM section, so PSM rows are written to a temporary file,
+    /// then appended to the mzTab file after the metadata and peptide sections when Close is called
+    /// </para>
+    /// </remarks>
+    public class MzTabWriter : EventNotifier, IDisposable
+    {
+        // Ignore Spelling: CHEMMOD, mzTab, nativeID, PEH, PSH, MTD
+
+        private const string NULL_VALUE = "null";
+
+        private const string PSM_SECTION_TEMP_FILE_SUFFIX = ".psm.tmp";
+
+        /// <summary>
+        /// Score used for the search_engine_score[1] column
+        /// </summary>
+        private class PrimaryScore
+        {
+            public string ScoreName { get; }
+
+            public string CvParam { get; }
+
+            public bool HigherIsBetter { get; }
+
+            public PrimaryScore(string scoreName, string cvParam, bool higherIsBetter)
+            {
+                ScoreName = scoreName;
+                CvParam = cvParam;
+                HigherIsBetter = higherIsBetter;
+            }
+        }
+
+        /// <summary>
+        /// PSMs aggregated by peptide sequence, modifications, and charge
+        /// </summary>
+        private class PeptideEntry
+        {
+            public string Sequence { get; set; }
+            public string Accession { get; set; }
+            public bool Unique { get; set; }
+            public string Modifications { get; set; }
+            public int Charge { get; set; }
+            public double CalculatedMassToCharge { get; set; }
+
+            public string BestScore { get; set; }
+            public double BestScoreValue { get; set; }
+
+            // Retention times are NaN if unknown
+            public double BestRetentionTimeSeconds { get; set; }
+
+            public double MinRetentionTimeSeconds { get; set; }
+            public double MaxRetentionTimeSeconds { get; set; }
+        }
+
+        // Scores are listed in order of preference; the first score found in the score schema is used as the primary score
+        private static readonly PrimaryScore[] mKnownPrimaryScores =
+        {
+            new("MSGFDB_SpecEValue", "[MS, MS:1002052, MS-GF:SpecEValue, ]", false),
+            new("Peptide_Expectation_Value", "[MS, MS:1001330, X!Tandem:expect, ]", false),
+            new("PEP", "[MS, MS:1001901, MaxQuant:PEP, ]", false),
+            new("XCorr", "[MS, MS:1001155, SEQUEST:xcorr, ]", true)
+        };
+
+        // Keys are search engine names reported by PHRPReader; values are PSI-MS accession and name
+        private static readonly Dictionary<string, string> mSearchEngineCvTerms = new(StringComparer.OrdinalIgnoreCase)
+        {
+            { "MS-GF+", "MS, MS:1002048, MS-GF+" },
+            { "MSGF+", "MS, MS:1002048, MS-GF+" },
+            { "X! Tandem", "MS, MS:1001476, X!Tandem" },
+            { "X!Tandem", "MS, MS:1001476, X!Tandem" },
+            { "MaxQuant", "MS, MS:1001583, MaxQuant" },
+            { "SEQUEST", "MS, MS:1001208, SEQUEST" }
+        };
+
+        private readonly string mOutputFilePath;
+
+        private readonly string mPSMSectionFilePath;
+
+        private readonly Options mOptions;
+
+        private readonly SearchEngineParameters mSearchEngineParams;
+
+        private readonly StreamWriter mPSMWriter;
+
+        // Slot of the primary score in the score schema; -1 to use the MSGF SpecEValue of each PSM
+        private readonly int mPrimaryScoreSlot;
+
+        private readonly PrimaryScore mPrimaryScore;
+
+        private readonly string mDatabase;
+
+        private readonly string mSearchEngine;
+
+        // Keys are peptide sequence, modifications, and charge, separated by tabs
+        private readonly Dictionary<string, PeptideEntry> mPeptides = new();
+
+        private readonly StringBuilder mRow = new();
+
+        private bool mClosed;
+
+        private int mPSMCount;
+
+        /// <summary>
+        /// Number of PSM rows written (one row per PSM and protein)
+        /// </summary>
+        public int PSMRowCount { get; private set; }
+
+        /// <summary>
+        /// Number of unique peptides (by sequence, modifications, and charge)
+        /// </summary>
+        public int PeptideCount => mPeptides.Count;
+
+        /// <summary>
+        /// Constructor
+        /// </summary>
+        /// <param name="outputFilePath">Path to the mzTab file to create</param>
+        /// <param name="searchEngineParams">Search engine parameters</param>
+        /// <param name="scoreSchema">Score schema of the cached PSMs</param>
+        /// <param name="options"></param>
+        public MzTabWriter(string outputFilePath, SearchEngineParameters searchEngineParams, ScoreSchema scoreSchema, Options options)
+        {
+            mOutputFilePath = outputFilePath;
+            mPSMSectionFilePath = outputFilePath + PSM_SECTION_TEMP_FILE_SUFFIX;
+            mOptions = options;
+            mSearchEngineParams = searchEngineParams;
+
+            mPrimaryScoreSlot = -1;
+            mPrimaryScore = new PrimaryScore("MSGF_SpecEValue", "[, , MSGF SpecEValue, ]", false);
+
+            foreach (var knownScore in mKnownPrimaryScores)
+            {
+                var slot = FindScoreSlot(scoreSchema, knownScore.ScoreName);
+                if (slot < 0)
+                    continue;
+
+                mPrimaryScoreSlot = slot;
+                mPrimaryScore = knownScore;
+                break;
+            }
+
+            var fastaFilePath = string.IsNullOrEmpty(searchEngineParams.FastaFilePath) ? options.FastaFilePath : searchEngineParams.FastaFilePath;
+            mDatabase = string.IsNullOrWhiteSpace(fastaFilePath) ? NULL_VALUE : Path.GetFileNameWithoutExtension(fastaFilePath);
+
+            mSearchEngine = GetSearchEngineParam(false);
+
+            mPSMWriter = new StreamWriter(new FileStream(mPSMSectionFilePath, FileMode.Create, FileAccess.Write, FileShare.Read, options.ResourceLimits.OutputBufferSize));
+            mPSMWriter.WriteLine(string.Join("\t",
+                "PSH", "sequence", "PSM_ID", "accession", "unique", "database", "database_version", "search_engine", "search_engine_score[1]",
+                "modifications", "retention_time", "charge", "exp_mass_to_charge", "calc_mass_to_charge", "spectra_ref", "pre", "post", "start", "end"));
+        }
+
+        /// <summary>
+        /// Write the metadata and peptide sections, then append the PSM section
+        /// </summary>
+        public void Close()
+        {
+            if (mClosed)
+                return;
+
+            mClosed = true;
+            mPSMWriter.Dispose();
+
+            try
+            {
+                using (var writer = new StreamWriter(new FileStream(mOutputFilePath, FileMode.Create, FileAccess.Write, FileShare.Read)))
+                {
+                    WriteMetadataSection(writer);
+                    writer.WriteLine();
+
+                    WritePeptideSection(writer);
+                    writer.WriteLine();
+                    writer.Flush();
+
+                    using var psmSection = new FileStream(mPSMSectionFilePath, FileMode.Open, FileAccess.Read, FileShare.Read);
+                    psmSection.CopyTo(writer.BaseStream);
+                }
+
+                OnStatusEvent(string.Format("mzTab file created with {0:#,##0} PSMs and {1:#,##0} peptides", mPSMCount, mPeptides.Count));
+            }
+            finally
+            {
+                DeleteTempFile();
+            }
+        }
+
+        private void DeleteTempFile()
+        {
+            try
+            {
+                if (File.Exists(mPSMSectionFilePath))
+                    File.Delete(mPSMSectionFilePath);
+            }
+            catch (Exception ex)
+            {
+                OnWarningEvent("Unable to delete temporary file " + mPSMSectionFilePath + ": " + ex.Message);
+            }
+        }
+
+        /// <summary>
+        /// Close the temporary PSM section file, if not yet closed
+        /// </summary>
+        /// <remarks>Does not create the mzTab file; call Close to do so</remarks>
+        public void Dispose()
+        {
+            if (mClosed)
+                return;
+
+            mClosed = true;
+            mPSMWriter.Dispose();
+            DeleteTempFile();
+        }
+
+        private static int FindScoreSlot(ScoreSchema scoreSchema, string scoreName)
+        {
+            for (var slot = 0; slot < scoreSchema.SlotCount; slot++)
+            {
+                if (scoreSchema.ScoreNames[slot].Equals(scoreName, StringComparison.OrdinalIgnoreCase))
+                    return slot;
+            }
+
+            return -1;
+        }
+
+        private static string FormatNumber(double value, byte digitsAfterDecimal)
+        {
+            return StringUtilities.DblToString(value, digitsAfterDecimal);
+        }
+
+        private static string FormatRetentionTime(double retentionTimeSeconds)
+        {
+            return double.IsNaN(retentionTimeSeconds) ? NULL_VALUE : FormatNumber(retentionTimeSeconds, 2);
+        }
+
+        /// <summary>
+        /// Format the modifications of a PSM using mzTab CHEMMOD notation, e.g. 3-CHEMMOD:+15.9949,0-CHEMMOD:+42.0106
+        /// </summary>
+        /// <param name="psm"></param>
+        /// <param name="sequenceLength"></param>
+        private static string GetModifications(CachedPSM psm, int sequenceLength)
+        {
+            if (psm.ModifiedResidues.Count == 0)
+                return NULL_VALUE;
+
+            var modifications = new StringBuilder();
+
+            foreach (var residue in psm.ModifiedResidues)
+            {
+                if (modifications.Length > 0)
+                    modifications.Append(',');
+
+                modifications.Append(GetModificationPosition(residue, sequenceLength)).Append("-CHEMMOD:").Append(GetSignedMass(residue.ModDefinition.ModificationMass));
+            }
+
+            return modifications.ToString();
+        }
+
+        /// <summary>
+        /// Determine the mzTab position of a modified residue
+        /// </summary>
+        /// <remarks>Terminal modifications are reported at position 0 (N-terminus) or sequenceLength + 1 (C-terminus)</remarks>
+        /// <param name="residue"></param>
+        /// <param name="sequenceLength"></param>
+        private static int GetModificationPosition(AminoAcidModInfo residue, int sequenceLength)
+        {
+            var modDef = residue.ModDefinition;
+
+            var terminalMod = modDef.ModificationType is
+                                  ModificationDefinition.ResidueModificationType.TerminalPeptideStaticMod or
+                                  ModificationDefinition.ResidueModificationType.ProteinTerminusStaticMod ||
+                              !string.IsNullOrEmpty(modDef.TargetResidues) && modDef.TargetResidues.IndexOf(residue.Residue) < 0;
+
+            if (!terminalMod)
+                return residue.ResidueLocInPeptide;
+
+            return residue.TerminusState switch
+            {
+                AminoAcidModInfo.ResidueTerminusState.PeptideCTerminus or AminoAcidModInfo.ResidueTerminusState.ProteinCTerminus => sequenceLength + 1,
+                _ => 0
+            };
+        }
+
+        /// <summary>
+        /// Convert the target residues of a modification to mzTab sites, e.g. M, N-term, or C-term
+        /// </summary>
+        /// <param name="targetResidues"></param>
+        private static SortedSet<string> GetModificationSites(string targetResidues)
+        {
+            var sites = new SortedSet<string>();
+
+            if (string.IsNullOrEmpty(targetResidues))
+                return sites;
+
+            foreach (var residue in targetResidues)
+            {
+                switch (residue)
+                {
+                    case AminoAcidModInfo.N_TERMINAL_PEPTIDE_SYMBOL_DMS:
+                    case AminoAcidModInfo.N_TERMINAL_PROTEIN_SYMBOL_DMS:
+                        sites.Add("N-term");
+                        break;
+
+                    case AminoAcidModInfo.C_TERMINAL_PEPTIDE_SYMBOL_DMS:
+                    case AminoAcidModInfo.C_TERMINAL_PROTEIN_SYMBOL_DMS:
+                        sites.Add("C-term");
+                        break;
+
+                    default:
+                        sites.Add(residue.ToString());
+                        break;
+                }
+            }
+
+            return sites;
+        }
+
+        private string GetSearchEngineParam(bool includeVersion)
+        {
+            var searchEngineName = mSearchEngineParams.SearchEngineName ?? string.Empty;
+            var version = includeVersion && !string.Equals(mSearchEngineParams.SearchEngineVersion, "Unknown", StringComparison.OrdinalIgnoreCase)
+                ? mSearchEngineParams.SearchEngineVersion ?? string.Empty
+                : string.Empty;
+
+            if (mSearchEngineCvTerms.TryGetValue(searchEngineName, out var cvTerm))
+                return "[" + cvTerm + ", " + version + "]";
+
+            return "[, , " + searchEngineName + ", " + version + "]";
+        }
+
+        private static string GetSignedMass(double modificationMass)
+        {
+            var massText = FormatNumber(modificationMass, 5);
+            return modificationMass < 0 ? massText : "+" + massText;
+        }
+
+        private string GetPrimaryScore(CachedPSM psm)
+        {
+            var score = mPrimaryScoreSlot < 0 || mPrimaryScoreSlot >= psm.Scores.Length
+                ? psm.MSGFSpecEValue
+                : psm.GetScoreText(mPrimaryScoreSlot);
+
+            return string.IsNullOrWhiteSpace(score) ? NULL_VALUE : score;
+        }
+
+        private bool IsBetterScore(double score, double comparisonScore)
+        {
+            return mPrimaryScore.HigherIsBetter ? score > comparisonScore : score < comparisonScore;
+        }
+
+        private void UpdatePeptide(
+            string sequence,
+            string modifications,
+            CachedPSM psm,
+            int charge,
+            double calculatedMassToCharge,
+            string score,
+            double retentionTimeSeconds)
+        {
+            var key = sequence + "\t" + modifications + "\t" + charge;
+            var hasScore = double.TryParse(score, NumberStyles.Float, CultureInfo.InvariantCulture, out var scoreValue);
+
+            if (!mPeptides.TryGetValue(key, out var peptide))
+            {
+                mPeptides.Add(key, new PeptideEntry
+                {
+                    Sequence = sequence,
+                    Accession = psm.ProteinFirst,
+                    Unique = psm.ProteinCount <= 1,
+                    Modifications = modifications,
+                    Charge = charge,
+                    CalculatedMassToCharge = calculatedMassToCharge,
+                    BestScore = hasScore ? score : NULL_VALUE,
+                    BestScoreValue = scoreValue,
+                    BestRetentionTimeSeconds = retentionTimeSeconds,
+                    MinRetentionTimeSeconds = retentionTimeSeconds,
+                    MaxRetentionTimeSeconds = retentionTimeSeconds
+                });
+
+                return;
+            }
+
+            if (!double.IsNaN(retentionTimeSeconds))
+            {
+                // Math.Min and Math.Max return NaN if either value is NaN
+                peptide.MinRetentionTimeSeconds = double.IsNaN(peptide.MinRetentionTimeSeconds) ? retentionTimeSeconds : Math.Min(peptide.MinRetentionTimeSeconds, retentionTimeSeconds);
+                peptide.MaxRetentionTimeSeconds = double.IsNaN(peptide.MaxRetentionTimeSeconds) ? retentionTimeSeconds : Math.Max(peptide.MaxRetentionTimeSeconds, retentionTimeSeconds);
+            }
+
+            if (!hasScore || peptide.BestScore != NULL_VALUE && !IsBetterScore(scoreValue, peptide.BestScoreValue))
+                return;
+
+            peptide.BestScore = score;
+            peptide.BestScoreValue = scoreValue;
+            peptide.BestRetentionTimeSeconds = retentionTimeSeconds;
+        }
+
+        private void WriteMetadataSection(TextWriter writer)
+        {
+            var metadata = new List<KeyValuePair<string, string>>
+            {
+                new("mzTab-version", "1.0.0"),
+                new("mzTab-mode", "Summary"),
+                new("mzTab-type", "Identification"),
+                new("mzTab-ID", mOptions.DatasetName),
+                new("description", "PSMs for dataset " + mOptions.DatasetName + ", converted from " + Path.GetFileName(mOptions.InputFilePath) + " by PeptideListToXML"),
+                new("ms_run[1]-location", "file://" + mOptions.DatasetName + ".mzML"),
+                new("ms_run[1]-id_format", "[MS, MS:1000768, Thermo nativeID format, ]"),
+                new("software[1]", GetSearchEngineParam(true)),
+                new("software[2]", "[, , PeptideListToXML, " + Assembly.GetExecutingAssembly().GetName().Version + "]"),
+                new("psm_search_engine_score[1]", mPrimaryScore.CvParam),
+                new("peptide_search_engine_score[1]", mPrimaryScore.CvParam)
+            };
+
+            var fixedMods = 0;
+            var variableMods = 0;
+
+            foreach (var modDef in mSearchEngineParams.ModList)
+            {
+                if (modDef.ModificationType == ModificationDefinition.ResidueModificationType.IsotopicMod)
+                    continue;
+
+                // mzTab allows one site per modification entry, so a modification with several target residues is listed once per site
+                var sites = GetModificationSites(modDef.TargetResidues);
+                if (sites.Count == 0)
+                    sites.Add(string.Empty);
+
+                foreach (var site in sites)
+                {
+                    string prefix;
+                    if (modDef.ModificationType == ModificationDefinition.ResidueModificationType.DynamicMod)
+                    {
+                        variableMods++;
+                        prefix = "variable_mod[" + variableMods + "]";
+                    }
+                    else
+                    {
+                        fixedMods++;
+                        prefix = "fixed_mod[" + fixedMods + "]";
+                    }
+
+                    metadata.Add(new KeyValuePair<string, string>(prefix, "[, , CHEMMOD:" + GetSignedMass(modDef.ModificationMass) + ", ]"));
+
+                    if (site.Length > 0)
+                        metadata.Add(new KeyValuePair<string, string>(prefix + "-site", site));
+                }
+            }
+
+            if (fixedMods == 0)
+                metadata.Add(new KeyValuePair<string, string>("fixed_mod[1]", "[MS, MS:1002453, No fixed modifications searched, ]"));
+
+            if (variableMods == 0)
+                metadata.Add(new KeyValuePair<string, string>("variable_mod[1]", "[MS, MS:1002454, No variable modifications searched, ]"));
+
+            foreach (var item in metadata)
+            {
+                writer.WriteLine("MTD\t" + item.Key + "\t" + item.Value);
+            }
+        }
+
+        private void WritePeptideSection(TextWriter writer)
+        {
+            writer.WriteLine(string.Join("\t",
+                "PEH", "sequence", "accession", "unique", "database", "database_version", "search_engine",
+                "best_search_engine_score[1]", "search_engine_score[1]_ms_run[1]", "modifications",
+                "retention_time", "retention_time_window", "charge", "mass_to_charge"));
+
+            foreach (var peptide in mPeptides.Values)
+            {
+                mRow.Clear();
+                mRow.Append("PEP\t").Append(peptide.Sequence)
+                    .Append('\t').Append(peptide.Accession)
+                    .Append('\t').Append(peptide.Unique ? '1' : '0')
+                    .Append('\t').Append(mDatabase)
+                    .Append('\t').Append(NULL_VALUE)
+                    .Append('\t').Append(mSearchEngine)
+                    .Append('\t').Append(peptide.BestScore)
+                    .Append('\t').Append(peptide.BestScore)
+                    .Append('\t').Append(peptide.Modifications)
+                    .Append('\t').Append(FormatRetentionTime(peptide.BestRetentionTimeSeconds))
+                    .Append('\t').Append(double.IsNaN(peptide.MinRetentionTimeSeconds)
+                        ? NULL_VALUE
+                        : FormatNumber(peptide.MinRetentionTimeSeconds, 2) + "|" + FormatNumber(peptide.MaxRetentionTimeSeconds, 2))
+                    .Append('\t').Append(peptide.Charge)
+                    .Append('\t').Append(FormatNumber(peptide.CalculatedMassToCharge, 5));
+
+                writer.WriteLine(mRow.ToString());
+            }
+        }
+
+        /// <summary>
+        /// Append the PSMs for a spectrum to the PSM section, and update the peptide section
+        /// </summary>
+        /// <param name="spectrum"></param>
+        /// <param name="psms"></param>
+        public void WriteSpectrum(SpectrumInfo spectrum, List<CachedPSM> psms)
+        {
+            if (psms is null || psms.Count == 0)
+                return;
+
+            var charge = spectrum.AssumedCharge;
+            // PHRPReader reports an elution time of 0 when it is unknown (e.g. if the ScanStats file was not loaded)
+            var retentionTimeSeconds = spectrum.ElutionTimeMinutes > 0 ? spectrum.ElutionTimeMinutes * 60.0 : double.NaN;
+            var spectraRef = "ms_run[1]:" + spectrum.GetNativeID();
+
+            var expMassToCharge = charge > 0
+                ? FormatNumber((spectrum.PrecursorNeutralMass + charge * PeptideMassCalculator.MASS_PROTON) / charge, 5)
+                : NULL_VALUE;
+
+            foreach (var psm in psms)
+            {
+                mPSMCount++;
+
+                string sequence;
+                string prefix;
+                string suffix;
+
+                if (PeptideCleavageStateCalculator.SplitPrefixAndSuffixFromSequence(psm.Peptide, out var peptide, out prefix, out suffix))
+                {
+                    sequence = PeptideCleavageStateCalculator.ExtractCleanSequenceFromSequenceWithMods(peptide, false);
+                }
+                else
+                {
+                    sequence = PeptideCleavageStateCalculator.ExtractCleanSequenceFromSequenceWithMods(psm.Peptide, false);
+                    prefix = NULL_VALUE;
+                    suffix = NULL_VALUE;
+                }
+
+                var modifications = GetModifications(psm, sequence.Length);
+                var score = GetPrimaryScore(psm);
+                var calcMassToCharge = charge > 0 ? (psm.PeptideMonoisotopicMass + charge * PeptideMassCalculator.MASS_PROTON) / charge : 0;
+                var unique = psm.ProteinCount <= 1 ? '1' : '0';
+
+                UpdatePeptide(sequence, modifications, psm, charge, calcMassToCharge, score, retentionTimeSeconds);
+
+                // CachedPSM limits the proteins to MaxProteinsPerPSM
+                foreach (var protein in psm.Proteins.Count > 0 ? psm.Proteins : (IReadOnlyList<string>)new[] { psm.ProteinFirst })
+                {
+                    mRow.Clear();
+                    mRow.Append("PSM\t").Append(sequence)
+                        .Append('\t').Append(mPSMCount)
+                        .Append('\t').Append(string.IsNullOrEmpty(protein) ? NULL_VALUE : protein)
+                        .Append('\t').Append(unique)
+                        .Append('\t').Append(mDatabase)
+                        .Append('\t').Append(NULL_VALUE)
+                        .Append('\t').Append(mSearchEngine)
+                        .Append('\t').Append(score)
+                        .Append('\t').Append(modifications)
+                        .Append('\t').Append(FormatRetentionTime(retentionTimeSeconds))
+                        .Append('\t').Append(charge)
+                        .Append('\t').Append(expMassToCharge)
+                        .Append('\t').Append(charge > 0 ? FormatNumber(calcMassToCharge, 5) : NULL_VALUE)
+                        .Append('\t').Append(spectraRef)
+                        .Append('\t').Append(string.IsNullOrEmpty(prefix) ? NULL_VALUE : prefix)
+                        .Append('\t').Append(string.IsNullOrEmpty(suffix) ? NULL_VALUE : suffix)
+                        .Append('\t').Append(NULL_VALUE)
+                        .Append('\t').Append(NULL_VALUE);
+
+                    mPSMWriter.WriteLine(mRow.ToString());
+                    PSMRowCount++;
+                }
+            }
+        }
+    }
+}
@@ -8,12 +8,22 @@ namespace PeptideListToXML
     /// </summary>
     public class Options
     {
-        // Future enum if support for mzIdentML is added
-        // public enum PeptideListOutputFormat
-        // {
-        //     PepXML = 0,
-        //     mzIdentML = 1
-        // }
+        /// <summary>
+        /// Output file formats
+        /// </summary>
+        /// <remarks>mzIdentML may be added in the future</remarks>
+        public enum PeptideListOutputFormat
+        {
+            /// <summary>
+            /// PepXML file
+            /// </summary>
+            PepXML = 0,
+
+            /// <summary>
+            /// JSON Lines file, with one JSON object per spectrum
+            /// </summary>
+            JsonLines = 1
+        }
 
         /// <summary>
         /// List of charge states to filter on (only storing the listed charge states)
@@ -21,6 +31,11 @@ namespace PeptideListToXML
         /// <remarks>If an empty list, return all charges</remarks>
         public List<int> ChargeFilterList { get; } = new();
 
+        /// <summary>
+        /// When true, also create an mzTab file, using the same cached data as the PepXML file
+        /// </summary>
+        public bool CreateMzTabFile { get; set; }
+
         /// <summary>
         /// Dataset name
         /// </summary>
@@ -29,6 +44,14 @@ namespace PeptideListToXML
         /// </remarks>
         public string DatasetName { get; set; }
 
+        /// <summary>
+        /// Maximum time, in minutes, to spend reading and writing each dataset
+        /// </summary>
+        /// <remarks>
+        /// 0 means no limit; when the limit is reached, the partial output file is deleted and the next dataset is processed
+        /// </remarks>
+        public double DatasetTimeoutMinutes { get; set; }
+
         /// <summary>
         /// FASTA file path to store in the pepXML file
         /// </summary>
@@ -37,6 +60,11 @@ namespace PeptideListToXML
         /// </remarks>
         public string FastaFilePath { get; set; }
 
+        /// <summary>
+        /// When true, load the PHRP _ProteinMods.txt file and include the protein-relative position of each modified residue in the output file
+        /// </summary>
+        public bool IncludeProteinModPositions { get; set; }
+
         /// <summary>
         /// Input file path
         /// </summary>
@@ -76,8 +104,10 @@ namespace PeptideListToXML
         /// <remarks>Optional</remarks>
         public string OutputDirectoryPath { get; set; }
 
-        // Future property if support for mzIdentML is added
-        // private PeptideListOutputFormat OutputFormat { get; set; }
+        /// <summary>
+        /// Output file format
+        /// </summary>
+        public PeptideListOutputFormat OutputFormat { get; set; }
 
         /// <summary>
         /// Parameter file path
@@ -108,12 +138,29 @@ namespace PeptideListToXML
         /// </summary>
         public bool PreviewMode { get; set; }
 
+        /// <summary>
+        /// CPU and memory limits, used to size the output buffers and the queues between threads
+        /// </summary>
+        /// <remarks>Program.Main replaces the default values with the limits of the container or host</remarks>
+        public ResourceLimits ResourceLimits { get; set; }
+
+        /// <summary>
+        /// When true, run micro-benchmarks of the per-PSM functions using PSMs from the input file, instead of creating a PepXML file
+        /// </summary>
+        public bool RunMicroBenchmarks { get; set; }
+
         /// <summary>
         /// PSMs per spectrum to store
         /// </summary>
         /// <remarks>0 means to store all PSMs</remarks>
         public int PSMsPerSpectrumToStore { get; set; }
 
+        /// <summary>
+        /// When true, save elapsed time, throughput, and memory usage for each processing phase to a JSON file
+        /// </summary>
+        /// <remarks>The file is created in the output directory and is named Dataset_PerfStats.json</remarks>
+        public bool SavePerformanceStats { get; set; }
+
         /// <summary>
         /// Name of the parameter file used by the search engine that produced the input results file
         /// </summary>
@@ -131,14 +178,28 @@ namespace PeptideListToXML
         /// <remarks>If the scan has multiple charges, the output file will still only have one peptide listed for that scan number</remarks>
         public bool TopHitOnly { get; set; }
 
+        /// <summary>
+        /// When true, check the PepXML file against the pepXML v117 schema rules while it is written, using a separate thread
+        /// </summary>
+        public bool ValidateOutput { get; set; }
+
+        /// <summary>
+        /// When true, write the JSON Lines output to the standard output stream instead of to a file
+        /// </summary>
+        /// <remarks>Only supported when OutputFormat is JsonLines; console messages are written to the standard error stream instead</remarks>
+        public bool WriteToStandardOutput { get; set; }
+
         /// <summary>
         /// Constructor
         /// </summary>
         public Options()
         {
             ChargeFilterList.Clear();
+            CreateMzTabFile = false;
             DatasetName = "Unknown";
+            DatasetTimeoutMinutes = 0;
             FastaFilePath = string.Empty;
+            IncludeProteinModPositions = false;
             InputFilePath = string.Empty;
             LoadModsAndSeqInfo = true;
             LoadMSGFResults = true;
@@ -146,14 +207,20 @@ namespace PeptideListToXML
             LogMessagesToFile = false;
             MaxProteinsPerPSM = 100;
             OutputDirectoryPath = string.Empty;
+            OutputFormat = PeptideListOutputFormat.PepXML;
             ParameterFilePath = string.Empty;
             PeptideFilterFilePath = string.Empty;
             PeptideHitResultType = PeptideHitResultTypes.Unknown;
             PreviewMode = false;
             PSMsPerSpectrumToStore = 3;
+            ResourceLimits = new ResourceLimits();
+            RunMicroBenchmarks = false;
+            SavePerformanceStats = false;
             SearchEngineParamFileName = string.Empty;
             SkipXPeptides = false;
             TopHitOnly = false;
+            ValidateOutput = false;
+            WriteToStandardOutput = false;
         }
     }
 }
@@ -15,12 +15,12 @@
         /// <summary>
         /// Peptide-sequence match
         /// </summary>
-        public PHRPReader.Data.PSM PSM { get; }
+        public CachedPSM PSM { get; }
 
         /// <summary>
         /// Spectrum key
         /// </summary>
-        public string SpectrumKey { get; }
+        public SpectrumKey SpectrumKey { get; }
 
         /// <summary>
         /// MSGF SpecProb value
@@ -32,7 +32,7 @@
         /// </summary>
         /// <param name="spectrumKey"></param>
         /// <param name="psm"></param>
-        public PSMInfo(string spectrumKey, PHRPReader.Data.PSM psm)
+        public PSMInfo(SpectrumKey spectrumKey, CachedPSM psm)
         {
             SpectrumKey = spectrumKey;
             mMSGFSpecProb = MSGF_SPEC_NOT_DEFINED;
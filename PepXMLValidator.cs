@@ -0,0 +1,456 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Threading;
+using System.Xml;
+using PRISM;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// Checks the PepXML data written by PepXMLWriter against the pepXML v117 schema rules, using a separate thread
+    /// </summary>
+    /// <remarks>
+    /// <para>
+    /// The stream returned by AttachToStream passes each buffer written by the XmlWriter to the output stream,
+    /// then copies the data to an AdaptiveBufferQueue for the validation thread, so the file is not read a second time
+    /// </para>
+    /// <para>
+    /// Checks include element nesting, required attributes, integer and floating point attribute values, and enumerated values;
+    /// this is a subset of the rules in pepXML_v117.xsd, covering the elements written by this program
+    /// </para>
+    /// </remarks>
+    public sealed class PepXMLValidator : EventNotifier, IDisposable
+    {
+        // Ignore Spelling: aminoacid, massdiff, xsd
+
+        /// <summary>
+        /// Maximum number of violations to report; additional violations are counted but not shown
+        /// </summary>
+        public const int MAX_VIOLATIONS_TO_REPORT = 25;
+
+        private class ElementRule
+        {
+            public string[] Parents { get; }
+
+            public string[] RequiredAttributes { get; }
+
+            public string[] IntegerAttributes { get; }
+
+            public string[] DoubleAttributes { get; }
+
+            public ElementRule(string[] parents, string[] requiredAttributes, string[] integerAttributes = null, string[] doubleAttributes = null)
+            {
+                Parents = parents;
+                RequiredAttributes = requiredAttributes;
+                IntegerAttributes = integerAttributes ?? Array.Empty<string>();
+                DoubleAttributes = doubleAttributes ?? Array.Empty<string>();
+            }
+        }
+
+        /// <summary>
+        /// Stream that writes to the output stream and queues a copy of each buffer for validation
+        /// </summary>
+        private class ValidatingStream : Stream
+        {
+            private readonly Stream mOutputStream;
+            private readonly PepXMLValidator mValidator;
+
+            public override bool CanRead => false;
+            public override bool CanSeek => false;
+            public override bool CanWrite => true;
+            public override long Length => mOutputStream.Length;
+
+            public override long Position
+            {
+                get => mOutputStream.Position;
+                set => throw new NotSupportedException();
+            }
+
+            public ValidatingStream(Stream outputStream, PepXMLValidator validator)
+            {
+                mOutputStream = outputStream;
+                mValidator = validator;
+            }
+
+            public override void Flush()
+            {
+                mOutputStream.Flush();
+            }
+
+            public override int Read(byte[] buffer, int offset, int count)
+            {
+                throw new NotSupportedException();
+            }
+
+            public override long Seek(long offset, SeekOrigin origin)
+            {
+                throw new NotSupportedException();
+            }
+
+            public override void SetLength(long value)
+            {
+                throw new NotSupportedException();
+            }
+
+            public override void Write(byte[] buffer, int offset, int count)
+            {
+                mOutputStream.Write(buffer, offset, count);
+
+                mValidator.mBuffers.Add(buffer, offset, count);
+            }
+
+            protected override void Dispose(bool disposing)
+            {
+                if (disposing)
+                {
+                    mOutputStream.Dispose();
+                    mValidator.mBuffers.CompleteAdding();
+                }
+
+                base.Dispose(disposing);
+            }
+        }
+
+        /// <summary>
+        /// Read-only stream that returns the queued buffers, in order
+        /// </summary>
+        private class QueuedBufferStream : Stream
+        {
+            private readonly AdaptiveBufferQueue mBuffers;
+
+            private byte[] mCurrentBuffer = Array.Empty<byte>();
+            private int mCurrentOffset;
+
+            public override bool CanRead => true;
+            public override bool CanSeek => false;
+            public override bool CanWrite => false;
+            public override long Length => throw new NotSupportedException();
+
+            public override long Position
+            {
+                get => throw new NotSupportedException();
+                set => throw new NotSupportedException();
+            }
+
+            public QueuedBufferStream(AdaptiveBufferQueue buffers)
+            {
+                mBuffers = buffers;
+            }
+
+            public override void Flush()
+            {
+            }
+
+            public override int Read(byte[] buffer, int offset, int count)
+            {
+                if (mCurrentOffset >= mCurrentBuffer.Length)
+                {
+                    // Wait for the next buffer; returns 0 (end of stream) once the writer is closed
+                    if (!mBuffers.TryTake(out mCurrentBuffer))
+                    {
+                        mCurrentBuffer = Array.Empty<byte>();
+                        mCurrentOffset = 0;
+                        return 0;
+                    }
+
+                    mCurrentOffset = 0;
+                }
+
+                var bytesToCopy = Math.Min(count, mCurrentBuffer.Length - mCurrentOffset);
+                Buffer.BlockCopy(mCurrentBuffer, mCurrentOffset, buffer, offset, bytesToCopy);
+                mCurrentOffset += bytesToCopy;
+
+                return bytesToCopy;
+            }
+
+            public override long Seek(long offset, SeekOrigin origin)
+            {
+                throw new NotSupportedException();
+            }
+
+            public override void SetLength(long value)
+            {
+                throw new NotSupportedException();
+            }
+
+            public override void Write(byte[] buffer, int offset, int count)
+            {
+                throw new NotSupportedException();
+            }
+        }
+
+        private static readonly Dictionary<string, ElementRule> mElementRules = new()
+        {
+            { "msms_pipeline_analysis", new ElementRule(Array.Empty<string>(), new[] { "date", "summary_xml" }) },
+            { "analysis_summary", new ElementRule(new[] { "msms_pipeline_analysis" }, new[] { "analysis", "time" }) },
+            { "msms_run_summary", new ElementRule(new[] { "msms_pipeline_analysis" }, new[] { "base_name", "raw_data_type", "raw_data" }) },
+            { "sample_enzyme", new ElementRule(new[] { "msms_run_summary" }, new[] { "name" }) },
+            { "specificity", new ElementRule(new[] { "sample_enzyme" }, new[] { "cut", "sense" }, new[] { "min_spacing" }) },
+            { "search_summary", new ElementRule(new[] { "msms_run_summary" }, new[] { "base_name", "search_engine", "precursor_mass_type", "fragment_mass_type", "search_id" }, new[] { "search_id" }) },
+            { "search_database", new ElementRule(new[] { "search_summary" }, new[] { "local_path", "type" }) },
+            { "enzymatic_search_constraint", new ElementRule(new[] { "search_summary" }, new[] { "enzyme", "max_num_internal_cleavages", "min_number_termini" }, new[] { "max_num_internal_cleavages", "min_number_termini" }) },
+            { "aminoacid_modification", new ElementRule(new[] { "search_summary" }, new[] { "aminoacid", "massdiff", "mass", "variable" }, null, new[] { "massdiff", "mass" }) },
+            { "terminal_modification", new ElementRule(new[] { "search_summary" }, new[] { "terminus", "massdiff", "mass", "variable", "protein_terminus" }, null, new[] { "massdiff", "mass" }) },
+            { "parameter", new ElementRule(new[] { "search_summary", "search_hit" }, new[] { "name", "value" }) },
+            { "spectrum_query", new ElementRule(new[] { "msms_run_summary" }, new[] { "spectrum", "start_scan", "end_scan", "precursor_neutral_mass", "assumed_charge", "index" }, new[] { "start_scan", "end_scan", "assumed_charge", "index" }, new[] { "precursor_neutral_mass", "retention_time_sec" }) },
+            { "search_result", new ElementRule(new[] { "spectrum_query" }, Array.Empty<string>()) },
+            { "search_hit", new ElementRule(new[] { "search_result" }, new[] { "hit_rank", "peptide", "protein", "num_tot_proteins", "calc_neutral_pep_mass", "massdiff" }, new[] { "hit_rank", "num_tot_proteins", "num_matched_ions", "tot_num_ions", "num_tol_term", "num_missed_cleavages", "is_rejected" }, new[] { "calc_neutral_pep_mass", "massdiff" }) },
+            { "alternative_protein", new ElementRule(new[] { "search_hit" }, new[] { "protein" }) },
+            { "modification_info", new ElementRule(new[] { "search_hit" }, Array.Empty<string>(), null, new[] { "mod_nterm_mass", "mod_cterm_mass" }) },
+            { "mod_aminoacid_mass", new ElementRule(new[] { "modification_info" }, new[] { "position", "mass" }, new[] { "position" }, new[] { "mass" }) },
+            { "search_score", new ElementRule(new[] { "search_hit" }, new[] { "name", "value" }) }
+        };
+
+        // Keys are element name and attribute name; values are the allowed values
+        private static readonly Dictionary<string, string[]> mEnumeratedValues = new()
+        {
+            { "search_summary@precursor_mass_type", new[] { "monoisotopic", "average" } },
+            { "search_summary@fragment_mass_type", new[] { "monoisotopic", "average" } },
+            { "search_database@type", new[] { "AA", "NA" } },
+            { "aminoacid_modification@variable", new[] { "Y", "N" } },
+            { "terminal_modification@variable", new[] { "Y", "N" } },
+            { "terminal_modification@protein_terminus", new[] { "Y", "N" } },
+            { "terminal_modification@terminus", new[] { "n", "c", "N", "C" } },
+            { "specificity@sense", new[] { "C", "N" } }
+        };
+
+        private readonly AdaptiveBufferQueue mBuffers;
+
+        private readonly List<string> mViolations = new();
+
+        private readonly Thread mValidationThread;
+
+        private int mViolationCount;
+
+        private bool mCompleted;
+
+        /// <summary>
+        /// Number of elements checked
+        /// </summary>
+        public int ElementsChecked { get; private set; }
+
+        /// <summary>
+        /// Number of schema violations found
+        /// </summary>
+        public int ViolationCount => mViolationCount;
+
+        /// <summary>
+        /// Constructor
+        /// </summary>
+        /// <remarks>
+        /// When the queue between the writer and the validation thread is full, the writer waits for the validation thread;
+        /// the queue length and buffer size start at the values in resourceLimits, then adapt to memory pressure and throughput
+        /// </remarks>
+        /// <param name="resourceLimits">Resource limits</param>
+        public PepXMLValidator(ResourceLimits resourceLimits)
+        {
+            mBuffers = new AdaptiveBufferQueue(ResourceLimits.VALIDATION_BUFFER_SIZE, resourceLimits.ValidationQueueCapacity, resourceLimits);
+
+            mValidationThread = new Thread(ValidateQueuedData)
+            {
+                IsBackground = true,
+                Name = "PepXMLValidator"
+            };
+        }
+
+        private void AddViolation(IXmlLineInfo lineInfo, string message)
+        {
+            mViolationCount++;
+            if (mViolations.Count < MAX_VIOLATIONS_TO_REPORT)
+            {
+                mViolations.Add(string.Format("Line {0}: {1}", lineInfo?.LineNumber ?? 0, message));
+            }
+        }
+
+        /// <summary>
+        /// Start validating the data written to the returned stream
+        /// </summary>
+        /// <param name="outputStream">Stream to write the PepXML data to; disposed when the returned stream is disposed</param>
+        /// <returns>Stream for the XmlWriter</returns>
+        public Stream AttachToStream(Stream outputStream)
+        {
+            mValidationThread.Start();
+            return new ValidatingStream(outputStream, this);
+        }
+
+        private void CheckAttributes(XmlReader reader, string elementName, ElementRule rule)
+        {
+            var lineInfo = (IXmlLineInfo)reader;
+
+            foreach (var attributeName in rule.RequiredAttributes)
+            {
+                if (reader.GetAttribute(attributeName) == null)
+                {
+                    AddViolation(lineInfo, string.Format("<{0}> is missing required attribute {1}", elementName, attributeName));
+                }
+            }
+
+            foreach (var attributeName in rule.IntegerAttributes)
+            {
+                var value = reader.GetAttribute(attributeName);
+                if (value != null && !int.TryParse(value, NumberStyles.Integer, CultureInfo.InvariantCulture, out _))
+                {
+                    AddViolation(lineInfo, string.Format("<{0}> attribute {1} is not an integer: \"{2}\"", elementName, attributeName, value));
+                }
+            }
+
+            foreach (var attributeName in rule.DoubleAttributes)
+            {
+                var value = reader.GetAttribute(attributeName);
+                if (value == null)
+                    continue;
+
+                if (!double.TryParse(value, NumberStyles.Float, CultureInfo.InvariantCulture, out var number) || double.IsNaN(number) || double.IsInfinity(number))
+                {
+                    AddViolation(lineInfo, string.Format("<{0}> attribute {1} is not a number: \"{2}\"", elementName, attributeName, value));
+                }
+            }
+
+            if (!reader.MoveToFirstAttribute())
+                return;
+
+            do
+            {
+                if (mEnumeratedValues.TryGetValue(elementName + "@" + reader.LocalName, out var allowedValues) &&
+                    Array.IndexOf(allowedValues, reader.Value) < 0)
+                {
+                    AddViolation(lineInfo, string.Format("<{0}> attribute {1} has invalid value \"{2}\"; allowed values are {3}",
+                        elementName, reader.LocalName, reader.Value, string.Join(", ", allowedValues)));
+                }
+            } while (reader.MoveToNextAttribute());
+
+            reader.MoveToElement();
+        }
+
+        /// <summary>
+        /// Wait for the validation thread to check the remaining data, then report any violations
+        /// </summary>
+        /// <remarks>Call this after the XmlWriter has been closed</remarks>
+        /// <returns>True if no violations were found</returns>
+        public bool Complete()
+        {
+            if (mCompleted)
+                return mViolationCount == 0;
+
+            mCompleted = true;
+
+            mBuffers.CompleteAdding();
+            mValidationThread.Join();
+
+            OnDebugEvent(string.Format(
+                "PepXML validation queue: peak {0:#,##0} KB queued, final limit {1:#,##0} KB in {2:#,##0} KB buffers " +
+                "(grown {3} times, shrunk {4} times due to memory pressure); writer waited {5:F2} seconds",
+                mBuffers.PeakQueuedBytes / 1024, mBuffers.QueuedBytesLimit / 1024, mBuffers.BatchSize / 1024,
+                mBuffers.GrowCount, mBuffers.ShrinkCount, mBuffers.WriterWaitTime.TotalSeconds));
+
+            if (mViolationCount == 0)
+            {
+                OnStatusEvent(string.Format("PepXML validation: {0:#,##0} elements conform to the pepXML v117 rules", ElementsChecked));
+                return true;
+            }
+
+            OnWarningEvent(string.Format("PepXML validation: found {0:#,##0} schema violation{1} in {2:#,##0} elements",
+                mViolationCount, mViolationCount == 1 ? string.Empty : "s", ElementsChecked));
+
+            foreach (var violation in mViolations)
+            {
+                OnWarningEvent("  " + violation);
+            }
+
+            if (mViolationCount > mViolations.Count)
+            {
+                OnWarningEvent(string.Format("  ... {0:#,##0} additional violations not shown", mViolationCount - mViolations.Count));
+            }
+
+            return false;
+        }
+
+        /// <summary>
+        /// Stop the validation thread, if running
+        /// </summary>
+        public void Dispose()
+        {
+            mBuffers.CompleteAdding();
+
+            if (mValidationThread.IsAlive)
+                mValidationThread.Join();
+        }
+
+        private void ValidateQueuedData()
+        {
+            var settings = new XmlReaderSettings
+            {
+                DtdProcessing = DtdProcessing.Ignore,
+                IgnoreComments = true,
+                IgnoreProcessingInstructions = true,
+                IgnoreWhitespace = true
+            };
+
+            var elementStack = new Stack<string>();
+            IXmlLineInfo lineInfo = null;
+
+            try
+            {
+                // XmlReader.Create reads the start of the data, so it is inside the try block
+                using var reader = XmlReader.Create(new QueuedBufferStream(mBuffers), settings);
+                lineInfo = (IXmlLineInfo)reader;
+
+                while (reader.Read())
+                {
+                    if (reader.NodeType == XmlNodeType.EndElement)
+                    {
+                        elementStack.Pop();
+                        continue;
+                    }
+
+                    if (reader.NodeType != XmlNodeType.Element)
+                        continue;
+
+                    var elementName = reader.LocalName;
+                    var parentName = elementStack.Count > 0 ? elementStack.Peek() : string.Empty;
+                    ElementsChecked++;
+
+                    if (mElementRules.TryGetValue(elementName, out var rule))
+                    {
+                        if (rule.Parents.Length == 0 ? parentName.Length > 0 : Array.IndexOf(rule.Parents, parentName) < 0)
+                        {
+                            AddViolation(lineInfo, parentName.Length == 0
+                                ? string.Format("<{0}> is not allowed as the root element", elementName)
+                                : string.Format("<{0}> is not allowed in <{1}>", elementName, parentName));
+                        }
+
+                        CheckAttributes(reader, elementName, rule);
+                    }
+
+                    if (!reader.IsEmptyElement)
+                    {
+                        elementStack.Push(elementName);
+                    }
+                }
+
+                if (ElementsChecked == 0)
+                {
+                    AddViolation(lineInfo, "the file does not have any elements");
+                }
+            }
+            catch (XmlException ex)
+            {
+                AddViolation(lineInfo, "malformed XML: " + ex.Message);
+            }
+            catch (Exception ex)
+            {
+                // This method runs on the validation thread, where an unhandled exception would terminate the program
+                AddViolation(lineInfo, "validation stopped due to an error: " + ex.Message);
+            }
+            finally
+            {
+                // Discard any remaining buffers so that the writer is not blocked
+                while (mBuffers.TryTake(out _))
+                {
+                }
+            }
+        }
+    }
+}
@@ -14,43 +14,127 @@ namespace PeptideListToXML
     /// <summary>
     /// PepXML writer
     /// </summary>
-    public class PepXMLWriter : EventNotifier
+    public class PepXMLWriter : EventNotifier, IDisposable
     {
         // Ignore Spelling: href, stylesheet, xmlns, xsi, xsl, yyyy-MM-ddTHH:mm:ss
         // Ignore Spelling: aminoacid, Da, fval, Inetpub, massd, massdiff, nmc, ntt, peptideprophet, tryptic
         // Ignore Spelling: bscore, deltacn, deltacnstar, hyperscore, msgfspecprob, sprank, spscore, xcorr, yscore
 
+        /// <summary>
+        /// Name of the search_hit parameter used for each protein-relative modification site
+        /// </summary>
+        public const string PROTEIN_MOD_SITE_PARAMETER_NAME = "protein_mod_site";
+
+        /// <summary>
+        /// Activation methods supported by the PepXML format
+        /// </summary>
+        public enum ActivationMethods : byte
+        {
+            /// <summary>
+            /// Unknown or unsupported collision mode; the activation_method attribute is not written
+            /// </summary>
+            Unknown = 0,
+
+            /// <summary>
+            /// Collision-induced dissociation
+            /// </summary>
+            CID = 1,
+
+            /// <summary>
+            /// Electron transfer dissociation
+            /// </summary>
+            ETD = 2,
+
+            /// <summary>
+            /// Higher-energy collisional dissociation
+            /// </summary>
+            HCD = 3,
+
+            /// <summary>
+            /// ETD followed by CID
+            /// </summary>
+            ETD_CID = 4
+        }
+
+        // Activation method names, indexed by ActivationMethods value
+        private static readonly string[] mActivationMethodNames = { string.Empty, "CID", "ETD", "HCD", "ETD/CID" };
+
         private readonly Options mOptions;
 
         private readonly PeptideMassCalculator mPeptideMassCalculator;
 
         private XmlWriter mXMLWriter;
 
+        private PepXMLValidator mValidator;
+
+        private bool mClosed;
+
         // This dictionary maps PNNL-based score names to pep-xml standard score names
         private Dictionary<string, string> mPNNLScoreNameMap;
 
+        private readonly ScoreSchema mScoreSchema;
+
+        // PepXML score names, indexed by score schema slot number
+        private readonly List<string> mPepXMLScoreNames = new();
+
+        /// <summary>
+        /// Protein-relative modification sites, read from the _ProteinMods.txt file
+        /// </summary>
+        /// <remarks>When defined, the sites of each PSM are written as search_hit parameters</remarks>
+        public ProteinModIndex ProteinModSites { get; set; }
+
         /// <summary>
         /// Search engine parameters, read by PHRPReader
         /// </summary>
         public SearchEngineParameters SearchEngineParams { get; }
 
+        /// <summary>
+        /// Number of pepXML schema violations found when Options.ValidateOutput is true
+        /// </summary>
+        /// <remarks>Updated by CloseDocument</remarks>
+        public int ValidationViolationCount { get; private set; }
+
         /// <summary>
         /// Constructor
         /// </summary>
         /// <param name="outputFilePath">Path to the PepXML file to create</param>
         /// <param name="searchEngineParams">Search engine parameters</param>
+        /// <param name="scoreSchema">Score schema of the cached PSMs</param>
         /// <param name="options"></param>
-        public PepXMLWriter(string outputFilePath, SearchEngineParameters searchEngineParams, Options options)
+        public PepXMLWriter(string outputFilePath, SearchEngineParameters searchEngineParams, ScoreSchema scoreSchema, Options options)
         {
             mOptions = options;
             SearchEngineParams = searchEngineParams;
+            mScoreSchema = scoreSchema;
 
             mPeptideMassCalculator = new PeptideMassCalculator();
             InitializePNNLScoreNameMap();
 
             try
             {
-                InitializePepXMLFile(outputFilePath, options.FastaFilePath);
+                XmlWriter writer;
+
+                if (options.ValidateOutput)
+                {
+                    mValidator = new PepXMLValidator(options.ResourceLimits);
+                    RegisterEvents(mValidator);
+
+                    var writerSettings = GetWriterSettings();
+                    writerSettings.CloseOutput = true;
+
+                    var outputStream = new FileStream(outputFilePath, FileMode.Create, FileAccess.Write, FileShare.Read, options.ResourceLimits.OutputBufferSize);
+                    writer = XmlWriter.Create(mValidator.AttachToStream(outputStream), writerSettings);
+                }
+                else
+                {
+                    var writerSettings = GetWriterSettings();
+                    writerSettings.CloseOutput = true;
+
+                    var outputStream = new FileStream(outputFilePath, FileMode.Create, FileAccess.Write, FileShare.Read, options.ResourceLimits.OutputBufferSize);
+                    writer = XmlWriter.Create(outputStream, writerSettings);
+                }
+
+                InitializePepXMLFile(writer, Path.GetFileName(outputFilePath), options.FastaFilePath);
             }
             catch (Exception ex)
             {
@@ -58,9 +142,31 @@ namespace PeptideListToXML
             }
         }
 
+        /// <summary>
+        /// Constructor that writes the PepXML data to a stream
+        /// </summary>
+        /// <remarks>Used by the micro-benchmarks to write to Stream.Null</remarks>
+        /// <param name="outputStream">Output stream</param>
+        /// <param name="outputFileName">File name to store in the summary_xml attribute</param>
+        /// <param name="searchEngineParams">Search engine parameters</param>
+        /// <param name="scoreSchema">Score schema of the cached PSMs</param>
+        /// <param name="options"></param>
+        internal PepXMLWriter(Stream outputStream, string outputFileName, SearchEngineParameters searchEngineParams, ScoreSchema scoreSchema, Options options)
+        {
+            mOptions = options;
+            SearchEngineParams = searchEngineParams;
+            mScoreSchema = scoreSchema;
+
+            mPeptideMassCalculator = new PeptideMassCalculator();
+            InitializePNNLScoreNameMap();
+
+            InitializePepXMLFile(XmlWriter.Create(outputStream, GetWriterSettings()), outputFileName, options.FastaFilePath);
+        }
+
         /// <summary>
         /// Close the pepXML document
         /// </summary>
+        /// <remarks>If validating the output, waits for validation to finish, then reports any schema violations</remarks>
         public void CloseDocument()
         {
             mXMLWriter.WriteEndElement();                // msms_run_summary
@@ -68,74 +174,130 @@ namespace PeptideListToXML
             mXMLWriter.WriteEndDocument();
             mXMLWriter.Flush();
             mXMLWriter.Close();
+            mClosed = true;
+
+            if (mValidator == null)
+                return;
+
+            ValidationViolationCount = mValidator.Complete() ? 0 : mValidator.ViolationCount;
+            mValidator.Dispose();
+            mValidator = null;
         }
 
-        private bool GetPepXMLCollisionMode(string psmCollisionMode, out string pepXMLCollisionMode)
+        /// <summary>
+        /// Close the pepXML file, if not yet closed
+        /// </summary>
+        /// <remarks>Used when processing is aborted; the document is not completed and validation results are not reported</remarks>
+        public void Dispose()
         {
-            var collisionModeUCase = psmCollisionMode.ToUpper();
+            if (mClosed)
+                return;
+
+            mClosed = true;
+            mXMLWriter?.Close();
+
+            mValidator?.Dispose();
+            mValidator = null;
+        }
+
+        /// <summary>
+        /// Convert a collision mode reported by PHRPReader to a PepXML activation method
+        /// </summary>
+        /// <param name="psmCollisionMode"></param>
+        /// <returns>Activation method, or ActivationMethods.Unknown if not recognized</returns>
+        internal static ActivationMethods GetPepXMLCollisionMode(string psmCollisionMode)
+        {
+            var collisionModeUCase = (psmCollisionMode ?? string.Empty).ToUpper();
             switch (collisionModeUCase)
             {
                 case "CID":
+                    return ActivationMethods.CID;
+
                 case "ETD":
+                    return ActivationMethods.ETD;
+
                 case "HCD":
-                    pepXMLCollisionMode = collisionModeUCase;
-                    break;
+                    return ActivationMethods.HCD;
 
                 case "ETD/CID":
                 case "ETD-CID":
-                    pepXMLCollisionMode = "ETD/CID";
-                    break;
+                    return ActivationMethods.ETD_CID;
 
                 default:
                     if (collisionModeUCase.StartsWith("CID"))
                     {
-                        pepXMLCollisionMode = "CID";
+                        return ActivationMethods.CID;
                     }
-                    else if (collisionModeUCase.StartsWith("HCD"))
-                    {
-                        pepXMLCollisionMode = "HCD";
-                    }
-                    else if (collisionModeUCase.StartsWith("ETD"))
+
+                    if (collisionModeUCase.StartsWith("HCD"))
                     {
-                        pepXMLCollisionMode = "ETD";
+                        return ActivationMethods.HCD;
                     }
-                    else
+
+                    if (collisionModeUCase.StartsWith("ETD"))
                     {
-                        pepXMLCollisionMode = string.Empty;
+                        return ActivationMethods.ETD;
                     }
 
-                    break;
+                    return ActivationMethods.Unknown;
             }
+        }
 
-            return !string.IsNullOrEmpty(pepXMLCollisionMode);
+        /// <summary>
+        /// Get the name of an activation method, as written to the activation_method attribute
+        /// </summary>
+        /// <param name="activationMethod"></param>
+        internal static string GetActivationMethodName(ActivationMethods activationMethod)
+        {
+            return mActivationMethodNames[(int)activationMethod];
         }
 
         /// <summary>
-        /// Initialize a Pep.XML file for writing
+        /// Get the PepXML score name for the given score schema slot
         /// </summary>
-        /// <param name="outputFilePath"></param>
-        /// <param name="fastaFilePath"></param>
-        private void InitializePepXMLFile(string outputFilePath, string fastaFilePath)
+        /// <remarks>Score names are mapped using mPNNLScoreNameMap the first time each slot is written</remarks>
+        /// <param name="slot"></param>
+        private string GetPepXMLScoreName(int slot)
         {
-            if (string.IsNullOrWhiteSpace(fastaFilePath))
+            while (mPepXMLScoreNames.Count <= slot)
             {
-                fastaFilePath = @"C:\Database\Unknown_Database.fasta";
+                var scoreName = mScoreSchema.ScoreNames[mPepXMLScoreNames.Count];
+
+                mPepXMLScoreNames.Add(mPNNLScoreNameMap.TryGetValue(scoreName, out var alternateScoreName) ? alternateScoreName : scoreName);
             }
 
-            var outputFile = new FileInfo(outputFilePath);
-            var writerSettings = new XmlWriterSettings
+            return mPepXMLScoreNames[slot];
+        }
+
+        private static XmlWriterSettings GetWriterSettings()
+        {
+            return new XmlWriterSettings
             {
                 Indent = true,
                 OmitXmlDeclaration = false,
                 NewLineOnAttributes = false,
                 Encoding = Encoding.ASCII
             };
+        }
+
+        /// <summary>
+        /// Initialize a Pep.XML file for writing
+        /// </summary>
+        /// <param name="writer"></param>
+        /// <param name="outputFileName"></param>
+        /// <param name="fastaFilePath"></param>
+        private void InitializePepXMLFile(XmlWriter writer, string outputFileName, string fastaFilePath)
+        {
+            if (string.IsNullOrWhiteSpace(fastaFilePath))
+            {
+                fastaFilePath = @"C:\Database\Unknown_Database.fasta";
+            }
 
-            mXMLWriter = XmlWriter.Create(outputFilePath, writerSettings);
+            mXMLWriter = writer;
 
             mXMLWriter.WriteStartDocument();
             mXMLWriter.WriteProcessingInstruction("xml-stylesheet", "type=\"text/xsl\" href=\"pepXML_std.xsl\"");
-            WriteHeaderElements(outputFile);
+            WriteHeaderElements(outputFileName);
             WriteSearchSummary(fastaFilePath);
         }
 
@@ -214,11 +376,11 @@ namespace PeptideListToXML
             mXMLWriter.WriteEndElement();
         }
 
-        private void WriteHeaderElements(FileSystemInfo outputFile)
+        private void WriteHeaderElements(string outputFileName)
         {
             mXMLWriter.WriteStartElement("msms_pipeline_analysis", "http://regis-web.systemsbiology.net/pepXML");
             mXMLWriter.WriteAttributeString("date", DateTime.Now.ToString("yyyy-MM-ddTHH:mm:ss"));
-            mXMLWriter.WriteAttributeString("summary_xml", outputFile.Name);
+            mXMLWriter.WriteAttributeString("summary_xml", outputFileName);
             mXMLWriter.WriteAttributeString("xmlns", "http://regis-web.systemsbiology.net/pepXML");
             mXMLWriter.WriteAttributeString("xmlns", "xsi", null, "http://www.w3.org/2001/XMLSchema-instance");
 
@@ -472,7 +634,7 @@ namespace PeptideListToXML
         /// <param name="spectrum"></param>
         /// <param name="psms"></param>
         /// <param name="seqToProteinMap"></param>
-        public void WriteSpectrum(SpectrumInfo spectrum, List<PSM> psms, SortedList<int, List<ProteinInfo>> seqToProteinMap)
+        public void WriteSpectrum(SpectrumInfo spectrum, List<CachedPSM> psms, SortedList<int, List<ProteinInfo>> seqToProteinMap)
         {
             // The keys in this dictionary are the residue position in the peptide; the values are the total mass (including all mods)
             var modifiedResidues = new Dictionary<int, double>();
@@ -483,20 +645,20 @@ namespace PeptideListToXML
             }
 
             mXMLWriter.WriteStartElement("spectrum_query");
-            mXMLWriter.WriteAttributeString("spectrum", spectrum.SpectrumTitle); // Example: QC_05_2_05Dec05_Doc_0508-08.9427.9427.1
+            mXMLWriter.WriteAttributeString("spectrum", spectrum.GetSpectrumTitle(mOptions.DatasetName)); // Example: QC_05_2_05Dec05_Doc_0508-08.9427.9427.1
             WriteAttribute("start_scan", spectrum.StartScan);
             WriteAttribute("end_scan", spectrum.EndScan);
             WriteAttribute("retention_time_sec", spectrum.ElutionTimeMinutes * 60.0, 2);
 
-            if (GetPepXMLCollisionMode(spectrum.CollisionMode, out var collisionMode))
+            if (spectrum.CollisionMode != ActivationMethods.Unknown)
             {
-                WriteAttribute("activation_method", collisionMode);
+                WriteAttribute("activation_method", mActivationMethodNames[(int)spectrum.CollisionMode]);
             }
 
             WriteAttribute("precursor_neutral_mass", spectrum.PrecursorNeutralMass);
             WriteAttribute("assumed_charge", spectrum.AssumedCharge);
             WriteAttribute("index", spectrum.Index);
-            WriteAttribute("spectrumNativeID", spectrum.NativeID); // Example: controllerType=0 controllerNumber=1 scan=20554
+            WriteAttribute("spectrumNativeID", spectrum.GetNativeID()); // Example: controllerType=0 controllerNumber=1 scan=20554
             mXMLWriter.WriteStartElement("search_result");
 
             var hasMsgfSpecEValue = psms.Any(psmEntry => !string.IsNullOrWhiteSpace(psmEntry.MSGFSpecEValue));
@@ -533,7 +695,7 @@ namespace PeptideListToXML
                 // Could optionally write out protein description
                 // .WriteAttributeString("protein_descr", searchHit.StrProteinDescription)
 
-                WriteAttribute("num_tot_proteins", psmEntry.Proteins.Count);
+                WriteAttribute("num_tot_proteins", psmEntry.ProteinCount);
                 WriteAttribute("num_matched_ions", 0);
                 WriteAttribute("tot_num_ions", 0);
                 WriteAttribute("calc_neutral_pep_mass", psmEntry.PeptideMonoisotopicMass);
@@ -564,9 +726,7 @@ namespace PeptideListToXML
                     proteinInfoAvailable = false;
                 }
 
-                var proteinsWritten = 0;
-
-                // Write out the additional proteins
+                // Write out the additional proteins (CachedPSM limits the proteins to MaxProteinsPerPSM)
                 foreach (var proteinAddnl in psmEntry.Proteins)
                 {
                     if (!proteinAddnl.Equals(psmEntry.ProteinFirst))
@@ -594,12 +754,6 @@ namespace PeptideListToXML
                         WriteAttribute("num_tol_term", numTrypticTermini);
                         mXMLWriter.WriteEndElement();      // alternative_protein
                     }
-
-                    proteinsWritten++;
-                    if (mOptions.MaxProteinsPerPSM > 0 && proteinsWritten >= mOptions.MaxProteinsPerPSM)
-                    {
-                        break;
-                    }
                 }
 
                 if (psmEntry.ModifiedResidues.Count > 0)
@@ -608,16 +762,13 @@ namespace PeptideListToXML
                 }
 
                 // Write out the search scores
-                foreach (var item in psmEntry.AdditionalScores)
+                for (var slot = 0; slot < psmEntry.Scores.Length; slot++)
                 {
-                    if (mPNNLScoreNameMap.TryGetValue(item.Key, out var alternateScoreName))
-                    {
-                        WriteNameValueElement("search_score", alternateScoreName, item.Value);
-                    }
-                    else
-                    {
-                        WriteNameValueElement("search_score", item.Key, item.Value);
-                    }
+                    var scoreText = psmEntry.GetScoreText(slot);
+                    if (scoreText == null)
+                        continue;
+
+                    WriteNameValueElement("search_score", GetPepXMLScoreName(slot), scoreText);
                 }
 
                 if (hasMsgfSpecEValue)
@@ -634,6 +785,17 @@ namespace PeptideListToXML
 
                 WriteNameValueElement("search_score", "AbsMassErrorPPM", Math.Abs(massErrorPPM), 4);
 
+                if (ProteinModSites != null)
+                {
+                    // Example: <parameter name="protein_mod_site" value="PAXI_MOUSE:C108:IodoAcet:15" />
+                    foreach (var site in ProteinModSites.GetSites(psmEntry.ResultID))
+                    {
+                        WriteNameValueElement("parameter", PROTEIN_MOD_SITE_PARAMETER_NAME, string.Concat(
+                            site.ProteinName, ":", site.Residue.ToString(), site.ProteinResidueNumber.ToString(), ":",
+                            site.ModName, ":", site.PeptideResidueNumber.ToString()));
+                    }
+                }
+
                 // Old, unused
                 // WritePeptideProphetUsingMSGF(mXMLWriter, searchHit, iNumTrypticTermini, iNumMissedCleavages)
 
@@ -644,7 +806,7 @@ namespace PeptideListToXML
             mXMLWriter.WriteEndElement();            // spectrum_query
         }
 
-        private void WriteModificationInfo(IDictionary<int, double> modifiedResidues, PSM psmEntry)
+        internal void WriteModificationInfo(IDictionary<int, double> modifiedResidues, CachedPSM psmEntry)
         {
             mXMLWriter.WriteStartElement("modification_info");
             var nTermAddon = 0.0;
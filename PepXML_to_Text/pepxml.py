@@ -5,21 +5,43 @@
 # This library file is used by pepxml2hit_list.py
 #
 # 2018-06-06 mem - Update to Python 3.x and update to support .pepXML files from MSFragger and MSGF+
+# 2026-10-18     - Support .pepXML.gz files and random access to spectra using a byte offset index
+#                - Store parser state in each pepxml_parser instance so that files can be parsed by multiple threads
+#
+# Random access example:
+#   with pepxml.IndexedPepXML('Dataset.pepXML.gz') as reader:
+#       psm = reader.get_spectrum('Dataset.9427.9427.2')
+#       for spectrum_id, psm in reader.iter_scan_range(5000, 5100):
+#           print(spectrum_id, psm['search_hit'][0]['peptide'])
 #
 
+import bisect
+import gzip
+import os
+import re
+import threading
 import xml.sax
 from decimal import Decimal, getcontext
+from xml.sax.saxutils import unescape
 
 class pepxml_parser(xml.sax.ContentHandler):
-    element_array = []
-    is_spectrum_query = False
-    is_search_hit = False
-    PSM = dict()
-    search_hit = dict()
-    spectrum_id = ''
-
     getcontext().prec = 32
 
+    def __init__(self):
+        super().__init__()
+        self.reset()
+
+    def reset(self):
+        """
+        Clear the parsed PSMs so that this parser can be used for another file
+        """
+        self.element_array = []
+        self.is_spectrum_query = False
+        self.is_search_hit = False
+        self.PSM = dict()
+        self.search_hit = dict()
+        self.spectrum_id = ''
+
     def startElement(self,name,attr):
         self.element_array.append(name)
         if( len(self.element_array) == 3 and name == 'spectrum_query' ):
@@ -130,7 +152,259 @@ class pepxml_parser(xml.sax.ContentHandler):
             self.is_search_hit = False
         self.element_array.pop()
     
-def parse_by_filename(filename_pepxml):
+def open_pepxml(filename_pepxml):
+    """
+    Open a .pepXML or .pepXML.gz file for reading, in binary mode
+    """
+    with open(filename_pepxml, 'rb') as f:
+        is_gzip = f.read(2) == GZIP_MAGIC
+
+    if is_gzip:
+        return gzip.open(filename_pepxml, 'rb')
+
+    return open(filename_pepxml, 'rb')
+
+def parse_stream(stream):
+    """
+    Parse pepXML data from a binary stream
+    Returns a dictionary where keys are spectrum titles and values are dictionaries of spectrum info and search hits
+    """
     p = pepxml_parser()
-    xml.sax.parse(filename_pepxml,p)
+    xml.sax.parse(stream,p)
     return p.PSM
+
+def parse_by_filename(filename_pepxml):
+    """
+    Parse a .pepXML or .pepXML.gz file
+    This function is thread-safe, since each call uses its own parser
+    """
+    with open_pepxml(filename_pepxml) as f:
+        return parse_stream(f)
+
+def parse_files(filenames, max_workers=None):
+    """
+    Parse several .pepXML or .pepXML.gz files using a pool of threads
+    Yields (file name, PSM dictionary) as each file is parsed, in the order of filenames
+
+    Threads share the Python interpreter lock, so the speedup is limited;
+    for CPU-bound bulk conversion, use worker processes that each call parse_by_filename
+    """
+    from concurrent.futures import ThreadPoolExecutor
+
+    with ThreadPoolExecutor(max_workers=max_workers) as executor:
+        for filename_pepxml, PSM in zip(filenames, executor.map(parse_by_filename, filenames)):
+            yield filename_pepxml, PSM
+
+class IndexedPepXML:
+    """
+    Random access to the spectra in a .pepXML or .pepXML.gz file
+
+    Uses an index of the byte offset of each spectrum_query element, stored in a tab-delimited file
+    named FileName.pepXML.idx (or FileName.pepXML.gz.idx); only the requested spectrum_query elements are parsed
+
+    If the index file is missing or out of date, the file is scanned to create it (without parsing the XML),
+    then the index is saved if save_index is True
+
+    For gzipped files, offsets are positions in the decompressed data; a forward seek decompresses the skipped data
+    and a backward seek restarts from the beginning of the file, so retrieve spectra in scan order when possible
+
+    Instances can be shared by multiple threads; reads from the file are serialized
+    """
+
+    INDEX_FILE_SUFFIX = '.idx'
+    INDEX_HEADER = 'Spectrum\tStart_Scan\tEnd_Scan\tOffset\tLength'
+
+    SCAN_CHUNK_SIZE = 16 * 1024 * 1024
+
+    def __init__(self, filename_pepxml, save_index=True):
+        self.filename = filename_pepxml
+        self.index_filename = filename_pepxml + self.INDEX_FILE_SUFFIX
+
+        # Keys are spectrum titles; values are tuples of (start scan, end scan, offset, length)
+        self.index = dict()
+
+        if not self._load_index():
+            self._create_index()
+            if save_index:
+                self._save_index()
+
+        # Spectrum titles, sorted by start scan and offset
+        self._titles_by_scan = sorted(self.index.keys(), key=lambda title: (self.index[title][0], self.index[title][2]))
+        self._start_scans = [self.index[title][0] for title in self._titles_by_scan]
+
+        self._file = open_pepxml(filename_pepxml)
+        self._file_lock = threading.Lock()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+    def __contains__(self, spectrum_id):
+        return spectrum_id in self.index
+
+    def __len__(self):
+        return len(self.index)
+
+    def close(self):
+        with self._file_lock:
+            if self._file is not None:
+                self._file.close()
+                self._file = None
+
+    def get_spectrum(self, spectrum_id):
+        """
+        Parse the spectrum_query element for the given spectrum title, e.g. QC_05_2_05Dec05_Doc_0508-08.9427.9427.1
+        Returns a dictionary with the same keys as the values returned by parse_by_filename, or None if not found
+        """
+        entry = self.index.get(spectrum_id)
+        if entry is None:
+            return None
+
+        return self._parse_spectrum_query(spectrum_id, entry[2], entry[3])
+
+    def iter_scan_range(self, start_scan, end_scan):
+        """
+        Yield (spectrum title, PSM dictionary) for each spectrum with a start scan between start_scan and end_scan (inclusive)
+        """
+        first = bisect.bisect_left(self._start_scans, start_scan)
+
+        for title in self._titles_by_scan[first:]:
+            entry = self.index[title]
+            if entry[0] > end_scan:
+                break
+
+            yield title, self._parse_spectrum_query(title, entry[2], entry[3])
+
+    def spectrum_ids(self):
+        """
+        Spectrum titles, in scan order
+        """
+        return list(self._titles_by_scan)
+
+    def _parse_spectrum_query(self, spectrum_id, offset, length):
+        with self._file_lock:
+            self._file.seek(offset)
+            block = self._file.read(length)
+
+        # pepxml_parser expects spectrum_query elements to be nested two levels below the root element
+        p = pepxml_parser()
+        xml.sax.parseString(b'<msms_pipeline_analysis><msms_run_summary>' + block + b'</msms_run_summary></msms_pipeline_analysis>', p)
+
+        return p.PSM.get(spectrum_id)
+
+    def _get_source_file_info(self):
+        stats = os.stat(self.filename)
+        return 'source_size=%d\tsource_mtime=%d' % (stats.st_size, int(stats.st_mtime))
+
+    def _load_index(self):
+        """
+        Load the index file, if it exists and matches the size and modification time of the pepXML file
+        """
+        if not os.path.exists(self.index_filename):
+            return False
+
+        with open(self.index_filename, 'r') as f:
+            if f.readline().rstrip('\n') != '# ' + self._get_source_file_info():
+                return False
+
+            if f.readline().rstrip('\n') != self.INDEX_HEADER:
+                return False
+
+            for line in f:
+                title, start_scan, end_scan, offset, length = line.rstrip('\n').split('\t')
+                self.index[title] = (int(start_scan), int(end_scan), int(offset), int(length))
+
+        return True
+
+    def _save_index(self):
+        try:
+            with open(self.index_filename, 'w') as f:
+                f.write('# %s\n' % self._get_source_file_info())
+                f.write('%s\n' % self.INDEX_HEADER)
+                for title, entry in self.index.items():
+                    f.write('%s\t%d\t%d\t%d\t%d\n' % (title, entry[0], entry[1], entry[2], entry[3]))
+        except OSError as ex:
+            print('Unable to save the pepXML index file %s: %s' % (self.index_filename, ex))
+
+    def _create_index(self):
+        """
+        Find the byte offset of each spectrum_query element, reading the file in chunks
+        """
+        self.index.clear()
+
+        with open_pepxml(self.filename) as f:
+            for title, start_scan, end_scan, offset, length in _scan_spectrum_queries(f, self.SCAN_CHUNK_SIZE):
+                if title in self.index:
+                    print("Duplicate PSM : %s"%title)
+                    continue
+
+                self.index[title] = (start_scan, end_scan, offset, length)
+
+GZIP_MAGIC = b'\x1f\x8b'
+
+SPECTRUM_QUERY_START = b'<spectrum_query '
+SPECTRUM_QUERY_END = b'</spectrum_query>'
+
+ATTRIBUTE_PATTERN = re.compile(rb'([\w:]+)\s*=\s*"([^"]*)"')
+
+def _scan_spectrum_queries(stream, chunk_size):
+    """
+    Yield (spectrum title, start scan, end scan, offset, length) for each spectrum_query element in the stream
+    """
+    buffer = b''
+    buffer_offset = 0
+
+    # Attributes and offset of the spectrum_query whose end tag has not yet been found
+    pending = None
+
+    while True:
+        chunk = stream.read(chunk_size)
+        buffer += chunk
+        position = 0
+
+        while True:
+            if pending is None:
+                start = buffer.find(SPECTRUM_QUERY_START, position)
+                if start < 0:
+                    keep_from = max(position, len(buffer) - len(SPECTRUM_QUERY_START))
+                    break
+
+                tag_end = buffer.find(b'>', start)
+                if tag_end < 0:
+                    keep_from = start
+                    break
+
+                attributes = dict(ATTRIBUTE_PATTERN.findall(buffer[start:tag_end]))
+                pending = (attributes, buffer_offset + start)
+                position = tag_end + 1
+
+                if buffer[tag_end - 1:tag_end] == b'/':
+                    # Empty element
+                    end = position
+                else:
+                    continue
+            else:
+                end = buffer.find(SPECTRUM_QUERY_END, position)
+                if end < 0:
+                    keep_from = max(position, len(buffer) - len(SPECTRUM_QUERY_END))
+                    break
+
+                end += len(SPECTRUM_QUERY_END)
+                position = end
+
+            attributes, offset = pending
+            pending = None
+
+            yield (unescape(attributes[b'spectrum'].decode('utf-8'), {'&quot;': '"'}),
+                   int(attributes.get(b'start_scan', b'0')),
+                   int(attributes.get(b'end_scan', b'0')),
+                   offset,
+                   buffer_offset + end - offset)
+
+        if not chunk:
+            break
+
+        buffer_offset += keep_from
+        buffer = buffer[keep_from:]
@@ -5,124 +5,245 @@
 # Modified by Matthew Monroe in September 2012 to extract additional columns
 #
 # 2018-06-06 mem - Update to Python 3.x and update to support .pepXML files from MSFragger and MSGF+
+# 2026-10-18     - Support processing a directory or wildcard match of .pepXML files using a pool of worker processes
 #
 
+import argparse
+import glob
+import multiprocessing
 import os
 import sys
 import re
+import time
 
 # Import pepxml.py, which should be in the same directory as pepxml2hit_list.py
 import pepxml
 
-usage_mesg = 'Usage: pepxml2hit_list.py FileToProcess.pepXML'
-
-if( len(sys.argv) != 2 ):
-    print(usage_mesg)
-    sys.exit(1)
-
-filename_pepxml = sys.argv[1]
-if( not os.access(filename_pepxml,os.R_OK) ):
-    print("%s is not accessible."%filename_pepxml)
-    print(usage_mesg)
-    sys.exit(1)
-
-print('Reading %s'%(filename_pepxml))
-
-PSM = pepxml.parse_by_filename(filename_pepxml)
-
-filename_out = filename_pepxml
-filename_out = re.sub('.pepxml$','',filename_out)
-filename_out += '.txt'
-
-print('Creating %s'%(filename_pepxml))
-sys.stderr.write("Write %s ... \n"%filename_out)
-f_out = open(filename_out,'w')
-
-f_out.write("%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s" % ("Spectrum_ID", "Charge", "NeutralMass", "Peptide", "Protein", "MissedCleavages", "Xcorr", "DeltaCn"))
-f_out.write("\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s" % ("DeltaCn2", "RankXc", "XcRatio", "Ions_Observed", "Ions_Matched", "Ions_Expected", "NumTrypticEnds", "MSGF_SpecProb", "EValue"))
-f_out.write("\t%s\t%s\t%s\n" % ("Scan_Scan", "End_Scan", "RetentionTime_Sec"))
-
-intLinesWritten = 0
-for spectrum_id in PSM.keys():
-    charge = PSM[spectrum_id]['charge']
-    neutral_mass = PSM[spectrum_id]['neutral_mass']
-
-    start_scan = PSM[spectrum_id]['start_scan']
-    end_scan = PSM[spectrum_id]['end_scan']
-    retention_time_sec = PSM[spectrum_id]['retention_time_sec']
-
-    best_peptide = ''
-    best_protein = ''
-    best_xcorr = 0
-    missed_cleavages = 0
-    best_deltacnStar = 0
-    best_RankXc = 0
-    best_XcRatio = 0
-    best_Ions_Observed = 0
-    best_Ions_Matched = 0
-    best_Ions_Expected = 0
-    best_NumTrypticEnds = 0
-    best_msgfspecprob = 1
-    best_expect = 1
-    StoreHit = 0
-    HitsParsed = 0
-        
-    for tmp_hit in PSM[spectrum_id]['search_hit']:
-        msgfspecprob = tmp_hit.setdefault('msgfspecprob',1)
-        expectScore = tmp_hit.setdefault('expect',1)
-        xcorr = tmp_hit.setdefault('xcorr',0)
-    
+usage_mesg = 'Usage: pepxml2hit_list.py FileToProcess.pepXML [FileOrDirectory2 ...] [--processes N]'
+
+
+def convert_file(filename_pepxml, show_progress=True):
+    """
+    Convert a .pepXML file to a tab-delimited text file with the best hit for each spectrum
+    Returns a tuple of (output file path, spectrum count, lines written)
+    """
+    if show_progress:
+        print('Reading %s'%(filename_pepxml))
+
+    PSM = pepxml.parse_by_filename(filename_pepxml)
+
+    filename_out = filename_pepxml
+    filename_out = re.sub('.gz$','',filename_out)
+    filename_out = re.sub('.pepxml$','',filename_out)
+    filename_out += '.txt'
+
+    if show_progress:
+        print('Creating %s'%(filename_pepxml))
+        sys.stderr.write("Write %s ... \n"%filename_out)
+
+    f_out = open(filename_out,'w')
+
+    f_out.write("%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s" % ("Spectrum_ID", "Charge", "NeutralMass", "Peptide", "Protein", "MissedCleavages", "Xcorr", "DeltaCn"))
+    f_out.write("\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s" % ("DeltaCn2", "RankXc", "XcRatio", "Ions_Observed", "Ions_Matched", "Ions_Expected", "NumTrypticEnds", "MSGF_SpecProb", "EValue"))
+    f_out.write("\t%s\t%s\t%s\n" % ("Scan_Scan", "End_Scan", "RetentionTime_Sec"))
+
+    intLinesWritten = 0
+    for spectrum_id in PSM.keys():
+        charge = PSM[spectrum_id]['charge']
+        neutral_mass = PSM[spectrum_id]['neutral_mass']
+
+        start_scan = PSM[spectrum_id]['start_scan']
+        end_scan = PSM[spectrum_id]['end_scan']
+        retention_time_sec = PSM[spectrum_id]['retention_time_sec']
+
+        best_peptide = ''
+        best_protein = ''
+        best_xcorr = 0
+        missed_cleavages = 0
+        best_deltacnStar = 0
+        best_RankXc = 0
+        best_XcRatio = 0
+        best_Ions_Observed = 0
+        best_Ions_Matched = 0
+        best_Ions_Expected = 0
+        best_NumTrypticEnds = 0
+        best_msgfspecprob = 1
+        best_expect = 1
         StoreHit = 0
-        if (HitsParsed == 0):
-            StoreHit = 1
-            best_msgfspecprob = msgfspecprob
-            best_expect = expectScore
-            best_xcorr = xcorr
-                 
-        elif (best_msgfspecprob < 1):
-            if (msgfspecprob < best_msgfspecprob):
-                StoreHit = 1
-        elif (best_expect < 1):
-            if (expectScore < best_expect):
-                StoreHit = 1
-        elif (best_xcorr > 0):
-            if (xcorr > best_xcorr):
+        HitsParsed = 0
+
+        for tmp_hit in PSM[spectrum_id]['search_hit']:
+            msgfspecprob = tmp_hit.setdefault('msgfspecprob',1)
+            expectScore = tmp_hit.setdefault('expect',1)
+            xcorr = tmp_hit.setdefault('xcorr',0)
+
+            StoreHit = 0
+            if (HitsParsed == 0):
                 StoreHit = 1
+                best_msgfspecprob = msgfspecprob
+                best_expect = expectScore
+                best_xcorr = xcorr
+
+            elif (best_msgfspecprob < 1):
+                if (msgfspecprob < best_msgfspecprob):
+                    StoreHit = 1
+            elif (best_expect < 1):
+                if (expectScore < best_expect):
+                    StoreHit = 1
+            elif (best_xcorr > 0):
+                if (xcorr > best_xcorr):
+                    StoreHit = 1
+
+            if( StoreHit == 1 ):
+                best_xcorr          = tmp_hit.setdefault('xcorr',0)
+                best_peptide        = tmp_hit['peptide']
+                best_protein        = tmp_hit['protein']
+                best_deltacn        = tmp_hit.setdefault('deltacn',0)
+                missed_cleavages    = tmp_hit['missed_cleavages']
+                best_deltacnStar    = tmp_hit.setdefault('deltacnstar',0)
+                best_RankXc         = tmp_hit.setdefault('RankXc',0)
+                best_XcRatio        = tmp_hit.setdefault('XcRatio',0)
+                best_Ions_Observed  = tmp_hit.setdefault('Ions_Observed',0)
+                best_Ions_Matched   = tmp_hit.setdefault('Ions_Matched',0)
+                best_Ions_Expected  = tmp_hit.setdefault('Ions_Expected',0)
+                best_NumTrypticEnds = tmp_hit.setdefault('NumTrypticEnds',0)
+                best_msgfspecprob   = tmp_hit.setdefault('msgfspecprob',1)
+                best_expect         = tmp_hit.setdefault('expect',1)
+
+            HitsParsed += 1
+        # end for loop over spectrum hits
+
+        if (HitsParsed > 0):
+            f_out.write("%s\t%s\t%f\t%s\t%s\t%d\t%f\t%f" % (spectrum_id, charge, neutral_mass, best_peptide, best_protein, missed_cleavages, best_xcorr, best_deltacn))
+
+            f_out.write("\t%f\t%s\t%f\t%s\t%s\t%s\t%s\t%s\t%s" % (best_deltacnStar, best_RankXc, best_XcRatio, best_Ions_Observed, best_Ions_Matched, best_Ions_Expected, best_NumTrypticEnds, best_msgfspecprob, best_expect))
+
+            f_out.write("\t%s\t%s\t%f\n" % (start_scan, end_scan, retention_time_sec))
+
+            intLinesWritten += 1
+
+            if (show_progress and intLinesWritten % 10000 == 0):
+                print('%i / %i' % (intLinesWritten,len(PSM.keys())))
+        # end if
+
+    # end for loop over PSMs
+
+    f_out.close()
+
+    return (filename_out, len(PSM), intLinesWritten)
+
+
+def convert_file_worker(filename_pepxml):
+    """
+    Convert a file in a worker process
+    Returns a tuple of (input file path, output file path, lines written, seconds elapsed, error message)
+    """
+    start_time = time.time()
+    try:
+        filename_out, spectra, lines_written = convert_file(filename_pepxml, False)
+        return (filename_pepxml, filename_out, lines_written, time.time() - start_time, '')
+    except Exception as ex:
+        return (filename_pepxml, '', 0, time.time() - start_time, '%s: %s' % (type(ex).__name__, ex))
+
+
+def find_input_files(paths):
+    """
+    Expand the command line arguments into a list of .pepXML files
+    Directories are searched (non-recursively) for .pepXML and .pepXML.gz files; wildcards are expanded since the Windows shell does not do so
+    """
+    input_files = []
+    for path in paths:
+        if os.path.isdir(path):
+            matches = [os.path.join(path, name) for name in sorted(os.listdir(path)) if name.lower().endswith(('.pepxml', '.pepxml.gz'))]
+        elif glob.has_magic(path):
+            matches = sorted(glob.glob(path))
+        else:
+            matches = [path]
+
+        for filename_pepxml in matches:
+            if filename_pepxml not in input_files:
+                input_files.append(filename_pepxml)
+
+    return input_files
+
+
+def process_files(input_files, processes):
+    """
+    Convert the files using a pool of worker processes, showing progress as each file finishes
+    Returns the number of files that could not be converted
+    """
+    print('Converting %i files using %i processes' % (len(input_files), processes))
+
+    start_time = time.time()
+    files_done = 0
+    total_lines = 0
+    failed_files = []
+
+    with multiprocessing.Pool(processes) as pool:
+        for filename_pepxml, filename_out, lines_written, seconds, error_message in pool.imap_unordered(convert_file_worker, input_files):
+            files_done += 1
+            if error_message:
+                failed_files.append(filename_pepxml)
+                print('[%i/%i] Error converting %s: %s' % (files_done, len(input_files), filename_pepxml, error_message))
+                continue
+
+            total_lines += lines_written
+            print('[%i/%i] %s: %i PSMs written to %s (%.1f seconds)' % (files_done, len(input_files), filename_pepxml, lines_written, os.path.basename(filename_out), seconds))
+
+    elapsed = time.time() - start_time
+
+    print('')
+    print('Converted %i of %i files; %i PSMs written in %.1f seconds' % (len(input_files) - len(failed_files), len(input_files), total_lines, elapsed))
+
+    if failed_files:
+        print('Files that could not be converted:')
+        for filename_pepxml in failed_files:
+            print('  %s' % filename_pepxml)
+
+    return len(failed_files)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Convert .pepXML files to tab-delimited text files with the best hit for each spectrum. ' +
+                    'When multiple files are specified, they are converted in parallel.')
+
+    parser.add_argument('paths', nargs='+',
+                        help='.pepXML file, directory with .pepXML files, or wildcard match (e.g. *.pepXML)')
+
+    parser.add_argument('--processes', '-p', type=int, default=0,
+                        help='Number of worker processes to use; defaults to the number of cores')
+
+    args = parser.parse_args()
+
+    input_files = find_input_files(args.paths)
+
+    if len(input_files) == 0:
+        print('No .pepXML files were found')
+        print(usage_mesg)
+        sys.exit(1)
+
+    inaccessible_files = [filename_pepxml for filename_pepxml in input_files if not os.access(filename_pepxml, os.R_OK)]
+    for filename_pepxml in inaccessible_files:
+        print("%s is not accessible."%filename_pepxml)
+
+    if inaccessible_files:
+        print(usage_mesg)
+        sys.exit(1)
+
+    if len(input_files) == 1:
+        convert_file(input_files[0])
+        print ("Done")
+        return
+
+    processes = args.processes if args.processes > 0 else (os.cpu_count() or 1)
+    processes = min(processes, len(input_files))
+
+    if process_files(input_files, processes) > 0:
+        sys.exit(1)
+
+    print ("Done")
+
 
-        if( StoreHit == 1 ):
-            best_xcorr          = tmp_hit.setdefault('xcorr',0)
-            best_peptide        = tmp_hit['peptide']
-            best_protein        = tmp_hit['protein']
-            best_deltacn        = tmp_hit.setdefault('deltacn',0)
-            missed_cleavages    = tmp_hit['missed_cleavages']
-            best_deltacnStar    = tmp_hit.setdefault('deltacnstar',0)
-            best_RankXc         = tmp_hit.setdefault('RankXc',0)
-            best_XcRatio        = tmp_hit.setdefault('XcRatio',0)
-            best_Ions_Observed  = tmp_hit.setdefault('Ions_Observed',0)
-            best_Ions_Matched   = tmp_hit.setdefault('Ions_Matched',0)
-            best_Ions_Expected  = tmp_hit.setdefault('Ions_Expected',0)
-            best_NumTrypticEnds = tmp_hit.setdefault('NumTrypticEnds',0)
-            best_msgfspecprob   = tmp_hit.setdefault('msgfspecprob',1)
-            best_expect         = tmp_hit.setdefault('expect',1)
-       
-        HitsParsed += 1
-    # end for loop over spectrum hits
-    
-    if (HitsParsed > 0):
-        f_out.write("%s\t%s\t%f\t%s\t%s\t%d\t%f\t%f" % (spectrum_id, charge, neutral_mass, best_peptide, best_protein, missed_cleavages, best_xcorr, best_deltacn))
-
-        f_out.write("\t%f\t%s\t%f\t%s\t%s\t%s\t%s\t%s\t%s" % (best_deltacnStar, best_RankXc, best_XcRatio, best_Ions_Observed, best_Ions_Matched, best_Ions_Expected, best_NumTrypticEnds, best_msgfspecprob, best_expect))
-
-        f_out.write("\t%s\t%s\t%f\n" % (start_scan, end_scan, retention_time_sec))
-    
-        intLinesWritten += 1
-    
-        if (intLinesWritten % 10000 == 0):
-            print('%i / %i' % (intLinesWritten,len(PSM.keys())))
-    # end if
-
-# end for loop over PSMs
-
-f_out.close()
-
-print ("Done")
+if __name__ == '__main__':
+    main()
@@ -2,6 +2,7 @@
 using System.Collections.Generic;
 using System.IO;
 using System.Linq;
+using System.Threading;
 using PHRPReader;
 using PHRPReader.Data;
 using PHRPReader.Reader;
@@ -37,8 +38,26 @@ namespace PeptideListToXML
         /// </summary>
         public const int DEFAULT_MAX_PROTEINS_PER_PSM = 100;
 
+        /// <summary>
+        /// Extension of the JSON Lines file created when OutputFormat is JsonLines
+        /// </summary>
+        public const string JSON_LINES_FILE_EXTENSION = ".jsonl";
+
+        /// <summary>
+        /// Extension of the mzTab file created when CreateMzTabFile is true
+        /// </summary>
+        public const string MZTAB_FILE_EXTENSION = ".mzTab";
+
+        /// <summary>
+        /// Suffix for the performance stats file created when SavePerformanceStats is true
+        /// </summary>
+        public const string PERFORMANCE_STATS_FILE_SUFFIX = "_PerfStats.json";
+
         private const int PREVIEW_PAD_WIDTH = 22;
 
+        // Number of PSMs cached between comparisons of the memory usage to the memory budget
+        private const int MEMORY_CHECK_INTERVAL = 10000;
+
         /// <summary>
         /// Error codes specialized for this class
         /// </summary>
@@ -79,6 +98,21 @@ namespace PeptideListToXML
             /// </summary>
             ScanStatsFileNotFound = 6,
 
+            /// <summary>
+            /// Processing did not finish within the per-dataset timeout
+            /// </summary>
+            ProcessingTimedOut = 7,
+
+            /// <summary>
+            /// Processing was cancelled by the caller
+            /// </summary>
+            ProcessingCancelled = 8,
+
+            /// <summary>
+            /// The cached PSMs used more than the memory budget, even after only retaining the top hit for each scan
+            /// </summary>
+            MemoryBudgetExceeded = 9,
+
             /// <summary>
             /// Unspecified error
             /// </summary>
@@ -90,23 +124,34 @@ namespace PeptideListToXML
         private ReaderFactory mPHRPReader;
         private PepXMLWriter mXMLWriter;
 
+        // Input files whose processing was aborted because the per-dataset timeout elapsed
+        private readonly List<string> mTimedOutInputFiles = new();
+
+        // Protein-relative modification sites; null unless mOptions.IncludeProteinModPositions is true and the _ProteinMods.txt file was loaded
+        private ProteinModIndex mProteinModIndex;
+
         private SortedList<int, List<ProteinInfo>> mSeqToProteinMapCached;
 
         // This dictionary tracks the PSMs (hits) for each spectrum
-        // The key is the Spectrum Key string (dataset, start scan, end scan, charge)
-        private Dictionary<string, List<PSM>> mPSMsBySpectrumKey;
+        // The key is the spectrum's start scan, end scan, and charge
+        private Dictionary<SpectrumKey, List<CachedPSM>> mPSMsBySpectrumKey;
+
+        // Score names reported by the search engine, with the slot number used to store each score
+        private ScoreSchema mScoreSchema;
 
         // This dictionary tracks the spectrum info
-        // The key is the Spectrum Key string (dataset, start scan, end scan, charge)
-        private Dictionary<string, SpectrumInfo> mSpectrumInfo;
+        // The key is the spectrum's start scan, end scan, and charge
+        private Dictionary<SpectrumKey, SpectrumInfo> mSpectrumInfo;
 
         /// <summary>
         /// Local error code
         /// </summary>
         public PeptideListToXMLErrorCodes LocalErrorCode { get; private set; }
 
-        // Possible future property if support for mzIdentML is added
-        // public PeptideListOutputFormat OutputFormat { get; set; }
+        /// <summary>
+        /// Input files that were not converted because processing did not finish within Options.DatasetTimeoutMinutes
+        /// </summary>
+        public IReadOnlyList<string> TimedOutInputFiles => mTimedOutInputFiles;
 
         /// <summary>
         /// Create a PepXML file using the peptides in file inputFilePath
@@ -116,23 +161,94 @@ namespace PeptideListToXML
         /// <returns>True if successful, false if an error</returns>
         public bool ConvertPHRPDataToXML(string inputFilePath, string outputDirectoryPath)
         {
-            var success = CachePHRPData(inputFilePath, out var searchEngineParams);
+            return ConvertPHRPDataToXML(inputFilePath, outputDirectoryPath, CancellationToken.None);
+        }
 
-            if (!success)
-                return false;
+        /// <summary>
+        /// Create a PepXML file using the peptides in file inputFilePath
+        /// </summary>
+        /// <remarks>
+        /// If Options.DatasetTimeoutMinutes is positive, processing is also cancelled when the timeout elapses;
+        /// when cancelled, the partially written output file is deleted
+        /// </remarks>
+        /// <param name="inputFilePath"></param>
+        /// <param name="outputDirectoryPath"></param>
+        /// <param name="cancellationToken">Cancellation token, checked while reading PSMs, while checking the modifications of the cached PSMs, and while writing spectra</param>
+        /// <returns>True if successful, false if an error or cancelled</returns>
+        public bool ConvertPHRPDataToXML(string inputFilePath, string outputDirectoryPath, CancellationToken cancellationToken)
+        {
+            using var timeoutSource = CancellationTokenSource.CreateLinkedTokenSource(cancellationToken);
 
-            if (mOptions.PreviewMode)
+            if (mOptions.DatasetTimeoutMinutes > 0 && !mOptions.PreviewMode)
             {
-                PreviewRequiredFiles(inputFilePath, mOptions);
-                return true;
+                timeoutSource.CancelAfter(TimeSpan.FromMinutes(mOptions.DatasetTimeoutMinutes));
             }
 
-            var outputFilePath = Path.Combine(outputDirectoryPath, mOptions.DatasetName + ".pepXML");
+            var outputFilePath = string.Empty;
+
+            try
+            {
+                var performanceStats = mOptions.SavePerformanceStats && !mOptions.PreviewMode ? new PerformanceStats(mOptions.DatasetName) : null;
+                performanceStats?.StartPhase();
+
+                var success = CachePHRPData(inputFilePath, timeoutSource.Token, out var searchEngineParams);
+
+                if (!success)
+                    return false;
+
+                if (mOptions.PreviewMode)
+                {
+                    PreviewRequiredFiles(inputFilePath, mOptions);
+                    return true;
+                }
+
+                performanceStats?.EndPhase("CachePHRPData", GetCachedPSMCount(), new FileInfo(inputFilePath).Length);
+
+                var outputFileExtension = mOptions.OutputFormat == Options.PeptideListOutputFormat.JsonLines ? JSON_LINES_FILE_EXTENSION : ".pepXML";
+                outputFilePath = Path.Combine(outputDirectoryPath, mOptions.DatasetName + outputFileExtension);
+
+                performanceStats?.StartPhase();
+
+                success = WriteCachedData(outputFilePath, searchEngineParams, performanceStats, timeoutSource.Token, out var bytesWritten);
+
+                if (!success || performanceStats == null)
+                    return success;
+
+                performanceStats.EndPhase("WriteCachedData", GetCachedPSMCount(), bytesWritten);
+                performanceStats.DatasetName = mOptions.DatasetName;
+
+                return SavePerformanceStats(performanceStats, Path.Combine(outputDirectoryPath, mOptions.DatasetName + PERFORMANCE_STATS_FILE_SUFFIX));
+            }
+            catch (OperationCanceledException)
+            {
+                OperationComplete();
+                OnStatusEvent(string.Empty);
+
+                if (cancellationToken.IsCancellationRequested)
+                {
+                    ShowErrorMessage("Processing cancelled for " + Path.GetFileName(inputFilePath));
+                    SetLocalErrorCode(PeptideListToXMLErrorCodes.ProcessingCancelled);
+                }
+                else
+                {
+                    ShowErrorMessage(string.Format("Processing of {0} did not finish within {1} minutes; skipping this dataset",
+                        Path.GetFileName(inputFilePath), mOptions.DatasetTimeoutMinutes));
+
+                    SetLocalErrorCode(PeptideListToXMLErrorCodes.ProcessingTimedOut);
+                    mTimedOutInputFiles.Add(inputFilePath);
+                }
+
+                DeletePartialOutputFile(outputFilePath);
 
-            return WriteCachedData(outputFilePath, searchEngineParams);
+                // Release the cached PSMs now, rather than when the next dataset is read
+                mPSMsBySpectrumKey?.Clear();
+                mSpectrumInfo?.Clear();
+
+                return false;
+            }
         }
 
-        private bool CachePHRPData(string inputFilePath, out SearchEngineParameters searchEngineParams)
+        private bool CachePHRPData(string inputFilePath, CancellationToken cancellationToken, out SearchEngineParameters searchEngineParams)
         {
             try
             {
@@ -147,7 +263,7 @@ namespace PeptideListToXML
 
                 if (mPSMsBySpectrumKey is null)
                 {
-                    mPSMsBySpectrumKey = new Dictionary<string, List<PSM>>();
+                    mPSMsBySpectrumKey = new Dictionary<SpectrumKey, List<CachedPSM>>();
                 }
                 else
                 {
@@ -156,23 +272,36 @@ namespace PeptideListToXML
 
                 if (mSpectrumInfo is null)
                 {
-                    mSpectrumInfo = new Dictionary<string, SpectrumInfo>();
+                    mSpectrumInfo = new Dictionary<SpectrumKey, SpectrumInfo>();
                 }
                 else
                 {
                     mSpectrumInfo.Clear();
                 }
 
+                mScoreSchema = new ScoreSchema();
+
+                // Keys in this dictionary are collision modes reported by PHRPReader; values are the equivalent PepXML activation method
+                var activationMethods = new Dictionary<string, PepXMLWriter.ActivationMethods>();
+
                 // Keys in this dictionary are scan numbers
                 var bestPSMByScan = new Dictionary<int, PSMInfo>();
 
                 var peptidesStored = 0;
+
+                // When running in a container with a memory limit and the cached PSMs use more than the memory budget,
+                // only the top hit for each scan is retained from then on, as with /TopHitOnly
+                var topHitOnly = mOptions.TopHitOnly;
+                var memoryBudgetExceeded = false;
+
                 var startupOptions = new StartupOptions
                 {
                     LoadModsAndSeqInfo = mOptions.LoadModsAndSeqInfo,
                     LoadMSGFResults = mOptions.LoadMSGFResults,
                     LoadScanStatsData = mOptions.LoadScanStats,
-                    MaxProteinsPerPSM = mOptions.MaxProteinsPerPSM
+
+                    // Load all of the proteins for each PSM so that the total protein count is known; CachedPSM applies MaxProteinsPerPSM
+                    MaxProteinsPerPSM = 0
                 };
 
                 mPHRPReader = new ReaderFactory(inputFilePath, startupOptions);
@@ -213,7 +342,7 @@ namespace PeptideListToXML
                 // Report any warnings cached during instantiation of mPHRPReader
                 foreach (var message in mPHRPReader.WarningMessages.Distinct())
                 {
-                    Console.WriteLine();
+                    OnStatusEvent(string.Empty);
                     ShowWarning(message);
                     if (message.Contains("SeqInfo file not found"))
                     {
@@ -245,11 +374,13 @@ namespace PeptideListToXML
                 }
 
                 if (mPHRPReader.WarningMessages.Count > 0)
-                    Console.WriteLine();
+                    OnStatusEvent(string.Empty);
 
                 mPHRPReader.ClearErrors();
                 mPHRPReader.ClearWarnings();
 
+                mProteinModIndex = mOptions.IncludeProteinModPositions ? LoadProteinModIndex(inputFilePath) : null;
+
                 if (string.IsNullOrEmpty(mOptions.DatasetName))
                 {
                     mOptions.DatasetName = "Unknown";
@@ -258,26 +389,13 @@ namespace PeptideListToXML
 
                 while (mPHRPReader.MoveNext())
                 {
-                    var currentPSM = mPHRPReader.CurrentPSM;
-
-                    var skipPeptide = mOptions.SkipXPeptides && currentPSM.PeptideCleanSequence.Contains("X");
+                    // Check for cancellation once per PSM read; the modified residues of the cached PSMs are
+                    // reconciled with the search engine parameters later, in LoadSearchEngineParameters
+                    cancellationToken.ThrowIfCancellationRequested();
 
-                    if (!skipPeptide && mOptions.PSMsPerSpectrumToStore > 0 && currentPSM.ScoreRank > mOptions.PSMsPerSpectrumToStore)
-                    {
-                        skipPeptide = true;
-                    }
-
-                    if (!skipPeptide && peptidesToFilterOn.Count > 0 && !peptidesToFilterOn.Contains(currentPSM.PeptideCleanSequence))
-                    {
-                        skipPeptide = true;
-                    }
-
-                    if (!skipPeptide && mOptions.ChargeFilterList.Count > 0 && !mOptions.ChargeFilterList.Contains(currentPSM.Charge))
-                    {
-                        skipPeptide = true;
-                    }
+                    var currentPSM = mPHRPReader.CurrentPSM;
 
-                    if (skipPeptide)
+                    if (SkipPSM(currentPSM, peptidesToFilterOn))
                     {
                         continue;
                     }
@@ -286,81 +404,118 @@ namespace PeptideListToXML
                     if (!mSpectrumInfo.ContainsKey(spectrumKey))
                     {
                         // New spectrum; add a new entry to mSpectrumInfo
-                        var spectrumInfo = new SpectrumInfo(spectrumKey)
+                        var collisionMode = currentPSM.CollisionMode ?? string.Empty;
+                        if (!activationMethods.TryGetValue(collisionMode, out var activationMethod))
                         {
-                            StartScan = currentPSM.ScanNumberStart,
-                            EndScan = currentPSM.ScanNumberEnd,
-                            PrecursorNeutralMass = currentPSM.PrecursorNeutralMass,
-                            AssumedCharge = currentPSM.Charge,
-                            ElutionTimeMinutes = currentPSM.ElutionTimeMinutes,
-                            CollisionMode = currentPSM.CollisionMode,
-                            Index = mSpectrumInfo.Count,
-                            NativeID = ConstructNativeID(currentPSM.ScanNumberStart)
-                        };
+                            activationMethod = PepXMLWriter.GetPepXMLCollisionMode(collisionMode);
+                            activationMethods.Add(collisionMode, activationMethod);
+                        }
+
+                        var spectrumInfo = new SpectrumInfo(
+                            currentPSM.ScanNumberStart,
+                            currentPSM.ScanNumberEnd,
+                            currentPSM.PrecursorNeutralMass,
+                            currentPSM.Charge,
+                            currentPSM.ElutionTimeMinutes,
+                            activationMethod,
+                            mSpectrumInfo.Count);
 
                         mSpectrumInfo.Add(spectrumKey, spectrumInfo);
                     }
 
-                    if (mPSMsBySpectrumKey.TryGetValue(spectrumKey, out var psms))
-                    {
-                        psms.Add(currentPSM);
-                    }
-                    else
+                    var cachedPSM = new CachedPSM(currentPSM, mScoreSchema, mOptions.MaxProteinsPerPSM);
+
+                    // Once the memory budget has been exceeded, PSMs are only tracked in bestPSMByScan
+                    if (!memoryBudgetExceeded)
                     {
-                        psms = new List<PSM>
+                        if (mPSMsBySpectrumKey.TryGetValue(spectrumKey, out var psms))
+                        {
+                            psms.Add(cachedPSM);
+                        }
+                        else
                         {
-                            currentPSM
-                        };
+                            psms = new List<CachedPSM>
+                            {
+                                cachedPSM
+                            };
 
-                        mPSMsBySpectrumKey.Add(spectrumKey, psms);
+                            mPSMsBySpectrumKey.Add(spectrumKey, psms);
+                        }
                     }
 
-                    if (mOptions.TopHitOnly)
+                    if (topHitOnly)
                     {
-                        var comparisonPSMInfo = new PSMInfo(spectrumKey, currentPSM);
+                        UpdateBestPSM(bestPSMByScan, spectrumKey, cachedPSM);
+                    }
 
-                        if (bestPSMByScan.TryGetValue(currentPSM.ScanNumberStart, out var bestPSMInfo))
+                    peptidesStored++;
+
+                    if (peptidesStored % MEMORY_CHECK_INTERVAL == 0 && mOptions.ResourceLimits.IsMemoryBudgetExceeded())
+                    {
+                        OnStatusEvent(string.Empty);
+
+                        if (memoryBudgetExceeded)
                         {
-                            if (comparisonPSMInfo.MSGFSpecProb < bestPSMInfo.MSGFSpecProb)
-                            {
-                                // We have found a better scoring peptide for this scan
-                                bestPSMByScan[currentPSM.ScanNumberStart] = comparisonPSMInfo;
-                            }
+                            ShowErrorMessage(string.Format(
+                                "After caching {0:#,##0} PSMs, memory usage exceeds the memory budget of {1:#,##0} MB (75% of the container's memory limit), " +
+                                "even though only the top hit for each scan is being retained",
+                                peptidesStored, mOptions.ResourceLimits.MemoryBudgetBytes / 1024 / 1024));
+
+                            SetLocalErrorCode(PeptideListToXMLErrorCodes.MemoryBudgetExceeded);
+                            searchEngineParams = new SearchEngineParameters(string.Empty);
+                            return false;
                         }
-                        else
+
+                        memoryBudgetExceeded = true;
+                        ShowWarning(string.Format(
+                            "After caching {0:#,##0} PSMs, memory usage exceeds the memory budget of {1:#,##0} MB (75% of the container's memory limit); " +
+                            "only the top hit for each scan (regardless of charge) will be retained, as with /TopHitOnly",
+                            peptidesStored, mOptions.ResourceLimits.MemoryBudgetBytes / 1024 / 1024));
+
+                        if (!topHitOnly)
                         {
-                            bestPSMByScan.Add(currentPSM.ScanNumberStart, comparisonPSMInfo);
+                            topHitOnly = true;
+
+                            foreach (var item in mPSMsBySpectrumKey)
+                            {
+                                foreach (var psm in item.Value)
+                                {
+                                    UpdateBestPSM(bestPSMByScan, item.Key, psm);
+                                }
+                            }
                         }
-                    }
 
-                    peptidesStored++;
+                        // Release the PSMs that are not the top hit, along with the dictionary's buckets; the top hits are added back after all PSMs are read
+                        mPSMsBySpectrumKey = new Dictionary<SpectrumKey, List<CachedPSM>>();
+                    }
 
                     UpdateProgress(mPHRPReader.PercentComplete);
                 }
 
                 OperationComplete();
-                Console.WriteLine();
+                OnStatusEvent(string.Empty);
                 var filterMessage = string.Empty;
                 if (peptidesToFilterOn.Count > 0)
                 {
                     filterMessage = " (filtered using " + peptidesToFilterOn.Count + " peptides in " + Path.GetFileName(mOptions.PeptideFilterFilePath) + ")";
                 }
 
-                if (mOptions.TopHitOnly)
+                if (topHitOnly)
                 {
                     // Update mPSMsBySpectrumKey to contain the best hit for each scan number (regardless of charge)
 
-                    var countAtStart = mPSMsBySpectrumKey.Count;
+                    var countAtStart = memoryBudgetExceeded ? peptidesStored : mPSMsBySpectrumKey.Count;
                     mPSMsBySpectrumKey.Clear();
                     foreach (var item in bestPSMByScan)
                     {
-                        var psms = new List<PSM> { item.Value.PSM };
+                        var psms = new List<CachedPSM> { item.Value.PSM };
                         mPSMsBySpectrumKey.Add(item.Value.SpectrumKey, psms);
                     }
 
                     peptidesStored = mPSMsBySpectrumKey.Count;
                     ShowMessage(" ... cached " + peptidesStored.ToString("#,##0") + " PSMs" + filterMessage);
-                    ShowMessage(" ... filtered out " + (countAtStart - peptidesStored).ToString("#,##0") + " PSMs to only retain the top hit for each scan (regardless of charge)");
+                    ShowMessage(" ... filtered out " + (countAtStart - peptidesStored).ToString("#,##0") + " PSMs to only retain the top hit for each scan (regardless of charge)" +
+                                (memoryBudgetExceeded ? ", since the memory budget was exceeded" : string.Empty));
                 }
                 else
                 {
@@ -368,14 +523,18 @@ namespace PeptideListToXML
                 }
 
                 // Load the search engine parameters
-                searchEngineParams = LoadSearchEngineParameters(mPHRPReader, mOptions.SearchEngineParamFileName);
+                searchEngineParams = LoadSearchEngineParameters(mPHRPReader, mOptions.SearchEngineParamFileName, cancellationToken);
                 return true;
             }
+            catch (OperationCanceledException)
+            {
+                throw;
+            }
             catch (Exception ex)
             {
                 if (mOptions.PreviewMode)
                 {
-                    Console.WriteLine();
+                    OnStatusEvent(string.Empty);
                     ShowMessage("Unable to preview the required files since not able to determine the dataset name: " + ex.Message);
                 }
                 else
@@ -397,24 +556,6 @@ namespace PeptideListToXML
             }
         }
 
-        /// <summary>
-        /// Constructs a Thermo-style nativeID string for the given spectrum
-        /// This allows for linking up with data in .mzML files
-        /// </summary>
-        /// <param name="scanNumber"></param>
-        private string ConstructNativeID(int scanNumber)
-        {
-            // Examples:
-            // Most Thermo raw files: "controllerType=0 controllerNumber=1 scan=6"
-            // Thermo raw with PQD spectra: "controllerType=1 controllerNumber=1 scan=6"
-            // Wiff files: "sample=1 period=1 cycle=123 experiment=2"
-            // Waters files: "function=2 process=0 scan=123
-
-            // For now, we're assuming all data processed by this program is from Thermo raw files
-
-            return "controllerType=0 controllerNumber=1 scan=" + scanNumber;
-        }
-
         /// <summary>
         /// Get the default file extensions that this class knows how to parse
         /// </summary>
@@ -454,6 +595,12 @@ namespace PeptideListToXML
                         "MSGF file not found; use the /NoMSGF switch to silence this error",
                     PeptideListToXMLErrorCodes.ScanStatsFileNotFound =>
                         "MASIC ScanStats file not found; use the /NoScanStats switch to ignore this error",
+                    PeptideListToXMLErrorCodes.ProcessingTimedOut =>
+                        "Processing did not finish within the time limit defined by /Timeout",
+                    PeptideListToXMLErrorCodes.ProcessingCancelled =>
+                        "Processing cancelled",
+                    PeptideListToXMLErrorCodes.MemoryBudgetExceeded =>
+                        "Memory usage exceeded the memory budget, even after only retaining the top hit for each scan; use /MaxProteins or /PepFilter to reduce memory usage, or increase the memory limit",
                     PeptideListToXMLErrorCodes.UnspecifiedError =>
                         "Unspecified localized error",
                     _ => "Unknown error state"
@@ -463,9 +610,57 @@ namespace PeptideListToXML
             return GetBaseClassErrorMessage();
         }
 
-        private string GetSpectrumKey(PSM CurrentPSM)
+        private void DeletePartialOutputFile(string outputFilePath)
+        {
+            if (string.IsNullOrEmpty(outputFilePath) || mOptions.WriteToStandardOutput)
+                return;
+
+            try
+            {
+                if (!File.Exists(outputFilePath))
+                    return;
+
+                File.Delete(outputFilePath);
+                ShowMessage("Deleted partial output file " + Path.GetFileName(outputFilePath));
+            }
+            catch (Exception ex)
+            {
+                ShowWarning("Unable to delete partial output file " + outputFilePath + ": " + ex.Message);
+            }
+        }
+
+        private int GetCachedPSMCount()
+        {
+            return mPSMsBySpectrumKey.Values.Sum(psms => psms.Count);
+        }
+
+        /// <summary>
+        /// Store psm in bestPSMByScan if it is the first PSM for its start scan, or if it has a lower MSGF SpecProb than the stored PSM
+        /// </summary>
+        /// <param name="bestPSMByScan">Keys are start scan numbers, values are the best PSM for each scan (regardless of charge)</param>
+        /// <param name="spectrumKey"></param>
+        /// <param name="psm"></param>
+        private static void UpdateBestPSM(Dictionary<int, PSMInfo> bestPSMByScan, SpectrumKey spectrumKey, CachedPSM psm)
+        {
+            var comparisonPSMInfo = new PSMInfo(spectrumKey, psm);
+
+            if (bestPSMByScan.TryGetValue(spectrumKey.StartScan, out var bestPSMInfo))
+            {
+                if (comparisonPSMInfo.MSGFSpecProb < bestPSMInfo.MSGFSpecProb)
+                {
+                    // We have found a better scoring peptide for this scan
+                    bestPSMByScan[spectrumKey.StartScan] = comparisonPSMInfo;
+                }
+            }
+            else
+            {
+                bestPSMByScan.Add(spectrumKey.StartScan, comparisonPSMInfo);
+            }
+        }
+
+        internal static SpectrumKey GetSpectrumKey(PSM CurrentPSM)
         {
-            return mOptions.DatasetName + "." + CurrentPSM.ScanNumberStart + "." + CurrentPSM.ScanNumberEnd + "." + CurrentPSM.Charge;
+            return new SpectrumKey(CurrentPSM.ScanNumberStart, CurrentPSM.ScanNumberEnd, CurrentPSM.Charge);
         }
 
         /// <summary>
@@ -524,7 +719,7 @@ namespace PeptideListToXML
             return true;
         }
 
-        private bool LoadPeptideFilterFile(string inputFilePath, out SortedSet<string> peptides)
+        internal bool LoadPeptideFilterFile(string inputFilePath, out SortedSet<string> peptides)
         {
             peptides = new SortedSet<string>();
 
@@ -574,13 +769,44 @@ namespace PeptideListToXML
             return true;
         }
 
-        private SearchEngineParameters LoadSearchEngineParameters(ReaderFactory reader, string searchEngineParamFileName)
+        /// <summary>
+        /// Load the protein-relative modification sites from the _ProteinMods.txt file that corresponds to the input file
+        /// </summary>
+        /// <param name="inputFilePath">PHRP synopsis file path</param>
+        /// <returns>The loaded sites, or null if the file could not be loaded</returns>
+        private ProteinModIndex LoadProteinModIndex(string inputFilePath)
+        {
+            var inputFile = new FileInfo(inputFilePath);
+
+            // Result IDs in the _ProteinMods.txt file are from the synopsis file
+            if (!inputFile.Name.Equals(ReaderFactory.GetPHRPSynopsisFileName(mOptions.PeptideHitResultType, mOptions.DatasetName), StringComparison.OrdinalIgnoreCase))
+            {
+                ShowWarning("Protein modification positions can only be added when the input file is the synopsis file; ignoring /ProteinMods");
+                return null;
+            }
+
+            var proteinModsFilePath = Path.Combine(inputFile.DirectoryName ?? string.Empty, ReaderFactory.GetPHRPProteinModsFileName(mOptions.PeptideHitResultType, mOptions.DatasetName));
+
+            var proteinModIndex = new ProteinModIndex();
+            RegisterEvents(proteinModIndex);
+
+            if (!proteinModIndex.LoadProteinModsFile(proteinModsFilePath))
+            {
+                ShowMessage("  ... protein modification positions will not be included in the output file");
+                return null;
+            }
+
+            ShowMessage("Loaded " + proteinModIndex.SiteCount.ToString("#,##0") + " protein modification sites from " + Path.GetFileName(proteinModsFilePath));
+            return proteinModIndex;
+        }
+
+        private SearchEngineParameters LoadSearchEngineParameters(ReaderFactory reader, string searchEngineParamFileName, CancellationToken cancellationToken)
         {
             SearchEngineParameters searchEngineParams = null;
 
             try
             {
-                Console.WriteLine();
+                OnStatusEvent(string.Empty);
                 if (string.IsNullOrEmpty(searchEngineParamFileName))
                 {
                     ShowWarning("Search engine parameter file not defined; use /E to specify the filename");
@@ -601,6 +827,8 @@ namespace PeptideListToXML
 
                 foreach (var item in mPSMsBySpectrumKey)
                 {
+                    cancellationToken.ThrowIfCancellationRequested();
+
                     var spectrumKey = item.Key;
                     if (!mSpectrumInfo.ContainsKey(spectrumKey))
                     {
@@ -635,6 +863,10 @@ namespace PeptideListToXML
                     }
                 }
             }
+            catch (OperationCanceledException)
+            {
+                throw;
+            }
             catch (Exception ex)
             {
                 HandleException("Error in LoadSearchEngineParameters", ex);
@@ -665,7 +897,7 @@ namespace PeptideListToXML
                 return;
             }
 
-            Console.WriteLine();
+            OnStatusEvent(string.Empty);
             ShowMessage("Data file directory: " + PathUtils.CompactPathString(inputFile.DirectoryName, 110));
 
             ShowMessage("Data file: ".PadRight(PREVIEW_PAD_WIDTH) + Path.GetFileName(inputFilePath));
@@ -680,6 +912,11 @@ namespace PeptideListToXML
                 }
             }
 
+            if (options.IncludeProteinModPositions)
+            {
+                ShowMessage("ProteinMods file: ".PadRight(PREVIEW_PAD_WIDTH) + ReaderFactory.GetPHRPProteinModsFileName(mOptions.PeptideHitResultType, mOptions.DatasetName));
+            }
+
             if (options.LoadMSGFResults)
             {
                 ShowMessage("MSGF Results file: ".PadRight(PREVIEW_PAD_WIDTH) + ReaderFactory.GetMSGFFileName(inputFilePath));
@@ -747,7 +984,7 @@ namespace PeptideListToXML
                     return false;
                 }
 
-                Console.WriteLine();
+                OnStatusEvent(string.Empty);
                 if (!mOptions.PreviewMode)
                 {
                     ShowMessage("Parsing " + Path.GetFileName(inputFilePath));
@@ -788,6 +1025,48 @@ namespace PeptideListToXML
             }
         }
 
+        private bool SavePerformanceStats(PerformanceStats performanceStats, string outputFilePath)
+        {
+            try
+            {
+                performanceStats.SaveToFile(outputFilePath);
+
+                foreach (var phase in performanceStats.Phases)
+                {
+                    ShowMessage(string.Format("{0}: {1:F2} seconds, {2:#,##0} PSMs/sec, {3:F1} MB/sec",
+                        phase.Name, phase.ElapsedSeconds, phase.PSMsPerSecond, phase.MBPerSecond));
+                }
+
+                ShowMessage("Performance stats saved to " + Path.GetFileName(outputFilePath));
+                return true;
+            }
+            catch (Exception ex)
+            {
+                HandleException("Error in SavePerformanceStats", ex);
+                return false;
+            }
+        }
+
+        /// <summary>
+        /// Check whether a PSM should be skipped, based on the X residue, score rank, peptide, and charge filters
+        /// </summary>
+        /// <param name="currentPSM"></param>
+        /// <param name="peptidesToFilterOn">Peptides to keep; if empty, all peptides are kept</param>
+        /// <returns>True if the PSM should not be stored</returns>
+        internal bool SkipPSM(PSM currentPSM, SortedSet<string> peptidesToFilterOn)
+        {
+            if (mOptions.SkipXPeptides && currentPSM.PeptideCleanSequence.Contains("X"))
+                return true;
+
+            if (mOptions.PSMsPerSpectrumToStore > 0 && currentPSM.ScoreRank > mOptions.PSMsPerSpectrumToStore)
+                return true;
+
+            if (peptidesToFilterOn.Count > 0 && !peptidesToFilterOn.Contains(currentPSM.PeptideCleanSequence))
+                return true;
+
+            return mOptions.ChargeFilterList.Count > 0 && !mOptions.ChargeFilterList.Contains(currentPSM.Charge);
+        }
+
         private void SetLocalErrorCode(PeptideListToXMLErrorCodes newErrorCode, bool leaveExistingErrorCodeUnchanged = false)
         {
             if (leaveExistingErrorCodeUnchanged && LocalErrorCode != PeptideListToXMLErrorCodes.NoError)
@@ -810,21 +1089,80 @@ namespace PeptideListToXML
             }
         }
 
-        private bool WriteCachedData(string outputFilePath, SearchEngineParameters searchEngineParams)
+        /// <summary>
+        /// Write the cached spectra and PSMs to a PepXML or JSON Lines file, plus an mzTab file if enabled
+        /// </summary>
+        /// <param name="outputFilePath"></param>
+        /// <param name="searchEngineParams"></param>
+        /// <param name="performanceStats">If not null, used to record the time to first spectrum</param>
+        /// <param name="cancellationToken">Cancellation token, checked before writing each spectrum</param>
+        /// <param name="bytesWritten">Output: size of the PepXML or JSON Lines output, in bytes</param>
+        /// <returns>True if successful, false if an error</returns>
+        private bool WriteCachedData(
+            string outputFilePath,
+            SearchEngineParameters searchEngineParams,
+            PerformanceStats performanceStats,
+            CancellationToken cancellationToken,
+            out long bytesWritten)
         {
-            ResetProgress("Creating the .pepXML file");
+            var jsonLinesOutput = mOptions.OutputFormat == Options.PeptideListOutputFormat.JsonLines;
+
+            ResetProgress(jsonLinesOutput ? "Creating the .jsonl file" : "Creating the .pepXML file");
+            JsonLinesWriter jsonLinesWriter = null;
+            MzTabWriter mzTabWriter = null;
+
+            bytesWritten = 0;
+
             try
             {
-                Console.WriteLine();
-                ShowMessage("Creating PepXML file at " + Path.GetFileName(outputFilePath));
-                mXMLWriter = new PepXMLWriter(outputFilePath, searchEngineParams, mOptions);
-                RegisterEvents(mXMLWriter);
+                OnStatusEvent(string.Empty);
+
+                if (!jsonLinesOutput)
+                {
+                    ShowMessage("Creating PepXML file at " + Path.GetFileName(outputFilePath));
+                    mXMLWriter = new PepXMLWriter(outputFilePath, searchEngineParams, mScoreSchema, mOptions)
+                    {
+                        ProteinModSites = mProteinModIndex
+                    };
+
+                    RegisterEvents(mXMLWriter);
+                }
+                else if (mOptions.WriteToStandardOutput)
+                {
+                    // Console messages are redirected to the standard error stream by the calling program
+                    ShowMessage("Writing JSON Lines to standard output");
+                    mXMLWriter = null;
+                    jsonLinesWriter = new JsonLinesWriter(Console.OpenStandardOutput(), mScoreSchema, mOptions, true)
+                    {
+                        ProteinModSites = mProteinModIndex
+                    };
+                }
+                else
+                {
+                    ShowMessage("Creating JSON Lines file at " + Path.GetFileName(outputFilePath));
+                    mXMLWriter = null;
+                    jsonLinesWriter = new JsonLinesWriter(outputFilePath, mScoreSchema, mOptions)
+                    {
+                        ProteinModSites = mProteinModIndex
+                    };
+                }
+
+                if (mOptions.CreateMzTabFile)
+                {
+                    var mzTabFilePath = Path.ChangeExtension(outputFilePath, MZTAB_FILE_EXTENSION);
+                    ShowMessage("Creating mzTab file at " + Path.GetFileName(mzTabFilePath));
+
+                    mzTabWriter = new MzTabWriter(mzTabFilePath, searchEngineParams, mScoreSchema, mOptions);
+                    RegisterEvents(mzTabWriter);
+                }
 
                 var spectra = 0;
                 var peptides = 0;
 
                 foreach (var spectrumKey in mPSMsBySpectrumKey.Keys)
                 {
+                    cancellationToken.ThrowIfCancellationRequested();
+
                     var psm = mPSMsBySpectrumKey[spectrumKey];
 
                     if (mSpectrumInfo.TryGetValue(spectrumKey, out var currentSpectrum))
@@ -832,11 +1170,18 @@ namespace PeptideListToXML
                         spectra++;
                         peptides += psm.Count;
 
-                        mXMLWriter.WriteSpectrum(currentSpectrum, psm, mSeqToProteinMapCached);
+                        mXMLWriter?.WriteSpectrum(currentSpectrum, psm, mSeqToProteinMapCached);
+                        jsonLinesWriter?.WriteSpectrum(currentSpectrum, psm);
+                        mzTabWriter?.WriteSpectrum(currentSpectrum, psm);
+
+                        if (spectra == 1)
+                        {
+                            performanceStats?.RecordFirstSpectrum();
+                        }
                     }
                     else
                     {
-                        ShowErrorMessage("Spectrum key '" + spectrumKey + "' not found in mSpectrumInfo; this is unexpected");
+                        ShowErrorMessage("Spectrum key '" + spectrumKey.GetSpectrumTitle(mOptions.DatasetName) + "' not found in mSpectrumInfo; this is unexpected");
                     }
 
                     var pctComplete = spectra / (float)mPSMsBySpectrumKey.Count * 100f;
@@ -845,20 +1190,43 @@ namespace PeptideListToXML
 
                 if (peptides > 500)
                 {
-                    Console.WriteLine();
+                    OnStatusEvent(string.Empty);
+                }
+
+                OnStatusEvent(string.Empty);
+
+                if (jsonLinesWriter != null)
+                {
+                    jsonLinesWriter.Close();
+                    bytesWritten = jsonLinesWriter.BytesWritten;
+                    ShowMessage("JSON Lines output created with " + spectra.ToString("#,##0") + " spectra and " + peptides.ToString("#,##0") + " peptides");
+                }
+                else
+                {
+                    mXMLWriter.CloseDocument();
+                    bytesWritten = new FileInfo(outputFilePath).Length;
+                    ShowMessage("PepXML file created with " + spectra.ToString("#,##0") + " spectra and " + peptides.ToString("#,##0") + " peptides");
                 }
 
-                mXMLWriter.CloseDocument();
-                Console.WriteLine();
-                ShowMessage("PepXML file created with " + spectra.ToString("#,##0") + " spectra and " + peptides.ToString("#,##0") + " peptides");
+                mzTabWriter?.Close();
 
                 return true;
             }
+            catch (OperationCanceledException)
+            {
+                throw;
+            }
             catch (Exception ex)
             {
                 ShowErrorMessage("Error Reading source file in WriteCachedData: " + ex.Message);
                 return false;
             }
+            finally
+            {
+                mXMLWriter?.Dispose();
+                jsonLinesWriter?.Dispose();
+                mzTabWriter?.Dispose();
+            }
         }
     }
 }
@@ -0,0 +1,134 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Text;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// Tracks elapsed time, throughput, and memory usage for each processing phase of a dataset
+    /// </summary>
+    /// <remarks>
+    /// Results are saved as a JSON file, which is read by Benchmarks\run_benchmarks.py
+    /// </remarks>
+    public class PerformanceStats
+    {
+        private readonly Stopwatch mPhaseStopwatch = new();
+
+        private long mPhaseStartAllocatedBytes;
+
+        /// <summary>
+        /// Dataset name
+        /// </summary>
+        public string DatasetName { get; set; }
+
+        /// <summary>
+        /// Statistics for completed phases
+        /// </summary>
+        public List<PhaseStats> Phases { get; } = new();
+
+        /// <summary>
+        /// Seconds from the start of the process until the first spectrum was written; 0 if not recorded
+        /// </summary>
+        /// <remarks>Includes runtime startup and JIT compilation, in addition to the time spent caching the PSMs</remarks>
+        public double TimeToFirstSpectrumSeconds { get; private set; }
+
+        /// <summary>
+        /// Constructor
+        /// </summary>
+        /// <param name="datasetName"></param>
+        public PerformanceStats(string datasetName)
+        {
+            DatasetName = datasetName;
+
+            // Required to track allocated bytes under the .NET Framework
+            AppDomain.MonitoringIsEnabled = true;
+        }
+
+        /// <summary>
+        /// Start timing a phase
+        /// </summary>
+        public void StartPhase()
+        {
+            mPhaseStartAllocatedBytes = AppDomain.CurrentDomain.MonitoringTotalAllocatedMemorySize;
+            mPhaseStopwatch.Restart();
+        }
+
+        /// <summary>
+        /// Stop timing the current phase and store its statistics
+        /// </summary>
+        /// <param name="phaseName">Phase name</param>
+        /// <param name="psmCount">Number of PSMs processed</param>
+        /// <param name="byteCount">Number of bytes read or written</param>
+        public PhaseStats EndPhase(string phaseName, int psmCount, long byteCount)
+        {
+            mPhaseStopwatch.Stop();
+
+            var currentProcess = Process.GetCurrentProcess();
+            currentProcess.Refresh();
+
+            var phase = new PhaseStats(phaseName)
+            {
+                ElapsedSeconds = mPhaseStopwatch.Elapsed.TotalSeconds,
+                PSMs = psmCount,
+                Bytes = byteCount,
+                AllocatedBytes = AppDomain.CurrentDomain.MonitoringTotalAllocatedMemorySize - mPhaseStartAllocatedBytes,
+                PeakWorkingSetBytes = currentProcess.PeakWorkingSet64
+            };
+
+            Phases.Add(phase);
+            return phase;
+        }
+
+        /// <summary>
+        /// Record the time from the start of the process until now as the time to first spectrum, if not yet recorded
+        /// </summary>
+        public void RecordFirstSpectrum()
+        {
+            if (TimeToFirstSpectrumSeconds > 0)
+                return;
+
+            TimeToFirstSpectrumSeconds = (DateTime.Now - Process.GetCurrentProcess().StartTime).TotalSeconds;
+        }
+
+        /// <summary>
+        /// Save the phase statistics to a JSON file
+        /// </summary>
+        /// <param name="outputFilePath"></param>
+        public void SaveToFile(string outputFilePath)
+        {
+            var json = new StringBuilder();
+            json.AppendLine("{");
+            json.AppendFormat("  \"dataset\": \"{0}\",", EscapeJson(DatasetName)).AppendLine();
+            json.AppendFormat(CultureInfo.InvariantCulture, "  \"timeToFirstSpectrumSeconds\": {0:0.######},", TimeToFirstSpectrumSeconds).AppendLine();
+            json.AppendLine("  \"phases\": [");
+
+            for (var i = 0; i < Phases.Count; i++)
+            {
+                var phase = Phases[i];
+                json.AppendLine("    {");
+                json.AppendFormat("      \"name\": \"{0}\",", EscapeJson(phase.Name)).AppendLine();
+                json.AppendFormat(CultureInfo.InvariantCulture, "      \"elapsedSeconds\": {0:0.######},", phase.ElapsedSeconds).AppendLine();
+                json.AppendFormat(CultureInfo.InvariantCulture, "      \"psms\": {0},", phase.PSMs).AppendLine();
+                json.AppendFormat(CultureInfo.InvariantCulture, "      \"bytes\": {0},", phase.Bytes).AppendLine();
+                json.AppendFormat(CultureInfo.InvariantCulture, "      \"psmsPerSecond\": {0:0.###},", phase.PSMsPerSecond).AppendLine();
+                json.AppendFormat(CultureInfo.InvariantCulture, "      \"mbPerSecond\": {0:0.####},", phase.MBPerSecond).AppendLine();
+                json.AppendFormat(CultureInfo.InvariantCulture, "      \"allocatedBytes\": {0},", phase.AllocatedBytes).AppendLine();
+                json.AppendFormat(CultureInfo.InvariantCulture, "      \"peakWorkingSetBytes\": {0}", phase.PeakWorkingSetBytes).AppendLine();
+                json.AppendLine(i < Phases.Count - 1 ? "    }," : "    }");
+            }
+
+            json.AppendLine("  ]");
+            json.AppendLine("}");
+
+            File.WriteAllText(outputFilePath, json.ToString());
+        }
+
+        private static string EscapeJson(string value)
+        {
+            return (value ?? string.Empty).Replace(@"\", @"\\").Replace("\"", "\\\"");
+        }
+    }
+}
@@ -0,0 +1,57 @@
+﻿namespace PeptideListToXML
+{
+    /// <summary>
+    /// Elapsed time, throughput, and memory usage for one processing phase
+    /// </summary>
+    public class PhaseStats
+    {
+        /// <summary>
+        /// Phase name, e.g. CachePHRPData or WriteCachedData
+        /// </summary>
+        public string Name { get; }
+
+        /// <summary>
+        /// Elapsed time, in seconds
+        /// </summary>
+        public double ElapsedSeconds { get; set; }
+
+        /// <summary>
+        /// Number of PSMs cached or written
+        /// </summary>
+        public int PSMs { get; set; }
+
+        /// <summary>
+        /// Number of bytes read (when caching) or written (when creating the pepXML file)
+        /// </summary>
+        public long Bytes { get; set; }
+
+        /// <summary>
+        /// Bytes allocated on the managed heap during this phase
+        /// </summary>
+        public long AllocatedBytes { get; set; }
+
+        /// <summary>
+        /// Peak working set of the process at the end of this phase, in bytes
+        /// </summary>
+        public long PeakWorkingSetBytes { get; set; }
+
+        /// <summary>
+        /// PSMs processed per second
+        /// </summary>
+        public double PSMsPerSecond => ElapsedSeconds > 0 ? PSMs / ElapsedSeconds : 0;
+
+        /// <summary>
+        /// Megabytes processed per second
+        /// </summary>
+        public double MBPerSecond => ElapsedSeconds > 0 ? Bytes / 1024.0 / 1024.0 / ElapsedSeconds : 0;
+
+        /// <summary>
+        /// Constructor
+        /// </summary>
+        /// <param name="name"></param>
+        public PhaseStats(string name)
+        {
+            Name = name;
+        }
+    }
+}
@@ -18,6 +18,7 @@ using System.Collections.Generic;
 using System.IO;
 using System.Linq;
 using System.Reflection;
+using System.Runtime;
 using System.Threading;
 using PRISM;
 using PRISM.Logging;
@@ -39,6 +40,7 @@ namespace PeptideListToXML
         private static int mRecurseDirectoriesMaxLevels;
 
         private static PeptideListToXML mPeptideListConverter;
+        private static AsyncLogWriter mLogWriter;
         private static DateTime mLastProgressReportTime;
         private static DateTime mLastPercentDisplayed;
 
@@ -48,6 +50,8 @@ namespace PeptideListToXML
         /// <returns>0 if no error, error code if an error</returns>
         public static int Main()
         {
+            EnableMultiCoreJit();
+
             var commandLineParser = new clsParseCommandLine();
 
             var options = new Options();
@@ -81,33 +85,70 @@ namespace PeptideListToXML
                     return -1;
                 }
 
-                // Note: the following settings will be overridden if mParameterFilePath points to a valid parameter file that has these settings defined
-                mPeptideListConverter = new PeptideListToXML(options)
+                if (options.WriteToStandardOutput)
+                {
+                    // Standard output is reserved for the JSON Lines data, so show console messages on the standard error stream
+                    Console.SetOut(Console.Error);
+                }
+
+                // Size the buffers and queues using the CPU and memory limits of the container (if any)
+                options.ResourceLimits = ResourceLimits.Detect();
+
+                // Console output and the /L log file are written by a background thread so that processing never waits on I/O
+                mLogWriter = new AsyncLogWriter(
+                    options.LogMessagesToFile ? GetLogFilePath(options) : string.Empty,
+                    options.ResourceLimits.LogQueueCapacity);
+
+                mLogWriter.ShowMessage(options.ResourceLimits.GetSummary());
+
+                if (options.RunMicroBenchmarks)
                 {
-                    LogMessagesToFile = options.LogMessagesToFile,
-                };
+                    var microBenchmarks = new MicroBenchmarks(options);
+                    RegisterEvents(microBenchmarks);
+
+                    return microBenchmarks.Run(options.InputFilePath) ? 0 : -1;
+                }
+
+                // Note: the following settings will be overridden if mParameterFilePath points to a valid parameter file that has these settings defined
+                // Messages are logged to a file by mLogWriter, so LogMessagesToFile is left false
+                mPeptideListConverter = new PeptideListToXML(options);
 
                 RegisterEvents(mPeptideListConverter);
 
+                if (options.DatasetTimeoutMinutes > 0)
+                {
+                    // Continue with the remaining input files after a dataset times out
+                    mPeptideListConverter.IgnoreErrorsWhenUsingWildcardMatching = true;
+                }
+
                 mLastProgressReportTime = DateTime.UtcNow;
                 mLastPercentDisplayed = DateTime.UtcNow;
                 if (mRecurseDirectories)
                 {
-                    if (mPeptideListConverter.ProcessFilesAndRecurseDirectories(
+                    var recurseSuccess = mPeptideListConverter.ProcessFilesAndRecurseDirectories(
                         options.InputFilePath,
                         options.OutputDirectoryPath,
                         mOutputDirectoryAlternatePath,
                         mRecreateDirectoryHierarchyInAlternatePath,
                         options.ParameterFilePath,
-                        mRecurseDirectoriesMaxLevels))
+                        mRecurseDirectoriesMaxLevels);
+
+                    if (ReportTimedOutInputFiles(options))
                     {
-                        return 0;
+                        return (int)PeptideListToXML.PeptideListToXMLErrorCodes.ProcessingTimedOut;
                     }
 
-                    return (int)mPeptideListConverter.ErrorCode;
+                    return recurseSuccess ? 0 : (int)mPeptideListConverter.ErrorCode;
                 }
 
-                if (mPeptideListConverter.ProcessFilesWildcard(options.InputFilePath, options.OutputDirectoryPath, options.ParameterFilePath))
+                var success = mPeptideListConverter.ProcessFilesWildcard(options.InputFilePath, options.OutputDirectoryPath, options.ParameterFilePath);
+
+                if (ReportTimedOutInputFiles(options))
+                {
+                    return (int)PeptideListToXML.PeptideListToXMLErrorCodes.ProcessingTimedOut;
+                }
+
+                if (success)
                 {
                     return 0;
                 }
@@ -125,13 +166,18 @@ namespace PeptideListToXML
                 ShowErrorMessage("Error occurred in modMain->Main", ex);
                 return -1;
             }
+            finally
+            {
+                // Write any queued messages
+                mLogWriter?.Dispose();
+            }
         }
 
         private static void DisplayProgressPercent(string taskDescription, int percentComplete, bool addCarriageReturn)
         {
             if (addCarriageReturn)
             {
-                Console.WriteLine();
+                mLogWriter.ShowProgress(Environment.NewLine);
             }
 
             if (percentComplete > 100)
@@ -140,13 +186,70 @@ namespace PeptideListToXML
             if (string.IsNullOrEmpty(taskDescription))
                 taskDescription = "Processing";
 
-            Console.Write("{0}: {1}% ", taskDescription, percentComplete);
+            mLogWriter.ShowProgress(string.Format("{0}: {1}% ", taskDescription, percentComplete));
             if (addCarriageReturn)
             {
-                Console.WriteLine();
+                mLogWriter.ShowProgress(Environment.NewLine);
+            }
+        }
+
+        /// <summary>
+        /// Record the methods compiled while the program starts, then compile them on a background thread in subsequent runs
+        /// </summary>
+        /// <remarks>
+        /// The profile is stored in the user's local application data directory; this has no effect
+        /// on methods that were precompiled with NGen (see the NGenInstall property in PeptideListToXML.csproj)
+        /// </remarks>
+        private static void EnableMultiCoreJit()
+        {
+            try
+            {
+                var profileDirectory = Path.Combine(Environment.GetFolderPath(Environment.SpecialFolder.LocalApplicationData), GetAppName());
+                Directory.CreateDirectory(profileDirectory);
+
+                ProfileOptimization.SetProfileRoot(profileDirectory);
+                ProfileOptimization.StartProfile(GetAppName() + ".jitprofile");
+            }
+            catch (Exception)
+            {
+                // Ignore errors; the program starts normally without the profile
             }
         }
 
+        /// <summary>
+        /// Log file path to use when /L is provided
+        /// </summary>
+        /// <remarks>The log file is created in the output directory, or in the input file's directory if an output directory is not defined</remarks>
+        /// <param name="options"></param>
+        private static string GetLogFilePath(Options options)
+        {
+            string logDirectoryPath;
+            if (!string.IsNullOrWhiteSpace(options.OutputDirectoryPath))
+            {
+                logDirectoryPath = options.OutputDirectoryPath;
+            }
+            else
+            {
+                logDirectoryPath = Path.GetDirectoryName(options.InputFilePath);
+            }
+
+            var logFileName = GetAppName() + "_log_" + DateTime.Now.ToString("yyyy-MM-dd") + ".txt";
+
+            return string.IsNullOrEmpty(logDirectoryPath) ? logFileName : Path.Combine(logDirectoryPath, logFileName);
+        }
+
+        /// <summary>
+        /// Get the program name, without the file extension
+        /// </summary>
+        /// <remarks>
+        /// Uses the assembly name instead of Assembly.Location, since the location is an empty string
+        /// when the program is published as a single file or as a native executable
+        /// </remarks>
+        private static string GetAppName()
+        {
+            return Assembly.GetExecutingAssembly().GetName().Name;
+        }
+
         private static string GetAppVersion()
         {
             return Assembly.GetExecutingAssembly().GetName().Version + " (" + PROGRAM_DATE + ")";
@@ -163,10 +266,10 @@ namespace PeptideListToXML
         {
             var validParameters = new List<string>
             {
-                "I", "O", "F", "E", "H", "X",
+                "I", "O", "F", "E", "H", "X", "Format", "Stdout",
                 "PepFilter", "ChargeFilter", "TopHitOnly", "MaxProteins",
                 "NoMods", "NoMSGF", "NoScanStats",
-                "Preview", "P", "S", "A", "R", "L"
+                "Preview", "PerfStats", "Benchmark", "Validate", "mzTab", "ProteinMods", "Timeout", "P", "S", "A", "R", "L"
             };
 
             invalidParameters = false;
@@ -194,10 +297,37 @@ namespace PeptideListToXML
                 if (commandLineParser.RetrieveValueForParameter("O", out var outputDirectoryPath))
                     options.OutputDirectoryPath = outputDirectoryPath;
 
-                // Future enum; mzIdentML is not yet supported
-                // if (.RetrieveValueForParameter("M", value)) {
-                //     mOutputFormat = clsPeptideListToXML.PeptideListOutputFormat.mzIdentML
-                // }
+                if (commandLineParser.RetrieveValueForParameter("Format", out var outputFormat))
+                {
+                    // mzIdentML is not yet supported
+                    if (outputFormat.Equals("pepXML", StringComparison.OrdinalIgnoreCase))
+                    {
+                        options.OutputFormat = Options.PeptideListOutputFormat.PepXML;
+                    }
+                    else if (outputFormat.Equals("jsonl", StringComparison.OrdinalIgnoreCase) ||
+                             outputFormat.Equals("JsonLines", StringComparison.OrdinalIgnoreCase))
+                    {
+                        options.OutputFormat = Options.PeptideListOutputFormat.JsonLines;
+                    }
+                    else
+                    {
+                        ShowErrorMessage("Invalid output format: " + outputFormat + "; should be pepXML or jsonl");
+                        Console.WriteLine();
+                        return false;
+                    }
+                }
+
+                if (commandLineParser.IsParameterPresent("Stdout"))
+                {
+                    if (options.OutputFormat != Options.PeptideListOutputFormat.JsonLines)
+                    {
+                        ShowErrorMessage("/Stdout requires /Format:jsonl");
+                        Console.WriteLine();
+                        return false;
+                    }
+
+                    options.WriteToStandardOutput = true;
+                }
 
                 if (commandLineParser.RetrieveValueForParameter("F", out var fastaFilePath))
                     options.FastaFilePath = fastaFilePath;
@@ -276,6 +406,34 @@ namespace PeptideListToXML
                 if (commandLineParser.IsParameterPresent("Preview"))
                     options.PreviewMode = true;
 
+                if (commandLineParser.IsParameterPresent("PerfStats"))
+                    options.SavePerformanceStats = true;
+
+                if (commandLineParser.IsParameterPresent("Benchmark"))
+                    options.RunMicroBenchmarks = true;
+
+                if (commandLineParser.IsParameterPresent("Validate"))
+                    options.ValidateOutput = true;
+
+                if (commandLineParser.IsParameterPresent("mzTab"))
+                    options.CreateMzTabFile = true;
+
+                if (commandLineParser.IsParameterPresent("ProteinMods"))
+                    options.IncludeProteinModPositions = true;
+
+                if (commandLineParser.RetrieveValueForParameter("Timeout", out var timeoutMinutes))
+                {
+                    // CancellationTokenSource.CancelAfter supports up to int.MaxValue milliseconds (about 24 days)
+                    if (!double.TryParse(timeoutMinutes, out var timeoutMinutesValue) || timeoutMinutesValue <= 0 || timeoutMinutesValue > int.MaxValue / 60000.0)
+                    {
+                        ShowErrorMessage("Invalid /Timeout value: " + timeoutMinutes + "; should be a positive number of minutes, for example /Timeout:30");
+                        Console.WriteLine();
+                        return false;
+                    }
+
+                    options.DatasetTimeoutMinutes = timeoutMinutesValue;
+                }
+
                 if (commandLineParser.RetrieveValueForParameter("S", out var recurseDirectories))
                 {
                     mRecurseDirectories = true;
@@ -304,9 +462,40 @@ namespace PeptideListToXML
             return false;
         }
 
+        /// <summary>
+        /// List the input files that were skipped because they were not converted within the time limit
+        /// </summary>
+        /// <param name="options"></param>
+        /// <returns>True if any input files timed out</returns>
+        private static bool ReportTimedOutInputFiles(Options options)
+        {
+            var timedOutInputFiles = mPeptideListConverter.TimedOutInputFiles;
+
+            if (timedOutInputFiles.Count == 0)
+                return false;
+
+            Console.WriteLine();
+            ShowErrorMessage(string.Format("{0} input file{1} not converted within {2} minutes:",
+                timedOutInputFiles.Count, timedOutInputFiles.Count == 1 ? " was" : "s were", options.DatasetTimeoutMinutes));
+
+            foreach (var inputFilePath in timedOutInputFiles)
+            {
+                ShowErrorMessage("  " + inputFilePath);
+            }
+
+            return true;
+        }
+
         private static void ShowErrorMessage(string errorMessage, Exception ex = null)
         {
-            ConsoleMsgUtils.ShowError(errorMessage, ex);
+            if (mLogWriter == null)
+            {
+                ConsoleMsgUtils.ShowError(errorMessage, ex);
+            }
+            else
+            {
+                mLogWriter.ShowError(errorMessage, ex);
+            }
         }
 
         private static void ShowErrorMessage(string title, IEnumerable<string> errorMessages)
@@ -326,12 +515,13 @@ namespace PeptideListToXML
                     "You should ideally also include the name of the parameter file used by the MS/MS search engine."));
                 Console.WriteLine();
                 Console.WriteLine("Program syntax:");
-                Console.WriteLine(Path.GetFileName(Assembly.GetExecutingAssembly().Location) + " /I:PHRPResultsFile [/O:OutputDirectoryPath]");
+                Console.WriteLine(GetAppName() + ".exe /I:PHRPResultsFile [/O:OutputDirectoryPath]");
                 Console.WriteLine(" [/E:SearchEngineParamFileName] [/F:FastaFilePath] [/P:ParameterFilePath]");
+                Console.WriteLine(" [/Format:pepXML|jsonl] [/Stdout] [/ProteinMods]");
                 Console.WriteLine(" [/H:PSMsPerSpectrumToStore] [/X] [/TopHitOnly] [/MaxProteins:" + PeptideListToXML.DEFAULT_MAX_PROTEINS_PER_PSM + "]");
                 Console.WriteLine(" [/PepFilter:PeptideFilterFilePath] [/ChargeFilter:ChargeList]");
-                Console.WriteLine(" [/NoMods] [/NoMSGF] [/NoScanStats] [/Preview]");
-                Console.WriteLine(" [/S:[MaxLevel]] [/A:AlternateOutputDirectoryPath] [/R] [/L] [/Q]");
+                Console.WriteLine(" [/NoMods] [/NoMSGF] [/NoScanStats] [/Preview] [/PerfStats] [/Benchmark] [/Validate] [/mzTab]");
+                Console.WriteLine(" [/S:[MaxLevel]] [/A:AlternateOutputDirectoryPath] [/R] [/Timeout:Minutes] [/L] [/Q]");
                 Console.WriteLine();
                 Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
                     "The input file path can contain the wildcard character * and should point to a tab-delimited text file created by PHRP " +
@@ -350,6 +540,15 @@ namespace PeptideListToXML
                     "ignored if /E is provided and the search engine parameter file defines the fasta file to search " +
                     "(this is the case for SEQUEST and X!Tandem but not Inspect or MS-GF+)"));
                 Console.WriteLine();
+                Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
+                    "Use /Format:jsonl to create a JSON Lines file (Dataset" + PeptideListToXML.JSON_LINES_FILE_EXTENSION + ") instead of a PepXML file, " +
+                    "with one JSON object per spectrum (equivalent to a PepXML spectrum_query element), listing the search hits, proteins, modifications, and scores. " +
+                    "Numeric values are written as JSON numbers"));
+                Console.WriteLine();
+                Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
+                    "Use /Stdout with /Format:jsonl to write the JSON Lines to the standard output stream instead of to a file; " +
+                    "console messages are written to the standard error stream"));
+                Console.WriteLine();
                 Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
                     "Use /H to specify the number of matches (aka hits) per spectrum to store " +
                     "(default is " + PeptideListToXML.DEFAULT_HITS_PER_SPECTRUM + "; use /H:0 to keep all PSMs)"));
@@ -387,6 +586,28 @@ namespace PeptideListToXML
                     "Use /Preview to preview the files that would be required for the specified dataset " +
                     "(taking into account the other command line switches used)"));
                 Console.WriteLine();
+                Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
+                    "Use /PerfStats to save the elapsed time, throughput, and memory usage of each processing phase " +
+                    "to file Dataset" + PeptideListToXML.PERFORMANCE_STATS_FILE_SUFFIX + " in the output directory"));
+                Console.WriteLine();
+                Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
+                    "Use /Benchmark to run micro-benchmarks of the functions called for each PSM, using PSMs read from the input file; " +
+                    "reports the time (ns/op) and memory allocated (bytes/op) per call. A PepXML file is not created"));
+                Console.WriteLine();
+                Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
+                    "Use /Validate to check the PepXML file against the pepXML v117 schema rules (element nesting, required attributes, and numeric values) " +
+                    "while it is being written, using a separate thread. Violations are reported as warnings"));
+                Console.WriteLine();
+                Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
+                    "Use /mzTab to also create an mzTab 1.0 file (Dataset" + PeptideListToXML.MZTAB_FILE_EXTENSION + ") with PSM and peptide sections, " +
+                    "written from the same cached data as the PepXML file"));
+                Console.WriteLine();
+                Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
+                    "Use /ProteinMods to load the PHRP _ProteinMods.txt file and include the residue number in each protein of each modified residue. " +
+                    "In the PepXML file, each site is written as a search_hit parameter named " + PepXMLWriter.PROTEIN_MOD_SITE_PARAMETER_NAME + ", " +
+                    "with value Protein:ResidueNumber:ModName:PeptideResidueNumber. In the JSON Lines file, the sites are listed for each modification. " +
+                    "Requires the synopsis file as the input file"));
+                Console.WriteLine();
                 Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
                     "Use /P to specify a parameter file to use. " +
                     "Options in this file will override options specified for /E, /F, /H, and /X"));
@@ -398,7 +619,13 @@ namespace PeptideListToXML
                     "When using /S, you can use /R to re-create the input directory hierarchy in the alternate output directory (if defined)."));
                 Console.WriteLine();
                 Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
-                    "Use /L to log messages to a file. If /Q is used, no messages will be displayed at the console."));
+                    "Use /Timeout:Minutes to limit the time spent on each dataset. If a dataset is not converted within the time limit, " +
+                    "its partial output file is deleted and processing continues with the next dataset; " +
+                    "datasets that timed out are listed when processing is complete"));
+                Console.WriteLine();
+                Console.WriteLine(ConsoleMsgUtils.WrapParagraph(
+                    "Use /L to log messages to file PeptideListToXML_log_YYYY-MM-DD.txt in the output directory (or in the input file's directory if /O is not used). " +
+                    "If /Q is used, no messages will be displayed at the console."));
                 Console.WriteLine();
                 Console.WriteLine("Program written by Matthew Monroe for the Department of Energy (PNNL, Richland, WA) in 2012");
                 Console.WriteLine("Version: " + GetAppVersion());
@@ -427,22 +654,22 @@ namespace PeptideListToXML
 
         private static void ProcessingClass_DebugEvent(string message)
         {
-            ConsoleMsgUtils.ShowDebug(message);
+            mLogWriter.ShowDebug(message);
         }
 
         private static void ProcessingClass_ErrorEvent(string message, Exception ex)
         {
-            ConsoleMsgUtils.ShowError(message, ex);
+            mLogWriter.ShowError(message, ex);
         }
 
         private static void ProcessingClass_StatusEvent(string message)
         {
-            Console.WriteLine(message);
+            mLogWriter.ShowMessage(message);
         }
 
         private static void ProcessingClass_WarningEvent(string message)
         {
-            ConsoleMsgUtils.ShowWarning(message);
+            mLogWriter.ShowWarning(message);
         }
 
         private static void ProcessingClass_ProgressUpdate(string progressMessage, float percentComplete)
@@ -450,14 +677,14 @@ namespace PeptideListToXML
             const int PROGRESS_DOT_INTERVAL_MSEC = 250;
             if (DateTime.UtcNow.Subtract(mLastPercentDisplayed).TotalSeconds >= 15d)
             {
-                Console.WriteLine();
+                mLogWriter.ShowProgress(Environment.NewLine);
                 DisplayProgressPercent(progressMessage, (int)Math.Round(percentComplete), false);
                 mLastPercentDisplayed = DateTime.UtcNow;
             }
             else if (DateTime.UtcNow.Subtract(mLastProgressReportTime).TotalMilliseconds > PROGRESS_DOT_INTERVAL_MSEC)
             {
                 mLastProgressReportTime = DateTime.UtcNow;
-                Console.Write(".");
+                mLogWriter.ShowProgress(".");
             }
         }
     }
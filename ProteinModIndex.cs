@@ -0,0 +1,238 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using PRISM;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// Protein-relative modification positions read from a PHRP _ProteinMods.txt file, indexed by ResultID
+    /// </summary>
+    /// <remarks>
+    /// <para>
+    /// PHRP writes one row for each modified residue of each protein that a PSM maps to, with the residue number in the protein;
+    /// loading this file allows the protein-relative positions to be written without reading the FASTA file
+    /// </para>
+    /// <para>
+    /// PHRP assigns sequential result IDs, so the sites are stored in a single array sorted by ResultID,
+    /// with an offset array indexed by ResultID (instead of a dictionary of lists)
+    /// </para>
+    /// </remarks>
+    public class ProteinModIndex : EventNotifier
+    {
+        // Ignore Spelling: IodoAcet
+
+        /// <summary>
+        /// Modified residue in a protein
+        /// </summary>
+        public readonly struct ProteinModSite
+        {
+            /// <summary>
+            /// Protein name
+            /// </summary>
+            public string ProteinName { get; }
+
+            /// <summary>
+            /// Modified residue
+            /// </summary>
+            public char Residue { get; }
+
+            /// <summary>
+            /// Residue number in the protein (1-based)
+            /// </summary>
+            public int ProteinResidueNumber { get; }
+
+            /// <summary>
+            /// Residue number in the peptide (1-based)
+            /// </summary>
+            /// <remarks>Corresponds to AminoAcidModInfo.ResidueLocInPeptide</remarks>
+            public int PeptideResidueNumber { get; }
+
+            /// <summary>
+            /// Modification name, e.g. IodoAcet
+            /// </summary>
+            public string ModName { get; }
+
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            /// <param name="proteinName"></param>
+            /// <param name="residue"></param>
+            /// <param name="proteinResidueNumber"></param>
+            /// <param name="peptideResidueNumber"></param>
+            /// <param name="modName"></param>
+            public ProteinModSite(string proteinName, char residue, int proteinResidueNumber, int peptideResidueNumber, string modName)
+            {
+                ProteinName = proteinName;
+                Residue = residue;
+                ProteinResidueNumber = proteinResidueNumber;
+                PeptideResidueNumber = peptideResidueNumber;
+                ModName = modName;
+            }
+        }
+
+        private const string COLUMN_RESULT_ID = "ResultID";
+        private const string COLUMN_PROTEIN_NAME = "Protein_Name";
+        private const string COLUMN_RESIDUE = "Residue";
+        private const string COLUMN_PROTEIN_RESIDUE_NUM = "Protein_Residue_Num";
+        private const string COLUMN_MOD_NAME = "Mod_Name";
+        private const string COLUMN_PEPTIDE_RESIDUE_NUM = "Peptide_Residue_Num";
+
+        // Sites for result ID n are mSites[mFirstSiteByResultID[n]] through mSites[mFirstSiteByResultID[n + 1] - 1]
+        private int[] mFirstSiteByResultID = { 0 };
+
+        private ProteinModSite[] mSites = Array.Empty<ProteinModSite>();
+
+        /// <summary>
+        /// Number of modified residues loaded (across all proteins)
+        /// </summary>
+        public int SiteCount => mSites.Length;
+
+        /// <summary>
+        /// Get the protein-relative modification sites for a PSM
+        /// </summary>
+        /// <param name="resultID">PSM result ID</param>
+        /// <returns>Sites, ordered as in the _ProteinMods.txt file; an empty segment if the PSM is not modified</returns>
+        public ArraySegment<ProteinModSite> GetSites(int resultID)
+        {
+            if (resultID < 0 || resultID >= mFirstSiteByResultID.Length - 1)
+                return new ArraySegment<ProteinModSite>(mSites, 0, 0);
+
+            var firstSite = mFirstSiteByResultID[resultID];
+            return new ArraySegment<ProteinModSite>(mSites, firstSite, mFirstSiteByResultID[resultID + 1] - firstSite);
+        }
+
+        /// <summary>
+        /// Load a PHRP _ProteinMods.txt file
+        /// </summary>
+        /// <param name="filePath"></param>
+        /// <returns>True if successful, false if an error</returns>
+        public bool LoadProteinModsFile(string filePath)
+        {
+            try
+            {
+                if (!File.Exists(filePath))
+                {
+                    OnWarningEvent("ProteinMods file not found: " + filePath);
+                    return false;
+                }
+
+                using var reader = new StreamReader(new FileStream(filePath, FileMode.Open, FileAccess.Read, FileShare.ReadWrite));
+
+                var headerLine = reader.ReadLine();
+                if (string.IsNullOrWhiteSpace(headerLine))
+                {
+                    OnWarningEvent("ProteinMods file is empty: " + filePath);
+                    return false;
+                }
+
+                var columnNames = new List<string>(headerLine.Split('\t'));
+
+                var resultIdColumn = columnNames.IndexOf(COLUMN_RESULT_ID);
+                var proteinColumn = columnNames.IndexOf(COLUMN_PROTEIN_NAME);
+                var residueColumn = columnNames.IndexOf(COLUMN_RESIDUE);
+                var proteinResidueColumn = columnNames.IndexOf(COLUMN_PROTEIN_RESIDUE_NUM);
+                var modNameColumn = columnNames.IndexOf(COLUMN_MOD_NAME);
+                var peptideResidueColumn = columnNames.IndexOf(COLUMN_PEPTIDE_RESIDUE_NUM);
+
+                if (resultIdColumn < 0 || proteinColumn < 0 || residueColumn < 0 || proteinResidueColumn < 0 || modNameColumn < 0 || peptideResidueColumn < 0)
+                {
+                    OnWarningEvent(string.Format(
+                        "ProteinMods file is missing one or more of the required columns ({0}, {1}, {2}, {3}, {4}, {5}): {6}",
+                        COLUMN_RESULT_ID, COLUMN_PROTEIN_NAME, COLUMN_RESIDUE, COLUMN_PROTEIN_RESIDUE_NUM, COLUMN_MOD_NAME, COLUMN_PEPTIDE_RESIDUE_NUM,
+                        filePath));
+
+                    return false;
+                }
+
+                var lastColumn = Math.Max(Math.Max(Math.Max(resultIdColumn, proteinColumn), Math.Max(residueColumn, proteinResidueColumn)), Math.Max(modNameColumn, peptideResidueColumn));
+
+                // Each protein name and mod name is stored once, since a protein typically has several modified residues
+                var cachedNames = new Dictionary<string, string>();
+
+                var resultIDs = new List<int>();
+                var sites = new List<ProteinModSite>();
+                var maxResultID = -1;
+                var invalidLines = 0;
+
+                while (!reader.EndOfStream)
+                {
+                    var dataLine = reader.ReadLine();
+                    if (string.IsNullOrWhiteSpace(dataLine))
+                        continue;
+
+                    var dataValues = dataLine.Split('\t');
+
+                    if (dataValues.Length <= lastColumn ||
+                        !int.TryParse(dataValues[resultIdColumn], out var resultID) || resultID < 0 ||
+                        !int.TryParse(dataValues[proteinResidueColumn], out var proteinResidueNumber) ||
+                        !int.TryParse(dataValues[peptideResidueColumn], out var peptideResidueNumber))
+                    {
+                        invalidLines++;
+                        continue;
+                    }
+
+                    var residue = dataValues[residueColumn];
+
+                    resultIDs.Add(resultID);
+                    sites.Add(new ProteinModSite(
+                        GetCachedName(cachedNames, dataValues[proteinColumn]),
+                        residue.Length > 0 ? residue[0] : '-',
+                        proteinResidueNumber,
+                        peptideResidueNumber,
+                        GetCachedName(cachedNames, dataValues[modNameColumn])));
+
+                    if (resultID > maxResultID)
+                        maxResultID = resultID;
+                }
+
+                // Counting sort by result ID; sites with the same result ID keep their order in the file
+                var firstSiteByResultID = new int[maxResultID + 2];
+
+                foreach (var resultID in resultIDs)
+                {
+                    firstSiteByResultID[resultID + 1]++;
+                }
+
+                for (var i = 1; i < firstSiteByResultID.Length; i++)
+                {
+                    firstSiteByResultID[i] += firstSiteByResultID[i - 1];
+                }
+
+                var nextSiteByResultID = new int[firstSiteByResultID.Length];
+                Array.Copy(firstSiteByResultID, nextSiteByResultID, firstSiteByResultID.Length);
+
+                var sortedSites = new ProteinModSite[sites.Count];
+
+                for (var i = 0; i < sites.Count; i++)
+                {
+                    sortedSites[nextSiteByResultID[resultIDs[i]]++] = sites[i];
+                }
+
+                mFirstSiteByResultID = firstSiteByResultID;
+                mSites = sortedSites;
+
+                if (invalidLines > 0)
+                {
+                    OnWarningEvent(string.Format("Skipped {0} invalid line{1} in {2}", invalidLines, invalidLines == 1 ? string.Empty : "s", Path.GetFileName(filePath)));
+                }
+
+                return true;
+            }
+            catch (Exception ex)
+            {
+                OnErrorEvent("Error loading the ProteinMods file: " + ex.Message, ex);
+                return false;
+            }
+        }
+
+        private static string GetCachedName(IDictionary<string, string> cachedNames, string name)
+        {
+            if (cachedNames.TryGetValue(name, out var cachedName))
+                return cachedName;
+
+            cachedNames.Add(name, name);
+            return name;
+        }
+    }
+}
@@ -0,0 +1,484 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Runtime.InteropServices;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// CPU and memory limits of the container (or host) that the program is running in,
+    /// plus the buffer sizes, queue depths, and memory budget derived from them
+    /// </summary>
+    /// <remarks>
+    /// <para>
+    /// On Linux, the limits are read from the cgroup v2 files (cpu.max and memory.max) or the cgroup v1 files
+    /// (cpu.cfs_quota_us, cpu.cfs_period_us, and memory.limit_in_bytes) of the current process,
+    /// since depending on the runtime, Environment.ProcessorCount may not reflect a CPU quota, and the memory limit is not reported
+    /// </para>
+    /// <para>
+    /// A limit set on an ancestor cgroup also applies to the process, so the files of the process's cgroup and each of its ancestors
+    /// are read, and the lowest limits are used
+    /// </para>
+    /// <para>
+    /// When no limits are found (including on Windows), the default values are used,
+    /// which match the sizes used before the limits were detected,
+    /// and GetMemoryLoad reports the memory load of the computer instead of the managed heap's share of the memory budget
+    /// </para>
+    /// </remarks>
+    public class ResourceLimits
+    {
+        // Ignore Spelling: cfs, cgroup, cgroups, cpuacct
+
+        private const string CGROUP_MOUNT_DIRECTORY = "/sys/fs/cgroup";
+
+        private const string PROCESS_CGROUP_FILE = "/proc/self/cgroup";
+
+        private const string MEMORY_INFO_FILE = "/proc/meminfo";
+
+        /// <summary>
+        /// Default output file buffer size, in bytes
+        /// </summary>
+        public const int DEFAULT_OUTPUT_BUFFER_SIZE = 65536;
+
+        /// <summary>
+        /// Default maximum number of buffers queued for the pepXML validation thread
+        /// </summary>
+        public const int DEFAULT_VALIDATION_QUEUE_CAPACITY = 256;
+
+        /// <summary>
+        /// Initial size, in bytes, of the buffers queued for the pepXML validation thread
+        /// </summary>
+        /// <remarks>Slightly larger than the blocks written by the XmlWriter</remarks>
+        public const int VALIDATION_BUFFER_SIZE = 8192;
+
+        private const int MIN_OUTPUT_BUFFER_SIZE = 16384;
+
+        private const int MAX_OUTPUT_BUFFER_SIZE = 1048576;
+
+        private const int MIN_VALIDATION_QUEUE_CAPACITY = 16;
+
+        private const int MIN_LOG_QUEUE_CAPACITY = 1000;
+
+        // Approximate memory used by each queued log message
+        private const int LOG_MESSAGE_BYTES = 1024;
+
+        // cgroup v1 reports a value just below 2^63 (rounded to the page size) when the memory is not limited
+        private const long UNLIMITED_MEMORY_THRESHOLD = 1L << 60;
+
+        /// <summary>
+        /// Number of processors available to this process
+        /// </summary>
+        /// <remarks>Environment.ProcessorCount, reduced to the CPU quota (rounded up) if a quota is defined</remarks>
+        public int ProcessorCount { get; private set; }
+
+        /// <summary>
+        /// Source of the CPU limit, e.g. "cgroup v2 cpu.max"; an empty string if no CPU quota is defined
+        /// </summary>
+        public string CpuLimitSource { get; private set; }
+
+        /// <summary>
+        /// Memory limit, in bytes; 0 if the memory is not limited (or the limit is unknown)
+        /// </summary>
+        public long MemoryLimitBytes { get; private set; }
+
+        /// <summary>
+        /// Source of the memory limit, e.g. "cgroup v2 memory.max"; an empty string if no memory limit is defined
+        /// </summary>
+        public string MemoryLimitSource { get; private set; }
+
+        /// <summary>
+        /// Memory that cached PSMs and queued data may use, in bytes; 0 if not limited
+        /// </summary>
+        /// <remarks>
+        /// 75% of the memory limit, leaving the remainder for the runtime, PHRPReader's lookup tables, and the output buffers;
+        /// when exceeded while caching PSMs, only the top hit for each scan is retained (as with /TopHitOnly),
+        /// and if it is exceeded again, processing stops, since the container would likely terminate the process before it finishes
+        /// </remarks>
+        public long MemoryBudgetBytes => MemoryLimitBytes * 3 / 4;
+
+        /// <summary>
+        /// Buffer size, in bytes, of the output file streams
+        /// </summary>
+        /// <remarks>
+        /// 1/4096 of the memory limit, between 16 KB and 1 MB; 64 KB if the memory is not limited
+        /// </remarks>
+        public int OutputBufferSize
+        {
+            get
+            {
+                if (MemoryLimitBytes <= 0)
+                    return DEFAULT_OUTPUT_BUFFER_SIZE;
+
+                return (int)Math.Max(MIN_OUTPUT_BUFFER_SIZE, Math.Min(MAX_OUTPUT_BUFFER_SIZE, MemoryLimitBytes / 4096));
+            }
+        }
+
+        /// <summary>
+        /// Maximum number of buffers queued for the pepXML validation thread
+        /// </summary>
+        /// <remarks>
+        /// With a single processor, the validation thread only runs when the writer waits, so a short queue suffices;
+        /// otherwise, the queue is limited to 1/64 of the memory budget
+        /// </remarks>
+        public int ValidationQueueCapacity
+        {
+            get
+            {
+                var capacity = ProcessorCount > 1 ? DEFAULT_VALIDATION_QUEUE_CAPACITY : MIN_VALIDATION_QUEUE_CAPACITY * 2;
+
+                if (MemoryLimitBytes <= 0)
+                    return capacity;
+
+                return (int)Math.Max(MIN_VALIDATION_QUEUE_CAPACITY, Math.Min(capacity, MemoryBudgetBytes / 64 / VALIDATION_BUFFER_SIZE));
+            }
+        }
+
+        /// <summary>
+        /// Maximum number of messages queued for the console and log file writer thread
+        /// </summary>
+        /// <remarks>Limited to 1/64 of the memory budget</remarks>
+        public int LogQueueCapacity
+        {
+            get
+            {
+                if (MemoryLimitBytes <= 0)
+                    return AsyncLogWriter.DEFAULT_QUEUE_CAPACITY;
+
+                return (int)Math.Max(MIN_LOG_QUEUE_CAPACITY, Math.Min(AsyncLogWriter.DEFAULT_QUEUE_CAPACITY, MemoryBudgetBytes / 64 / LOG_MESSAGE_BYTES));
+            }
+        }
+
+        /// <summary>
+        /// Constructor
+        /// </summary>
+        /// <remarks>Uses Environment.ProcessorCount and no memory limit; call Detect to read the limits of the current process</remarks>
+        public ResourceLimits()
+        {
+            ProcessorCount = Environment.ProcessorCount;
+            CpuLimitSource = string.Empty;
+            MemoryLimitBytes = 0;
+            MemoryLimitSource = string.Empty;
+        }
+
+        /// <summary>
+        /// Determine the CPU and memory limits of the current process
+        /// </summary>
+        /// <returns>Resource limits; default values if no limits are defined or they cannot be read</returns>
+        public static ResourceLimits Detect()
+        {
+            var limits = new ResourceLimits();
+
+            try
+            {
+                if (Path.DirectorySeparatorChar != '/' || !Directory.Exists(CGROUP_MOUNT_DIRECTORY))
+                    return limits;
+
+                var cgroupPaths = GetProcessCgroupPaths();
+
+                if (File.Exists(Path.Combine(CGROUP_MOUNT_DIRECTORY, "cgroup.controllers")))
+                {
+                    // cgroup v2 (unified hierarchy)
+                    cgroupPaths.TryGetValue(string.Empty, out var cgroupPath);
+
+                    foreach (var cgroupDirectory in GetCgroupDirectories(CGROUP_MOUNT_DIRECTORY, cgroupPath))
+                    {
+                        if (TryReadCpuMax(Path.Combine(cgroupDirectory, "cpu.max"), out var quota, out var period))
+                        {
+                            limits.SetCpuQuota(quota, period, "cgroup v2 cpu.max");
+                        }
+
+                        if (TryReadLimit(Path.Combine(cgroupDirectory, "memory.max"), out var memoryLimit))
+                        {
+                            limits.SetMemoryLimit(memoryLimit, "cgroup v2 memory.max");
+                        }
+                    }
+
+                    return limits;
+                }
+
+                // cgroup v1; the CPU controller is mounted as cpu, cpu,cpuacct, or cpuacct,cpu depending on the distribution
+                foreach (var controllerName in new[] { "cpu", "cpu,cpuacct", "cpuacct,cpu" })
+                {
+                    var controllerDirectory = Path.Combine(CGROUP_MOUNT_DIRECTORY, controllerName);
+                    if (!Directory.Exists(controllerDirectory))
+                        continue;
+
+                    cgroupPaths.TryGetValue("cpu", out var cpuPath);
+
+                    foreach (var cgroupDirectory in GetCgroupDirectories(controllerDirectory, cpuPath))
+                    {
+                        if (TryReadLimit(Path.Combine(cgroupDirectory, "cpu.cfs_quota_us"), out var quota) &&
+                            TryReadLimit(Path.Combine(cgroupDirectory, "cpu.cfs_period_us"), out var period))
+                        {
+                            limits.SetCpuQuota(quota, period, "cgroup v1 cpu.cfs_quota_us");
+                        }
+                    }
+
+                    break;
+                }
+
+                cgroupPaths.TryGetValue("memory", out var memoryPath);
+
+                foreach (var cgroupDirectory in GetCgroupDirectories(Path.Combine(CGROUP_MOUNT_DIRECTORY, "memory"), memoryPath))
+                {
+                    if (TryReadLimit(Path.Combine(cgroupDirectory, "memory.limit_in_bytes"), out var memoryLimitV1))
+                    {
+                        limits.SetMemoryLimit(memoryLimitV1, "cgroup v1 memory.limit_in_bytes");
+                    }
+                }
+            }
+            catch (Exception)
+            {
+                // Ignore errors reading the cgroup files; use the values determined so far
+            }
+
+            return limits;
+        }
+
+        /// <summary>
+        /// Get the directories of the process's cgroup and each of its ancestors, ending with the root of the hierarchy
+        /// </summary>
+        /// <remarks>
+        /// Inside a container, /proc/self/cgroup may list the host's path to the cgroup, which is mounted as the root of the hierarchy;
+        /// directories that do not exist are skipped
+        /// </remarks>
+        /// <param name="hierarchyDirectory">Directory where the cgroup hierarchy is mounted</param>
+        /// <param name="cgroupPath">Path of the process's cgroup, as listed in /proc/self/cgroup; null if unknown</param>
+        /// <returns>List of directories, starting with the process's cgroup</returns>
+        private static List<string> GetCgroupDirectories(string hierarchyDirectory, string cgroupPath)
+        {
+            var cgroupDirectories = new List<string>();
+
+            var currentPath = (cgroupPath ?? string.Empty).Trim().TrimEnd('/');
+
+            while (currentPath.Length > 0)
+            {
+                var cgroupDirectory = hierarchyDirectory + currentPath;
+                if (Directory.Exists(cgroupDirectory))
+                {
+                    cgroupDirectories.Add(cgroupDirectory);
+                }
+
+                currentPath = currentPath.Substring(0, Math.Max(0, currentPath.LastIndexOf('/')));
+            }
+
+            cgroupDirectories.Add(hierarchyDirectory);
+            return cgroupDirectories;
+        }
+
+        /// <summary>
+        /// Read the cgroup paths of the current process
+        /// </summary>
+        /// <returns>Dictionary where keys are controller names (an empty string for cgroup v2) and values are cgroup paths</returns>
+        private static Dictionary<string, string> GetProcessCgroupPaths()
+        {
+            var cgroupPaths = new Dictionary<string, string>();
+
+            if (!File.Exists(PROCESS_CGROUP_FILE))
+                return cgroupPaths;
+
+            // Each line has the form hierarchy-ID:controller-list:cgroup-path, for example 4:memory:/docker/1a2b3c or 0::/
+            foreach (var dataLine in File.ReadAllLines(PROCESS_CGROUP_FILE))
+            {
+                var lineParts = dataLine.Split(new[] { ':' }, 3);
+                if (lineParts.Length < 3)
+                    continue;
+
+                foreach (var controllerName in lineParts[1].Split(','))
+                {
+                    if (!cgroupPaths.ContainsKey(controllerName))
+                    {
+                        cgroupPaths.Add(controllerName, lineParts[2]);
+                    }
+                }
+            }
+
+            return cgroupPaths;
+        }
+
+        /// <summary>
+        /// Get the memory used by the managed heap, as a fraction of the memory budget;
+        /// if the memory is not limited, get the fraction of the computer's physical memory that is in use
+        /// </summary>
+        /// <remarks>
+        /// Uses GC.GetTotalMemory without forcing a collection, so the value includes garbage that has not yet been collected;
+        /// GC.GetGCMemoryInfo, which reports the memory load of the machine or container, is not available in .NET Framework
+        /// </remarks>
+        /// <returns>Memory load, where 1 means the budget (or physical memory) is used; 0 if unknown</returns>
+        public double GetMemoryLoad()
+        {
+            if (MemoryBudgetBytes <= 0)
+                return GetPhysicalMemoryLoad();
+
+            return GC.GetTotalMemory(false) / (double)MemoryBudgetBytes;
+        }
+
+        /// <summary>
+        /// Get the fraction of the computer's physical memory that is in use
+        /// </summary>
+        /// <remarks>
+        /// On Windows, uses GlobalMemoryStatusEx; on Linux, uses MemTotal and MemAvailable in /proc/meminfo
+        /// </remarks>
+        /// <returns>Memory load, between 0 and 1; 0 if unknown</returns>
+        private static double GetPhysicalMemoryLoad()
+        {
+            try
+            {
+                if (Path.DirectorySeparatorChar == '\\')
+                {
+                    var memoryStatus = new MemoryStatusEx
+                    {
+                        Length = (uint)Marshal.SizeOf(typeof(MemoryStatusEx))
+                    };
+
+                    return GlobalMemoryStatusEx(ref memoryStatus) ? memoryStatus.MemoryLoad / 100.0 : 0;
+                }
+
+                if (!File.Exists(MEMORY_INFO_FILE))
+                    return 0;
+
+                long memTotal = 0;
+                long memAvailable = -1;
+
+                // Lines have the form "MemTotal:       16318480 kB"
+                foreach (var dataLine in File.ReadLines(MEMORY_INFO_FILE))
+                {
+                    var lineParts = dataLine.Split(new[] { ' ', ':' }, StringSplitOptions.RemoveEmptyEntries);
+                    if (lineParts.Length < 2 || !long.TryParse(lineParts[1], out var value))
+                        continue;
+
+                    if (lineParts[0] == "MemTotal")
+                        memTotal = value;
+                    else if (lineParts[0] == "MemAvailable")
+                        memAvailable = value;
+
+                    if (memTotal > 0 && memAvailable >= 0)
+                        return Math.Max(0, 1 - memAvailable / (double)memTotal);
+                }
+            }
+            catch (Exception)
+            {
+                // Ignore errors determining the memory load
+            }
+
+            return 0;
+        }
+
+        /// <summary>
+        /// Check whether the managed heap uses more memory than the memory budget
+        /// </summary>
+        /// <remarks>
+        /// A full garbage collection is performed (to exclude garbage from the heap size) only if the heap size exceeds the budget without one
+        /// </remarks>
+        /// <returns>True if the budget is exceeded; false if not, or if the memory is not limited</returns>
+        public bool IsMemoryBudgetExceeded()
+        {
+            if (MemoryBudgetBytes <= 0)
+                return false;
+
+            return GC.GetTotalMemory(false) > MemoryBudgetBytes && GC.GetTotalMemory(true) > MemoryBudgetBytes;
+        }
+
+        /// <summary>
+        /// Get a description of the limits and the values derived from them, for example
+        /// "Resource limits: 2 processors (cgroup v2 cpu.max), 4,096 MB memory (cgroup v2 memory.max); ..."
+        /// </summary>
+        public string GetSummary()
+        {
+            var cpuDescription = string.Format("{0} processor{1}", ProcessorCount, ProcessorCount == 1 ? string.Empty : "s");
+
+            if (!string.IsNullOrEmpty(CpuLimitSource))
+                cpuDescription += " (" + CpuLimitSource + ")";
+
+            var memoryDescription = MemoryLimitBytes > 0
+                ? string.Format("{0:#,##0} MB memory ({1})", MemoryLimitBytes / 1024 / 1024, MemoryLimitSource)
+                : "no memory limit";
+
+            var memoryBudget = MemoryLimitBytes > 0
+                ? string.Format(", memory budget {0:#,##0} MB", MemoryBudgetBytes / 1024 / 1024)
+                : string.Empty;
+
+            return string.Format(
+                "Resource limits: {0}, {1}; output buffer {2} KB, validation queue {3} buffers, log queue {4:#,##0} messages{5}",
+                cpuDescription, memoryDescription, OutputBufferSize / 1024, ValidationQueueCapacity, LogQueueCapacity, memoryBudget);
+        }
+
+        [StructLayout(LayoutKind.Sequential)]
+        private struct MemoryStatusEx
+        {
+            public uint Length;
+            public uint MemoryLoad;
+            public ulong TotalPhys;
+            public ulong AvailPhys;
+            public ulong TotalPageFile;
+            public ulong AvailPageFile;
+            public ulong TotalVirtual;
+            public ulong AvailVirtual;
+            public ulong AvailExtendedVirtual;
+        }
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        [return: MarshalAs(UnmanagedType.Bool)]
+        private static extern bool GlobalMemoryStatusEx(ref MemoryStatusEx buffer);
+
+        private void SetCpuQuota(long quota, long period, string source)
+        {
+            if (quota <= 0 || period <= 0)
+                return;
+
+            // Round up, since a quota of 1.5 processors can keep two threads busy 75% of the time
+            var quotaProcessors = (int)Math.Min(int.MaxValue, (quota + period - 1) / period);
+
+            if (quotaProcessors >= ProcessorCount)
+                return;
+
+            ProcessorCount = Math.Max(1, quotaProcessors);
+            CpuLimitSource = source;
+        }
+
+        private void SetMemoryLimit(long memoryLimit, string source)
+        {
+            if (memoryLimit <= 0 || memoryLimit >= UNLIMITED_MEMORY_THRESHOLD)
+                return;
+
+            // Keep the lowest limit of the cgroup and its ancestors
+            if (MemoryLimitBytes > 0 && memoryLimit >= MemoryLimitBytes)
+                return;
+
+            MemoryLimitBytes = memoryLimit;
+            MemoryLimitSource = source;
+        }
+
+        /// <summary>
+        /// Read the CPU quota and period from a cgroup v2 cpu.max file, which has the form "quota period", e.g. "150000 100000" or "max 100000"
+        /// </summary>
+        private static bool TryReadCpuMax(string filePath, out long quota, out long period)
+        {
+            quota = 0;
+            period = 0;
+
+            if (!File.Exists(filePath))
+                return false;
+
+            var values = File.ReadAllText(filePath).Trim().Split(' ');
+
+            return values.Length == 2 &&
+                   long.TryParse(values[0], out quota) &&
+                   long.TryParse(values[1], out period);
+        }
+
+        /// <summary>
+        /// Read the single value in a cgroup file
+        /// </summary>
+        /// <returns>True if the file has a numeric value; false if not found, or if the value is "max" (cgroup v2) or -1 (cgroup v1)</returns>
+        private static bool TryReadLimit(string filePath, out long value)
+        {
+            value = 0;
+
+            if (!File.Exists(filePath))
+                return false;
+
+            return long.TryParse(File.ReadAllText(filePath).Trim(), out value) && value > 0;
+        }
+    }
+}
@@ -0,0 +1,113 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using PHRPReader.Data;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// Names of the scores reported by a search engine, with a slot number for each
+    /// </summary>
+    /// <remarks>
+    /// Score names are resolved once per dataset; each cached PSM stores its scores
+    /// in an array of doubles indexed by slot number instead of in a dictionary of strings
+    /// </remarks>
+    public class ScoreSchema
+    {
+        private readonly List<string> mScoreNames = new();
+
+        private readonly Dictionary<string, int> mSlotByScoreName = new();
+
+        /// <summary>
+        /// Score names, in slot order
+        /// </summary>
+        public IReadOnlyList<string> ScoreNames => mScoreNames;
+
+        /// <summary>
+        /// Number of slots
+        /// </summary>
+        public int SlotCount => mScoreNames.Count;
+
+        /// <summary>
+        /// Get the slot number for the given score, adding a new slot if the score name is not yet known
+        /// </summary>
+        /// <param name="scoreName"></param>
+        public int GetSlot(string scoreName)
+        {
+            if (mSlotByScoreName.TryGetValue(scoreName, out var slot))
+                return slot;
+
+            slot = mScoreNames.Count;
+            mScoreNames.Add(scoreName);
+            mSlotByScoreName.Add(scoreName, slot);
+
+            return slot;
+        }
+
+        /// <summary>
+        /// Format a score value for the output files
+        /// </summary>
+        /// <param name="value"></param>
+        public static string FormatScore(double value)
+        {
+            return value.ToString(CultureInfo.InvariantCulture);
+        }
+
+        /// <summary>
+        /// Convert the additional scores of a PSM to an array of doubles indexed by slot number
+        /// </summary>
+        /// <remarks>
+        /// Scores whose text would not be reproduced by FormatScore (for example "13.50", or text that is not a number)
+        /// are also stored in scoreText, so that the output files have the same text as the input file
+        /// </remarks>
+        /// <param name="psm"></param>
+        /// <param name="scoreText">Original text of scores that cannot be stored as a double; null if all scores can be</param>
+        /// <returns>Score values; NaN for scores that the PSM does not have, or that are only stored in scoreText</returns>
+        public double[] GetScores(PSM psm, out string[] scoreText)
+        {
+            var scores = new double[mScoreNames.Count];
+            scoreText = null;
+
+            for (var slot = 0; slot < scores.Length; slot++)
+            {
+                scores[slot] = double.NaN;
+            }
+
+            foreach (var item in psm.AdditionalScores)
+            {
+                var slot = GetSlot(item.Key);
+                if (slot >= scores.Length)
+                {
+                    // This PSM has a score not reported by previous PSMs
+                    var previousLength = scores.Length;
+                    Array.Resize(ref scores, mScoreNames.Count);
+
+                    for (var i = previousLength; i < scores.Length; i++)
+                    {
+                        scores[i] = double.NaN;
+                    }
+                }
+
+                var text = item.Value ?? string.Empty;
+
+                if (double.TryParse(text, NumberStyles.Float, CultureInfo.InvariantCulture, out var value) &&
+                    !double.IsNaN(value) && FormatScore(value) == text)
+                {
+                    scores[slot] = value;
+                    continue;
+                }
+
+                scoreText ??= new string[mScoreNames.Count];
+
+                if (scoreText.Length < scores.Length)
+                {
+                    Array.Resize(ref scoreText, scores.Length);
+                }
+
+                scoreText[slot] = text;
+            }
+
+            return scores;
+        }
+    }
+}
@@ -1,67 +1,106 @@
 ﻿namespace PeptideListToXML
 {
     /// <summary>
-    /// Spectrum info class
+    /// Spectrum info
     /// </summary>
-    public class SpectrumInfo
+    /// <remarks>
+    /// This is a value type with no string fields to minimize the memory used when caching millions of spectra;
+    /// the spectrum title and native ID are constructed when the spectrum is written to the PepXML file
+    /// </remarks>
+    public readonly struct SpectrumInfo
     {
+        // Properties are ordered largest to smallest to minimize padding
+
         /// <summary>
-        /// Spectrum Title
+        /// Monoisotopic mass of the precursor ion
         /// </summary>
-        /// <remarks>
-        /// Examples titles:
-        /// QC_05_2_05Dec05_Doc_0508-08.9427.9427.1
-        /// scan=16134 cs=2
-        /// </remarks>
-        public string SpectrumTitle { get; }
+        public double PrecursorNeutralMass { get; }
 
         /// <summary>
-        /// Start scan number
+        /// Elution time, in minutes
         /// </summary>
-        public int StartScan { get; set; }
+        public double ElutionTimeMinutes { get; }
 
         /// <summary>
-        /// End scan number (if this is a merged spectrum)
+        /// Start scan number
         /// </summary>
-        public int EndScan { get; set; }
+        public int StartScan { get; }
 
         /// <summary>
-        /// Monoisotopic mass of the precursor ion
+        /// End scan number (if this is a merged spectrum)
         /// </summary>
-        public double PrecursorNeutralMass { get; set; }
+        public int EndScan { get; }
 
         /// <summary>
         /// Assumed charge state of the precursor ion
         /// </summary>
-        public int AssumedCharge { get; set; }
+        public int AssumedCharge { get; }
 
         /// <summary>
-        /// Elution time, in minutes
+        /// Spectrum index
         /// </summary>
-        public double ElutionTimeMinutes { get; set; }
+        public int Index { get; }
 
         /// <summary>
         /// Collision mode
         /// </summary>
-        public string CollisionMode { get; set; }
+        public PepXMLWriter.ActivationMethods CollisionMode { get; }
 
         /// <summary>
-        /// Spectrum index
+        /// Constructor
         /// </summary>
-        public int Index { get; set; }
+        /// <param name="startScan"></param>
+        /// <param name="endScan"></param>
+        /// <param name="precursorNeutralMass"></param>
+        /// <param name="assumedCharge"></param>
+        /// <param name="elutionTimeMinutes"></param>
+        /// <param name="collisionMode"></param>
+        /// <param name="index"></param>
+        public SpectrumInfo(
+            int startScan,
+            int endScan,
+            double precursorNeutralMass,
+            int assumedCharge,
+            double elutionTimeMinutes,
+            PepXMLWriter.ActivationMethods collisionMode,
+            int index)
+        {
+            PrecursorNeutralMass = precursorNeutralMass;
+            ElutionTimeMinutes = elutionTimeMinutes;
+            StartScan = startScan;
+            EndScan = endScan;
+            AssumedCharge = assumedCharge;
+            Index = index;
+            CollisionMode = collisionMode;
+        }
 
         /// <summary>
-        /// Native ID (as assigned by msconvert.exe)
+        /// Construct the native ID (as assigned by msconvert.exe) for this spectrum
+        /// This allows for linking up with data in .mzML files
         /// </summary>
-        public string NativeID { get; set; }
+        public string GetNativeID()
+        {
+            // Examples:
+            // Most Thermo raw files: "controllerType=0 controllerNumber=1 scan=6"
+            // Thermo raw with PQD spectra: "controllerType=1 controllerNumber=1 scan=6"
+            // Wiff files: "sample=1 period=1 cycle=123 experiment=2"
+            // Waters files: "function=2 process=0 scan=123
+
+            // For now, we're assuming all data processed by this program is from Thermo raw files
+
+            return "controllerType=0 controllerNumber=1 scan=" + StartScan;
+        }
 
         /// <summary>
-        /// Constructor
+        /// Construct the spectrum title
         /// </summary>
-        /// <param name="title"></param>
-        public SpectrumInfo(string title)
+        /// <remarks>
+        /// Example title: QC_05_2_05Dec05_Doc_0508-08.9427.9427.1
+        /// </remarks>
+        /// <param name="datasetName"></param>
+        public string GetSpectrumTitle(string datasetName)
         {
-            SpectrumTitle = title;
+            return datasetName + "." + StartScan + "." + EndScan + "." + AssumedCharge;
         }
     }
 }
@@ -0,0 +1,82 @@
+﻿using System;
+
+namespace PeptideListToXML
+{
+    /// <summary>
+    /// Key used to group cached PSMs by spectrum: start scan, end scan, and charge
+    /// </summary>
+    /// <remarks>
+    /// This is a value type so that dictionaries keyed by spectrum do not store a string for each spectrum;
+    /// the spectrum title (Dataset.StartScan.EndScan.Charge) is constructed when the spectrum is written
+    /// </remarks>
+    public readonly struct SpectrumKey : IEquatable<SpectrumKey>
+    {
+        /// <summary>
+        /// Start scan number
+        /// </summary>
+        public int StartScan { get; }
+
+        /// <summary>
+        /// End scan number
+        /// </summary>
+        public int EndScan { get; }
+
+        /// <summary>
+        /// Charge state
+        /// </summary>
+        public int Charge { get; }
+
+        /// <summary>
+        /// Constructor
+        /// </summary>
+        /// <param name="startScan"></param>
+        /// <param name="endScan"></param>
+        /// <param name="charge"></param>
+        public SpectrumKey(int startScan, int endScan, int charge)
+        {
+            StartScan = startScan;
+            EndScan = endScan;
+            Charge = charge;
+        }
+
+        /// <summary>
+        /// Check whether this key has the same scans and charge as another key
+        /// </summary>
+        /// <param name="other"></param>
+        public bool Equals(SpectrumKey other)
+        {
+            return StartScan == other.StartScan && EndScan == other.EndScan && Charge == other.Charge;
+        }
+
+        /// <summary>
+        /// Check whether obj is a SpectrumKey with the same scans and charge
+        /// </summary>
+        /// <param name="obj"></param>
+        public override bool Equals(object obj)
+        {
+            return obj is SpectrumKey other && Equals(other);
+        }
+
+        /// <summary>
+        /// Hash code
+        /// </summary>
+        public override int GetHashCode()
+        {
+            unchecked
+            {
+                var hashCode = StartScan;
+                hashCode = hashCode * 397 ^ EndScan;
+                return hashCode * 397 ^ Charge;
+            }
+        }
+
+        /// <summary>
+        /// Construct the spectrum title, e.g. QC_05_2_05Dec05_Doc_0508-08.9427.9427.1
+        /// </summary>
+        /// <param name="datasetName"></param>
+        public string GetSpectrumTitle(string datasetName)
+        {
+            return datasetName + "." + StartScan + "." + EndScan + "." + Charge;
+        }
+    }
+}
@@ -0,0 +1,231 @@
+#
+# Streaming, canonicalizing comparison of two .pepXML files
+#
+# Elements are compared by local name, attributes are compared independent of order,
+# whitespace-only text is ignored, and selected attributes (by default the date the file
+# was created) are excluded. Files ending in .gz are decompressed on the fly.
+#
+# This library file is used by verify_golden_output.py
+#
+# 2026-10-18 - Initial version
+# 2026-10-18 - Add omitted_elements, to compare to a reference file created with different options
+#
+
+import gzip
+import xml.etree.ElementTree as ET
+
+# Attributes that legitimately differ between runs; format is ElementName@AttributeName
+DEFAULT_IGNORED_ATTRIBUTES = ('msms_pipeline_analysis@date',)
+
+
+def local_name(tag):
+    """Remove the namespace from an element or attribute name"""
+    if tag[:1] == '{':
+        return tag[tag.index('}') + 1:]
+    return tag
+
+
+def open_pepxml(file_path):
+    """Open a .pepXML or .pepXML.gz file for binary reading"""
+    if file_path.lower().endswith('.gz'):
+        return gzip.open(file_path, 'rb')
+    return open(file_path, 'rb')
+
+
+class IgnoredAttributes:
+    """Tracks the attributes to skip; entries can be AttributeName or ElementName@AttributeName"""
+
+    def __init__(self, entries=DEFAULT_IGNORED_ATTRIBUTES):
+        self.any_element = set()
+        self.by_element = set()
+        for entry in entries:
+            if '@' in entry:
+                element, attribute = entry.split('@', 1)
+                self.by_element.add((element, attribute))
+            else:
+                self.any_element.add(entry)
+
+    def is_ignored(self, element_name, attribute_name):
+        return attribute_name in self.any_element or (element_name, attribute_name) in self.by_element
+
+
+def canonical_attributes(element_name, attrib, ignored):
+    return tuple(sorted(
+        (local_name(key), value) for key, value in attrib.items()
+        if not ignored.is_ignored(element_name, local_name(key))))
+
+
+def canonical_entries(element, ignored, element_path='', omitted_elements=()):
+    """
+    Flatten an element and its descendants into a list of (path, attributes, text) tuples, in document order
+    Child paths include the child's position, e.g. spectrum_query/search_result[1]/search_hit[2]/search_score[5]
+    Descendants whose local name is in omitted_elements are skipped, along with their children
+    """
+    name = local_name(element.tag)
+    path = element_path or name
+    text = (element.text or '').strip()
+    entries = [(path, canonical_attributes(name, element.attrib, ignored), text)]
+
+    child_counts = {}
+    for child in element:
+        child_name = local_name(child.tag)
+        if child_name in omitted_elements:
+            continue
+
+        child_counts[child_name] = child_counts.get(child_name, 0) + 1
+        child_path = '%s/%s[%d]' % (path, child_name, child_counts[child_name])
+        entries.extend(canonical_entries(child, ignored, child_path, omitted_elements))
+
+    return entries
+
+
+def iter_canonical_items(file_path, ignored, omitted_elements=()):
+    """
+    Stream a pepXML file, yielding one item per header element and one item per spectrum_query
+
+    Items are tuples of (kind, key, entries)
+      kind is 'header' or 'spectrum_query'
+      key is the element path for header elements and the spectrum title for spectrum queries
+      entries is the list returned by canonical_entries
+    Memory use is bounded by the size of the largest spectrum_query
+    """
+    with open_pepxml(file_path) as reader:
+        stack = []
+        in_spectrum = 0
+
+        for event, element in ET.iterparse(reader, events=('start', 'end')):
+            name = local_name(element.tag)
+
+            if event == 'start':
+                stack.append(element)
+                if name == 'spectrum_query':
+                    in_spectrum += 1
+                elif in_spectrum == 0:
+                    path = '/'.join(local_name(item.tag) for item in stack)
+                    yield 'header', path, [(path, canonical_attributes(name, element.attrib, ignored), '')]
+                continue
+
+            stack.pop()
+            if name != 'spectrum_query':
+                continue
+
+            in_spectrum -= 1
+            yield 'spectrum_query', element.get('spectrum', ''), canonical_entries(element, ignored, '', omitted_elements)
+
+            # Release the parsed spectrum so that memory use does not grow with file size
+            element.clear()
+            if stack:
+                stack[-1].remove(element)
+
+
+def describe_entry_difference(expected, actual):
+    """Return a short, attribute-level description of how two canonical entries differ"""
+    expected_path, expected_attributes, expected_text = expected
+    actual_path, actual_attributes, actual_text = actual
+
+    if expected_path != actual_path:
+        return 'element %s expected, found %s' % (expected_path, actual_path)
+
+    details = []
+    expected_map = dict(expected_attributes)
+    actual_map = dict(actual_attributes)
+    for key in sorted(set(expected_map) | set(actual_map)):
+        if key not in actual_map:
+            details.append('%s: missing attribute %s' % (expected_path, key))
+        elif key not in expected_map:
+            details.append('%s: unexpected attribute %s="%s"' % (expected_path, key, actual_map[key]))
+        elif expected_map[key] != actual_map[key]:
+            details.append('%s@%s: expected "%s", found "%s"' % (expected_path, key, expected_map[key], actual_map[key]))
+
+    if expected_text != actual_text:
+        details.append('%s: expected text "%s", found "%s"' % (expected_path, expected_text, actual_text))
+
+    return '; '.join(details)
+
+
+def describe_difference(expected_entries, actual_entries):
+    for expected, actual in zip(expected_entries, actual_entries):
+        if expected != actual:
+            return describe_entry_difference(expected, actual)
+
+    if len(expected_entries) > len(actual_entries):
+        return 'missing element %s' % expected_entries[len(actual_entries)][0]
+
+    return 'unexpected element %s' % actual_entries[len(expected_entries)][0]
+
+
+class ComparisonResult:
+    """Outcome of compare_files"""
+
+    def __init__(self):
+        self.spectra_compared = 0
+        self.spectra_differing = 0
+        self.header_differences = 0
+        self.first_difference = ''
+
+    @property
+    def identical(self):
+        return self.spectra_differing == 0 and self.header_differences == 0
+
+    def record(self, message):
+        if not self.first_difference:
+            self.first_difference = message
+
+
+def compare_files(expected_file, actual_file, ignored=None, omitted_elements=()):
+    """
+    Compare two pepXML files in a single streaming pass over each
+    The first differing spectrum_query (or header element) is described in result.first_difference
+    Elements within spectrum queries whose local name is in omitted_elements are removed from the expected file only,
+    so that the actual file must not contain them
+    """
+    if ignored is None:
+        ignored = IgnoredAttributes()
+
+    result = ComparisonResult()
+    expected_items = iter_canonical_items(expected_file, ignored, omitted_elements)
+    actual_items = iter_canonical_items(actual_file, ignored)
+    sentinel = (None, None, None)
+
+    while True:
+        expected = next(expected_items, sentinel)
+        actual = next(actual_items, sentinel)
+
+        if expected is sentinel and actual is sentinel:
+            break
+
+        if expected is sentinel:
+            result.spectra_differing += actual[0] == 'spectrum_query'
+            result.header_differences += actual[0] == 'header'
+            result.record('Unexpected %s %s after the end of the expected file' % (actual[0], actual[1]))
+            continue
+
+        if actual is sentinel:
+            result.spectra_differing += expected[0] == 'spectrum_query'
+            result.header_differences += expected[0] == 'header'
+            result.record('Missing %s %s' % (expected[0], expected[1]))
+            continue
+
+        expected_kind, expected_key, expected_entries = expected
+        actual_kind, actual_key, actual_entries = actual
+
+        if expected_kind == 'spectrum_query':
+            result.spectra_compared += 1
+
+        if expected_kind == actual_kind and expected_entries == actual_entries:
+            continue
+
+        if expected_kind == 'spectrum_query' or actual_kind == 'spectrum_query':
+            result.spectra_differing += 1
+        else:
+            result.header_differences += 1
+
+        if expected_kind != actual_kind:
+            result.record('Expected %s %s, found %s %s' % (expected_kind, expected_key, actual_kind, actual_key))
+        elif expected_kind == 'spectrum_query':
+            result.record('spectrum_query %s (#%d): %s' % (
+                expected_key, result.spectra_compared, describe_difference(expected_entries, actual_entries)))
+        else:
+            result.record('Header element %s: %s' % (expected_key, describe_difference(expected_entries, actual_entries)))
+
+    return result
@@ -0,0 +1,196 @@
+#!/usr/bin/python
+
+#
+# Structural diff of two .pepXML files
+#
+# Each file is read once, in parallel, and each canonicalized spectrum_query is reduced
+# to a hash keyed by its spectrum title. The hashes are compared to find added, removed,
+# and changed spectra. A second streaming pass then reports attribute-level differences
+# for the changed spectra (up to --max-details of them).
+#
+# Run time is linear in the file size, and memory use is one hash per spectrum plus the
+# largest spectrum_query. The canonicalization (attribute order, whitespace, and ignored
+# attributes) is the same as in verify_golden_output.py.
+#
+# Example usage:
+#   python pepxml_diff.py Old.pepXML New.pepXML
+#   python pepxml_diff.py Old.pepXML.gz New.pepXML.gz --max-details 100 --ignore date
+#
+# Exit code is 0 if the files are equivalent, 1 if they differ, and 2 if a file could not be read
+#
+# 2026-10-18 - Initial version
+# 2026-10-18 - Compare repeated header elements (e.g. parameter) by position instead of only the first one
+#
+
+import argparse
+import hashlib
+import os
+import sys
+from concurrent.futures import ProcessPoolExecutor
+
+# Import pepxml_canonical.py, which should be in the same directory as pepxml_diff.py
+import pepxml_canonical
+
+HASH_SIZE_BYTES = 16
+
+
+def hash_entries(entries):
+    return hashlib.blake2b(repr(entries).encode('utf-8'), digest_size=HASH_SIZE_BYTES).digest()
+
+
+class FileHashes:
+    """Hashes of the header elements and spectrum queries in a pepXML file"""
+
+    def __init__(self):
+        # Keys are element paths, with the occurrence number of the path, e.g. .../search_summary/parameter[2]; values are hashes
+        self.header = {}
+
+        # Keys are spectrum titles; values are hashes
+        self.spectra = {}
+
+        # Spectrum titles that appear more than once; only the first occurrence is compared
+        self.duplicate_spectra = []
+
+
+def hash_file(file_path, ignored):
+    """Stream a pepXML file, computing a hash for each header element and each spectrum_query"""
+    hashes = FileHashes()
+
+    # Keys are header element paths; values are the number of elements found with that path
+    header_path_counts = {}
+
+    for kind, key, entries in pepxml_canonical.iter_canonical_items(file_path, ignored):
+        if kind != 'spectrum_query':
+            # Header elements such as parameter and aminoacid_modification are repeated, so number them
+            # in the order they appear (like the child paths in canonical_entries)
+            header_path_counts[key] = header_path_counts.get(key, 0) + 1
+            hashes.header['%s[%d]' % (key, header_path_counts[key])] = hash_entries(entries)
+            continue
+
+        if key in hashes.spectra:
+            hashes.duplicate_spectra.append(key)
+            continue
+
+        hashes.spectra[key] = hash_entries(entries)
+
+    return hashes
+
+
+def load_entries(file_path, ignored, spectrum_titles):
+    """Stream a pepXML file, keeping the canonical entries for the given spectrum titles"""
+    entries_by_title = {}
+
+    for kind, key, entries in pepxml_canonical.iter_canonical_items(file_path, ignored):
+        if kind == 'spectrum_query' and key in spectrum_titles and key not in entries_by_title:
+            entries_by_title[key] = entries
+
+    return entries_by_title
+
+
+def describe_all_differences(old_entries, new_entries):
+    """List the attribute-level differences between the canonical entries of two spectrum queries"""
+    details = []
+    new_by_path = {entry[0]: entry for entry in new_entries}
+    old_paths = set()
+
+    for old_entry in old_entries:
+        old_paths.add(old_entry[0])
+        new_entry = new_by_path.get(old_entry[0])
+        if new_entry is None:
+            details.append('removed element %s' % old_entry[0])
+        elif new_entry != old_entry:
+            details.append(pepxml_canonical.describe_entry_difference(old_entry, new_entry))
+
+    for new_entry in new_entries:
+        if new_entry[0] not in old_paths:
+            details.append('added element %s' % new_entry[0])
+
+    return details
+
+
+def print_titles(label, titles, max_titles):
+    print('%s: %d' % (label, len(titles)))
+    for title in titles[:max_titles]:
+        print('  %s' % title)
+
+    if len(titles) > max_titles:
+        print('  ... %d more' % (len(titles) - max_titles))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Report the spectra that were added, removed, or changed between two .pepXML files')
+    parser.add_argument('old_file', help='Original .pepXML or .pepXML.gz file')
+    parser.add_argument('new_file', help='New .pepXML or .pepXML.gz file')
+    parser.add_argument('--ignore', nargs='*', default=[],
+                        help='Additional attributes to ignore, as AttributeName or ElementName@AttributeName')
+    parser.add_argument('--max-details', type=int, default=20,
+                        help='Maximum number of changed spectra to describe at the attribute level')
+    parser.add_argument('--max-titles', type=int, default=20,
+                        help='Maximum number of added or removed spectrum titles to list')
+    options = parser.parse_args()
+
+    for file_path in (options.old_file, options.new_file):
+        if not os.path.exists(file_path):
+            print('File not found: %s' % file_path)
+            return 2
+
+    ignored = pepxml_canonical.IgnoredAttributes(list(pepxml_canonical.DEFAULT_IGNORED_ATTRIBUTES) + options.ignore)
+
+    with ProcessPoolExecutor(max_workers=2) as executor:
+        try:
+            old_future = executor.submit(hash_file, options.old_file, ignored)
+            new_future = executor.submit(hash_file, options.new_file, ignored)
+            old_hashes = old_future.result()
+            new_hashes = new_future.result()
+        except Exception as ex:
+            print('Error reading the pepXML files: %s' % ex)
+            return 2
+
+        removed = [title for title in old_hashes.spectra if title not in new_hashes.spectra]
+        added = [title for title in new_hashes.spectra if title not in old_hashes.spectra]
+        changed = [title for title, digest in old_hashes.spectra.items()
+                   if title in new_hashes.spectra and new_hashes.spectra[title] != digest]
+
+        header_changes = sorted(path for path in set(old_hashes.header) | set(new_hashes.header)
+                                if old_hashes.header.get(path) != new_hashes.header.get(path))
+
+        titles_to_describe = set(changed[:max(0, options.max_details)])
+        if titles_to_describe:
+            old_future = executor.submit(load_entries, options.old_file, ignored, titles_to_describe)
+            new_future = executor.submit(load_entries, options.new_file, ignored, titles_to_describe)
+            old_entries = old_future.result()
+            new_entries = new_future.result()
+
+    print('Old file: %s (%d spectra)' % (options.old_file, len(old_hashes.spectra)))
+    print('New file: %s (%d spectra)' % (options.new_file, len(new_hashes.spectra)))
+    print()
+
+    for label, hashes in (('old', old_hashes), ('new', new_hashes)):
+        if hashes.duplicate_spectra:
+            print('Warning: %d duplicate spectrum titles in the %s file; only the first of each was compared' % (
+                len(hashes.duplicate_spectra), label))
+
+    print_titles('Header elements changed', header_changes, options.max_titles)
+    print_titles('Spectra removed', removed, options.max_titles)
+    print_titles('Spectra added', added, options.max_titles)
+    print('Spectra changed: %d' % len(changed))
+
+    for title in changed:
+        if title not in titles_to_describe:
+            print('  ... %d more' % (len(changed) - len(titles_to_describe)))
+            break
+
+        print('  %s' % title)
+        for detail in describe_all_differences(old_entries[title], new_entries[title]):
+            print('    %s' % detail)
+
+    if header_changes or removed or added or changed:
+        return 1
+
+    print()
+    print('The files are equivalent')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
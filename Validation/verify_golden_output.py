@@ -0,0 +1,216 @@
+#!/usr/bin/python
+
+#
+# Golden-output regression harness for PeptideListToXML
+#
+# Converts each example dataset in the Data directory using every conversion mode supported
+# by the executable, then compares the results to the checked-in .pepXML files using a
+# canonicalizing comparison that ignores the creation date. The first differing
+# spectrum_query is reported for each mismatch.
+#
+# Example usage:
+#   python verify_golden_output.py
+#   python verify_golden_output.py --exe ..\bin\Release\PeptideListToXML.exe --modes serial
+#   python verify_golden_output.py --runner mono --exe ../bin/PeptideListToXML.exe
+#
+# Exit code is 0 if all outputs match, 1 if any output differs, and 2 if a conversion failed
+#
+# 2026-10-18 - Initial version
+# 2026-10-18 - Add the maxproteins mode, which checks that num_tot_proteins is not limited by /MaxProteins
+#
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+# Import pepxml_canonical.py, which should be in the same directory as verify_golden_output.py
+import pepxml_canonical
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Each dataset is run from its directory, with the same arguments as the Run_PeptideListToXML.bat file
+# Reference paths are relative to the Data directory
+DATASETS = [
+    {
+        'name': 'MSGFPlus',
+        'directory': 'MSGFPlus_Example',
+        'args': ['/I:QC_Shew_13_05b_HCD_500ng_24Mar14_Tiger_14-03-04_msgfplus_syn.txt',
+                 '/E:MSGFPlus_PartTryp_MetOx_20ppmParTol.txt'],
+        'reference': 'MSGFPlus_Example/QC_Shew_13_05b_HCD_500ng_24Mar14_Tiger_14-03-04.pepXML',
+    },
+    {
+        'name': 'MaxQuant',
+        'directory': 'MaxQuant_Example',
+        'args': ['/I:QC_Mam_19_01_Run3_02Jun21_Cicero_WBEH-20-09-08_maxq_syn.txt',
+                 '/E:MaxQuant_Tryp_Stat_CysAlk_Dyn_MetOx_NTermAcet_20ppmParTol.xml',
+                 '/NoMSGF'],
+        'reference': 'MaxQuant_Example/QC_Mam_19_01_Run3_02Jun21_Cicero_WBEH-20-09-08.pepXML',
+    },
+    {
+        'name': 'XTandem',
+        'directory': 'XTandem_Example',
+        'args': ['/I:QC_Shew_12_02_pt5_2c_20Dec12_Leopard_12-11-10_xt.txt',
+                 '/E:xtandem_Rnd1PartTryp_Rnd2DynMetOx.xml'],
+        'reference': 'XTandem_Example/QC_Shew_12_02_pt5_2c_20Dec12_Leopard_12-11-10.pepXML',
+    },
+    {
+        'name': 'XTandem_NoScanStats',
+        'directory': 'XTandem_Example',
+        'args': ['/I:QC_Shew_12_02_pt5_2c_20Dec12_Leopard_12-11-10_xt.txt',
+                 '/E:xtandem_Rnd1PartTryp_Rnd2DynMetOx.xml',
+                 '/NoScanStats'],
+        'reference': 'XTandem_Example/NoScanStats/QC_Shew_12_02_pt5_2c_20Dec12_Leopard_12-11-10.pepXML',
+    },
+]
+
+# Conversion modes
+#   switch:    command line switch that enables the mode; the mode is skipped if the program syntax does not list it
+#   args:      additional arguments to pass
+#   extension: extension of the file created by the mode
+#   omit:      elements to remove from the reference file before comparing (optional)
+# The maxproteins mode limits each PSM to one protein, so the output must not have alternative_protein elements,
+# but num_tot_proteins must still be the total number of proteins, as in the reference file
+MODES = {
+    'serial':      {'switch': '',            'args': [],                 'extension': '.pepXML'},
+    'streaming':   {'switch': 'Stream',      'args': ['/Stream'],        'extension': '.pepXML'},
+    'parallel':    {'switch': 'Threads',     'args': ['/Threads:4'],     'extension': '.pepXML'},
+    'compressed':  {'switch': 'GZip',        'args': ['/GZip'],          'extension': '.pepXML.gz'},
+    'maxproteins': {'switch': 'MaxProteins', 'args': ['/MaxProteins:1'], 'extension': '.pepXML',
+                    'omit': ['alternative_protein']},
+}
+
+
+def build_command(runner, exe_path, args):
+    command = [exe_path] + args
+    if runner:
+        command = runner.split() + command
+    return command
+
+
+def get_supported_switches(runner, exe_path):
+    """Run the program without arguments and parse the command line switches listed in the program syntax"""
+    process = subprocess.run(build_command(runner, exe_path, []),
+                             stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                             universal_newlines=True, timeout=60)
+
+    switches = set()
+    for word in process.stdout.replace('[', ' ').replace(']', ' ').split():
+        if word.startswith('/') and len(word) > 1:
+            switches.add(word[1:].split(':')[0].lower())
+
+    return switches
+
+
+def run_conversion(runner, exe_path, data_dir, dataset, mode, output_dir):
+    """Convert one dataset; returns the path to the output file, or None if the conversion failed"""
+    os.makedirs(output_dir, exist_ok=True)
+    log_path = os.path.join(output_dir, 'PeptideListToXML_ConsoleOutput.txt')
+
+    args = dataset['args'] + MODES[mode]['args'] + ['/O:' + output_dir]
+    with open(log_path, 'w') as log_file:
+        process = subprocess.run(build_command(runner, exe_path, args),
+                                 cwd=os.path.join(data_dir, dataset['directory']),
+                                 stdout=log_file, stderr=subprocess.STDOUT)
+
+    reference_name = os.path.basename(dataset['reference'])
+    output_path = os.path.join(output_dir, os.path.splitext(reference_name)[0] + MODES[mode]['extension'])
+
+    if process.returncode != 0 or not os.path.exists(output_path):
+        print('  Conversion failed (exit code %d); see %s' % (process.returncode, log_path))
+        return None
+
+    return output_path
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare PeptideListToXML output to the checked-in .pepXML files')
+    parser.add_argument('--exe', default=os.path.join(REPO_DIR, 'bin', 'PeptideListToXML.exe'),
+                        help='Path to PeptideListToXML.exe')
+    parser.add_argument('--runner', default='',
+                        help='Optional program used to start the executable, e.g. mono or dotnet')
+    parser.add_argument('--data-dir', default=os.path.join(REPO_DIR, 'Data'),
+                        help='Directory with the example datasets')
+    parser.add_argument('--modes', nargs='+', choices=list(MODES), default=list(MODES),
+                        help='Conversion modes to test')
+    parser.add_argument('--datasets', nargs='+', choices=[item['name'] for item in DATASETS],
+                        default=[item['name'] for item in DATASETS], help='Datasets to test')
+    parser.add_argument('--ignore', nargs='*', default=[],
+                        help='Additional attributes to ignore, as AttributeName or ElementName@AttributeName')
+    parser.add_argument('--work-dir', default='',
+                        help='Directory for the converted files; a temporary directory is used if not defined')
+    parser.add_argument('--keep-output', action='store_true', help='Do not delete the converted files')
+    options = parser.parse_args()
+
+    exe_path = os.path.abspath(options.exe)
+    if not os.path.exists(exe_path):
+        print('Executable not found: %s' % exe_path)
+        return 2
+
+    ignored = pepxml_canonical.IgnoredAttributes(list(pepxml_canonical.DEFAULT_IGNORED_ATTRIBUTES) + options.ignore)
+    supported_switches = get_supported_switches(options.runner, exe_path)
+
+    work_dir = os.path.abspath(options.work_dir) if options.work_dir else tempfile.mkdtemp(prefix='PeptideListToXML_')
+
+    results = []
+    try:
+        for dataset in DATASETS:
+            if dataset['name'] not in options.datasets:
+                continue
+
+            reference_path = os.path.join(options.data_dir, dataset['reference'])
+
+            for mode in options.modes:
+                label = '%s, %s' % (dataset['name'], mode)
+                switch = MODES[mode]['switch']
+
+                if switch and switch.lower() not in supported_switches:
+                    print('%-32s SKIPPED (switch /%s is not supported by this build)' % (label, switch))
+                    results.append('skipped')
+                    continue
+
+                if not os.path.exists(reference_path):
+                    print('%-32s SKIPPED (reference file not found: %s)' % (label, dataset['reference']))
+                    results.append('skipped')
+                    continue
+
+                output_path = run_conversion(options.runner, exe_path, options.data_dir, dataset, mode,
+                                             os.path.join(work_dir, mode, dataset['name']))
+                if output_path is None:
+                    print('%-32s FAILED' % label)
+                    results.append('failed')
+                    continue
+
+                comparison = pepxml_canonical.compare_files(reference_path, output_path, ignored,
+                                                            MODES[mode].get('omit', ()))
+                if comparison.identical:
+                    print('%-32s OK (%d spectra)' % (label, comparison.spectra_compared))
+                    results.append('ok')
+                else:
+                    print('%-32s DIFFERENT (%d of %d spectra differ, %d header differences)' % (
+                        label, comparison.spectra_differing, comparison.spectra_compared, comparison.header_differences))
+                    print('  First difference: %s' % comparison.first_difference)
+                    results.append('different')
+    finally:
+        if options.keep_output or options.work_dir:
+            print('Converted files are in %s' % work_dir)
+        else:
+            shutil.rmtree(work_dir, ignore_errors=True)
+
+    print()
+    print('%d OK, %d different, %d failed, %d skipped' % (
+        results.count('ok'), results.count('different'), results.count('failed'), results.count('skipped')))
+
+    if 'failed' in results:
+        return 2
+
+    if 'different' in results:
+        return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())